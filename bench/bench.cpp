@@ -0,0 +1,358 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../src/adsr.h"
+#include "../src/audio_graph.h"
+#include "../src/compressor.h"
+#include "../src/convolution_filter.h"
+#include "../src/delay.h"
+#include "../src/fft.h"
+#include "../src/first_order_filter.h"
+#include "../src/fm_synth.h"
+#include "../src/limiter.h"
+#include "../src/moorer_reverb.h"
+#include "../src/noise_gate.h"
+#include "../src/oscillator.h"
+#include "../src/second_order_filter.h"
+#include "../src/subtractive_synth.h"
+#include "../src/vector_ops.h"
+
+using namespace ClickTrack;
+
+
+/* Runs every processing class headless, and prints one CSV row per case:
+ *     name,block_size,channels,ns_per_sample,samples_per_sec_per_channel
+ *
+ * Each case runs the given number of independent copies of the class in one
+ * graph, each fed by its own noise source. For instruments, channels is the
+ * number of voices held down instead. Times are the median of several
+ * repetitions, after a warm-up.
+ *
+ * The block size is fixed at build time, so `make bench` builds this once
+ * for each block size.
+ */
+const unsigned WARMUP_SAMPLES = SAMPLE_RATE/4;
+const unsigned MEASURE_SAMPLES = SAMPLE_RATE/2;
+const unsigned REPETITIONS = 5;
+const unsigned CHANNEL_COUNTS[] = {1, 2, 8};
+const unsigned VOICE_COUNTS[] = {1, 8, 32, 128};
+const unsigned DEVICE_CHANNEL_COUNTS[] = {2, 8, 16, 32};
+
+
+/* A generator that loops a precomputed block of noise, as a cheap input
+ */
+class NoiseSource : public AudioGenerator
+{
+    public:
+        NoiseSource() : AudioGenerator(1), noise(BUFFER_SIZE)
+        {
+            for(auto& sample : noise)
+                sample = 0.5 * (2.0*rand()/RAND_MAX - 1.0);
+        }
+
+    private:
+        void generate_block(std::vector<SAMPLE*>& outputs, unsigned long t)
+        {
+            std::copy(noise.begin(), noise.end(), outputs[0]);
+        }
+
+        std::vector<SAMPLE> noise;
+};
+
+
+/* A consumer that pulls its inputs and throws them away
+ */
+class NullSink : public AudioConsumer
+{
+    public:
+        NullSink(unsigned num_inputs) : AudioConsumer(num_inputs) {}
+
+    private:
+        void process_block(std::vector<const SAMPLE*>& inputs,
+                unsigned long t) {}
+};
+
+
+/* Prints one result row
+ */
+void report(const std::string& name, unsigned channels, double seconds,
+        unsigned long samples)
+{
+    std::cout << name << "," << BUFFER_SIZE << "," << channels << "," <<
+        1e9*seconds/samples/channels << "," << samples/seconds << std::endl;
+}
+
+
+/* Times a function that processes the given number of samples on each call,
+ * and returns the median time of one call in seconds
+ */
+double time_median(std::function<void()> run)
+{
+    run();
+
+    std::vector<double> times;
+    for(unsigned i = 0; i < REPETITIONS; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        times.push_back(elapsed.count());
+    }
+
+    std::sort(times.begin(), times.end());
+    return times[REPETITIONS/2];
+}
+
+
+/* Runs a graph through a warm-up, then times it
+ */
+void bench_graph(const std::string& name, unsigned channels, AudioGraph& graph)
+{
+    unsigned long t = 0;
+    for(; t < WARMUP_SAMPLES; t += BUFFER_SIZE)
+        graph.run(t);
+
+    double seconds = time_median([&graph, &t]()
+    {
+        for(unsigned i = 0; i < MEASURE_SAMPLES; i += BUFFER_SIZE, t += BUFFER_SIZE)
+            graph.run(t);
+    });
+    report(name, channels, seconds, MEASURE_SAMPLES);
+}
+
+
+/* Benchmarks independent copies of a generator
+ */
+void bench_generator(const std::string& name,
+        std::function<AudioGenerator*()> make)
+{
+    for(unsigned channels : CHANNEL_COUNTS)
+    {
+        std::vector<AudioGenerator*> generators;
+        NullSink sink(channels);
+        for(unsigned i = 0; i < channels; i++)
+        {
+            generators.push_back(make());
+            sink.set_input_channel(generators[i]->get_output_channel(), i);
+        }
+
+        AudioGraph graph;
+        graph.add_consumer(&sink);
+        bench_graph(name, channels, graph);
+
+        for(auto generator : generators)
+            delete generator;
+    }
+}
+
+
+/* Benchmarks independent copies of a filter, each fed by noise
+ */
+template <class FilterT>
+void bench_filter(const std::string& name, std::function<FilterT*()> make)
+{
+    for(unsigned channels : CHANNEL_COUNTS)
+    {
+        std::vector<NoiseSource*> sources;
+        std::vector<FilterT*> filters;
+        NullSink sink(channels);
+        for(unsigned i = 0; i < channels; i++)
+        {
+            sources.push_back(new NoiseSource());
+            filters.push_back(make());
+            filters[i]->set_input_channel(sources[i]->get_output_channel());
+            sink.set_input_channel(filters[i]->get_output_channel(), i);
+        }
+
+        AudioGraph graph;
+        graph.add_consumer(&sink);
+        bench_graph(name, channels, graph);
+
+        for(unsigned i = 0; i < channels; i++)
+        {
+            delete filters[i];
+            delete sources[i];
+        }
+    }
+}
+
+
+/* Benchmarks an instrument with the given number of notes held down
+ */
+template <class InstrumentT>
+void bench_instrument(const std::string& name,
+        PolyphonicInstrument::VoiceBackend backend =
+            PolyphonicInstrument::OBJECT_VOICES)
+{
+    for(unsigned voices : VOICE_COUNTS)
+    {
+        InstrumentT instrument(voices, backend);
+        for(unsigned i = 0; i < voices; i++)
+            instrument.on_note_down((36 + i) % 128, 1.0);
+
+        NullSink sink(1);
+        sink.set_input_channel(instrument.get_output_channel());
+
+        AudioGraph graph;
+        graph.add_consumer(&sink);
+        bench_graph(name, voices, graph);
+    }
+}
+
+
+/* Benchmarks each kind of transform at one size
+ */
+void bench_transformer(unsigned size)
+{
+    Transformer transformer(size);
+    std::vector<std::complex<SAMPLE> > complex_in(size), complex_out(size);
+    std::vector<SAMPLE> real(size);
+    for(unsigned i = 0; i < size; i++)
+    {
+        real[i] = 2.0*rand()/RAND_MAX - 1.0;
+        complex_in[i] = real[i];
+    }
+
+    // Run enough transforms to cover the usual measurement length
+    const unsigned transforms = std::max(1u, MEASURE_SAMPLES/size);
+    const unsigned long samples = (unsigned long) transforms*size;
+    std::string suffix = "/" + std::to_string(size);
+
+    report("Transformer.fft" + suffix, 1, time_median([&]()
+    {
+        for(unsigned i = 0; i < transforms; i++)
+            transformer.fft(&complex_in[0], &complex_out[0]);
+    }), samples);
+
+    report("Transformer.ifft" + suffix, 1, time_median([&]()
+    {
+        for(unsigned i = 0; i < transforms; i++)
+            transformer.ifft(&complex_in[0], &complex_out[0]);
+    }), samples);
+
+    report("Transformer.rfft" + suffix, 1, time_median([&]()
+    {
+        for(unsigned i = 0; i < transforms; i++)
+            transformer.rfft(&real[0], &complex_out[0]);
+    }), samples);
+}
+
+
+/* Benchmarks moving blocks to and from an interleaved device buffer
+ */
+void bench_device_io()
+{
+    for(unsigned channels : DEVICE_CHANNEL_COUNTS)
+    {
+        std::vector<std::vector<SAMPLE> > blocks(channels,
+                std::vector<SAMPLE>(BUFFER_SIZE));
+        std::vector<const SAMPLE*> in;
+        std::vector<SAMPLE*> out;
+        for(auto& block : blocks)
+        {
+            for(auto& sample : block)
+                sample = 2.0*rand()/RAND_MAX - 1.0;
+            in.push_back(&block[0]);
+            out.push_back(&block[0]);
+        }
+        std::vector<SAMPLE> device(channels*BUFFER_SIZE);
+
+        const unsigned blocks_per_run = MEASURE_SAMPLES/BUFFER_SIZE;
+        report("interleave_clamp", channels, time_median([&]()
+        {
+            for(unsigned i = 0; i < blocks_per_run; i++)
+                interleave_clamp(&in[0], channels, &device[0], BUFFER_SIZE);
+        }), blocks_per_run*BUFFER_SIZE);
+        report("deinterleave", channels, time_median([&]()
+        {
+            for(unsigned i = 0; i < blocks_per_run; i++)
+                deinterleave(&device[0], channels, &out[0], BUFFER_SIZE);
+        }), blocks_per_run*BUFFER_SIZE);
+    }
+}
+
+
+int main()
+{
+    // Oscillators, in every mode
+    const std::pair<Oscillator::Mode, std::string> modes[] = {
+        {Oscillator::Sine, "Sine"}, {Oscillator::Saw, "Saw"},
+        {Oscillator::Square, "Square"}, {Oscillator::Tri, "Tri"},
+        {Oscillator::WhiteNoise, "WhiteNoise"},
+        {Oscillator::BlepSaw, "BlepSaw"},
+        {Oscillator::BlepSquare, "BlepSquare"},
+        {Oscillator::BlepTri, "BlepTri"},
+        {Oscillator::PulseTrain, "PulseTrain"},
+        {Oscillator::TableSine, "TableSine"},
+        {Oscillator::TableSaw, "TableSaw"},
+        {Oscillator::TableSquare, "TableSquare"},
+        {Oscillator::TableTri, "TableTri"}};
+    for(auto& mode : modes)
+    {
+        Oscillator::Mode m = mode.first;
+        bench_generator("Oscillator." + mode.second,
+                [m]() { return new Oscillator(m, 440); });
+    }
+
+    // Filters
+    bench_filter<SecondOrderFilter>("SecondOrderFilter", []()
+        { return new SecondOrderFilter(SecondOrderFilter::LOWPASS, 1000); });
+    bench_filter<FirstOrderFilter>("FirstOrderFilter", []()
+        { return new FirstOrderFilter(FirstOrderFilter::LOWPASS, 1000); });
+
+    // Time based effects
+    bench_filter<MoorerReverb>("MoorerReverb", []()
+        { return new MoorerReverb(MoorerReverb::HALL, 2.0, 0.0, 0.5, 1); });
+    bench_filter<Delay>("Delay", []()
+        { return new Delay(0.3, 0.5, 0.5); });
+
+    std::vector<SAMPLE> impulse(SAMPLE_RATE);
+    for(unsigned i = 0; i < impulse.size(); i++)
+        impulse[i] = (2.0*rand()/RAND_MAX - 1.0) * exp(-5.0*i/SAMPLE_RATE);
+    bench_filter<ConvolutionFilter>("ConvolutionFilter", [&impulse]()
+        { return new ConvolutionFilter(impulse.size(), &impulse[0], 0.0, 0.5); });
+    bench_filter<ConvolutionFilter>("ConvolutionFilter.low_latency",
+        [&impulse]()
+        {
+            return new ConvolutionFilter(impulse.size(), &impulse[0], 0.0, 0.5,
+                    true);
+        });
+
+    // Dynamics
+    bench_filter<Compressor>("Compressor", []()
+        { return new Compressor(-20.0, 4.0); });
+    bench_filter<Limiter>("Limiter", []()
+        { return new Limiter(-6.0); });
+    bench_filter<NoiseGate>("NoiseGate", []()
+        { return new NoiseGate(-40.0, -50.0); });
+    bench_filter<ADSRFilter>("ADSRFilter", []()
+    {
+        ADSRFilter* adsr = new ADSRFilter();
+        adsr->on_note_down();
+        return adsr;
+    });
+
+    // Instruments
+    bench_instrument<FMSynth>("FMSynth");
+    bench_instrument<SubtractiveSynth>("SubtractiveSynth");
+    bench_instrument<FMSynth>("FMSynth.voice_bank",
+            PolyphonicInstrument::VOICE_BANK);
+    bench_instrument<SubtractiveSynth>("SubtractiveSynth.voice_bank",
+            PolyphonicInstrument::VOICE_BANK);
+
+    // Device I/O
+    bench_device_io();
+
+    // Transforms, which don't depend on the block size
+    for(unsigned size = 64; size <= 16384; size *= 2)
+        bench_transformer(size);
+
+    return 0;
+}
@@ -1,3 +1,4 @@
+#include <iostream>
 #include "../src/clip_detector.h"
 #include "../src/drum_machine.h"
 #include "../src/speaker.h"
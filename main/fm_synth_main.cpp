@@ -1,4 +1,5 @@
 #include <iostream>
+#include <thread>
 #include "../src/clip_detector.h"
 #include "../src/fm_synth.h"
 #include "../src/limiter.h"
@@ -13,6 +14,7 @@ int main()
 
     cout << "Initializing MIDI instrument" << endl;
     TimingManager timing;
+    timing.set_num_threads(std::thread::hardware_concurrency());
 
     MidiListener midi(timing, 1);
     FMSynth inst(10);
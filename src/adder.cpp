@@ -7,12 +7,17 @@ Adder::Adder(unsigned in_num_input_channels)
     : AudioFilter(in_num_input_channels, 1)
 {}
 
-void Adder::filter(std::vector<SAMPLE>& input,
-        std::vector<SAMPLE>& output, unsigned long t)
+void Adder::filter_block(std::vector<const SAMPLE*>& inputs,
+        std::vector<SAMPLE*>& outputs, unsigned long t)
 {
-    output[0] = 0;
-    for(int i = 0; i < input.size(); i++)
+    SAMPLE* out = outputs[0];
+    for(unsigned j = 0; j < BUFFER_SIZE; j++)
+        out[j] = 0;
+
+    for(unsigned i = 0; i < inputs.size(); i++)
     {
-        output[0] += input[i];
+        const SAMPLE* in = inputs[i];
+        for(unsigned j = 0; j < BUFFER_SIZE; j++)
+            out[j] += in[j];
     }
 }
@@ -15,8 +15,8 @@ namespace ClickTrack
             Adder(unsigned num_input_channels);
 
         private:
-            void filter(std::vector<SAMPLE>& input,
-                    std::vector<SAMPLE>& output, unsigned long t);
+            void filter_block(std::vector<const SAMPLE*>& inputs,
+                    std::vector<SAMPLE*>& outputs, unsigned long t);
     };
 }
 
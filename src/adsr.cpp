@@ -36,6 +36,18 @@ void ADSRFilter::on_note_up()
 }
 
 
+float ADSRFilter::get_level()
+{
+    return multiplier;
+}
+
+
+bool ADSRFilter::is_silent()
+{
+    return state == silent;
+}
+
+
 void ADSRFilter::set_attack_time(float in)
 {
     attack_time = SAMPLE_RATE*in;
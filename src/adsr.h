@@ -23,6 +23,15 @@ namespace ClickTrack
             void on_note_down();
             void on_note_up();
 
+            /* Returns the current envelope level, from 0 to 1
+             */
+            float get_level();
+
+            /* Returns true while the envelope is silent, before its first note
+             * or once its release has finished
+             */
+            bool is_silent();
+
             /* Setters for parameters
              */
             void set_attack_time(float attack_time);
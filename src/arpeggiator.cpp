@@ -56,8 +56,9 @@ void Arpeggiator::filter_events(std::vector<MidiMessage>& inputs,
             MidiMessage noteoff;
             noteoff.type = NOTE_UP;
             noteoff.channel = 0;
-            noteoff.message.push_back(current_note);
-            noteoff.message.push_back(0x7F);
+            noteoff.length = 2;
+            noteoff.message[0] = current_note;
+            noteoff.message[1] = 0x7F;
 
             outputs.push_back(noteoff);
             current_note = 0;
@@ -75,8 +76,9 @@ void Arpeggiator::filter_events(std::vector<MidiMessage>& inputs,
             MidiMessage noteon;
             noteon.type = NOTE_DOWN;
             noteon.channel = 0;
-            noteon.message.push_back(current_note);
-            noteon.message.push_back(0x7F);
+            noteon.length = 2;
+            noteon.message[0] = current_note;
+            noteon.message[1] = 0x7F;
 
             outputs.push_back(noteon);
         }
@@ -1,3 +1,4 @@
+#include <atomic>
 #include <iostream>
 #include "audio_generics.h"
 
@@ -5,15 +6,35 @@
 using namespace ClickTrack;
 
 
+// A block of silence, read in place of disconnected channels
+static const std::vector<SAMPLE> silent_block(BUFFER_SIZE, 0.0);
+
+
+// The revision of the signal chain wiring
+static std::atomic<unsigned long> graph_revision(0);
+
+unsigned long ClickTrack::get_graph_revision()
+{
+    return graph_revision.load();
+}
+
+
+void ClickTrack::mark_graph_changed()
+{
+    graph_revision++;
+}
+
+
+
 AudioChannel::AudioChannel(AudioGenerator& in_parent, unsigned long start_t)
-    : parent(in_parent), last_sample(0.0), next_time(start_t)
+    : parent(in_parent), block(BUFFER_SIZE, 0.0), next_time(start_t)
 {}
 
 
 SAMPLE AudioChannel::get_sample(unsigned long t)
 {
     // If this block already fell out of the buffer, just return silence
-    if(next_time > t+1)
+    if(next_time > t+BUFFER_SIZE)
     {
         std::cerr << "AudioChannel has requested a time older than is in "
             << "its buffer." << std::endl;
@@ -24,27 +45,48 @@ SAMPLE AudioChannel::get_sample(unsigned long t)
     while(next_time <= t)
         parent.tick(next_time);
 
-    return last_sample; 
+    return block[t % BUFFER_SIZE]; 
 }
 
 
-void AudioChannel::push_sample(SAMPLE s)
+const SAMPLE* AudioChannel::get_block(unsigned long t)
 {
-    last_sample = s;
-    next_time++;
+    // If this block already fell out of the buffer, just return silence
+    if(next_time > t+BUFFER_SIZE)
+    {
+        std::cerr << "AudioChannel has requested a time older than is in "
+            << "its buffer." << std::endl;
+        return &silent_block[0];
+    }
+
+    // Otherwise generate enough audio
+    while(next_time <= t)
+        parent.tick(next_time);
+
+    return &block[0];
+}
+
+
+void AudioChannel::push_block()
+{
+    next_time += BUFFER_SIZE;
 }
 
 
 
 
 AudioGenerator::AudioGenerator(unsigned in_num_output_channels)
-    : output_channels(), output_frame()
+    : output_channels(), output_frame(), output_blocks(), sleeping(false)
 {
     for(unsigned i = 0; i < in_num_output_channels; i++)
     {
         output_channels.push_back(AudioChannel(*this));
         output_frame.push_back(0.0);
     }
+
+    // Point the output blocks at our channel buffers
+    for(unsigned i = 0; i < in_num_output_channels; i++)
+        output_blocks.push_back(&output_channels[i].block[0]);
 }
 
 
@@ -62,20 +104,67 @@ AudioChannel* AudioGenerator::get_output_channel(unsigned i)
 }
 
 
+void AudioGenerator::sleep()
+{
+    sleeping = true;
+}
+
+
+void AudioGenerator::wake(unsigned long t)
+{
+    sleeping = false;
+    for(unsigned i = 0; i < output_channels.size(); i++)
+    {
+        if(output_channels[i].next_time < t)
+            output_channels[i].next_time = t;
+    }
+}
+
+
+bool AudioGenerator::is_sleeping()
+{
+    return sleeping;
+}
+
+
 void AudioGenerator::tick(unsigned long t)
 {
-    generate_outputs(output_frame, t);
+    if(!sleeping)
+        generate_block(output_blocks, t);
 
-    //Write the outputs into the channel
+    // Mark the new block as written
     for(unsigned i = 0; i < output_channels.size(); i++)
-        output_channels[i].push_sample(output_frame[i]);
+        output_channels[i].push_block();
+}
+
+
+bool AudioGenerator::has_generated(unsigned long t)
+{
+    // All our channels advance together, so check the first
+    if(output_channels.empty())
+        return true;
+    return output_channels[0].next_time > t;
+}
+
+
+void AudioGenerator::generate_block(std::vector<SAMPLE*>& outputs,
+        unsigned long t)
+{
+    // Generate the block one frame at a time
+    for(unsigned j = 0; j < BUFFER_SIZE; j++)
+    {
+        generate_outputs(output_frame, t+j);
+        for(unsigned i = 0; i < outputs.size(); i++)
+            outputs[i][j] = output_frame[i];
+    }
 }
 
 
 
 
 AudioConsumer::AudioConsumer(unsigned in_num_input_channels)
-    : input_channels(in_num_input_channels, NULL), input_frame()
+    : input_channels(in_num_input_channels, NULL), input_frame(),
+      input_blocks(in_num_input_channels, NULL)
 {
     for(unsigned i = 0; i < in_num_input_channels; i++)
         input_frame.push_back(0.0);
@@ -85,12 +174,14 @@ AudioConsumer::AudioConsumer(unsigned in_num_input_channels)
 void AudioConsumer::set_input_channel(AudioChannel* channel, unsigned channel_i)
 {
     input_channels[channel_i] = channel;
+    mark_graph_changed();
 }
 
 
 void AudioConsumer::remove_channel(unsigned channel_i)
 {
     input_channels[channel_i] = NULL;
+    mark_graph_changed();
 }
 
 
@@ -115,22 +206,36 @@ unsigned AudioConsumer::get_num_input_channels()
 void AudioConsumer::tick(unsigned long t)
 {
     // Read in each channel
+    read_input_blocks(t);
+
+    // Process
+    process_block(input_blocks, t);
+}
+
+
+void AudioConsumer::read_input_blocks(unsigned long t)
+{
     for(unsigned i = 0; i < input_channels.size(); i++)
     {
         // If there is no channel currently, read in silence
         if(input_channels[i] == NULL)
-        {
-            //std::cerr << "The requested channel is not connected" << std::endl;
-            input_frame[i] = 0.0;
-        }
+            input_blocks[i] = &silent_block[0];
         else
-        {
-            input_frame[i] = input_channels[i]->get_sample(t);
-        }
+            input_blocks[i] = input_channels[i]->get_block(t);
     }
+}
 
-    // Process
-    process_inputs(input_frame, t);
+
+void AudioConsumer::process_block(std::vector<const SAMPLE*>& inputs,
+        unsigned long t)
+{
+    // Process the block one frame at a time
+    for(unsigned j = 0; j < BUFFER_SIZE; j++)
+    {
+        for(unsigned i = 0; i < inputs.size(); i++)
+            input_frame[i] = inputs[i][j];
+        process_inputs(input_frame, t+j);
+    }
 }
 
 
@@ -145,25 +250,34 @@ AudioFilter::AudioFilter(unsigned in_num_input_channels,
 
 void AudioFilter::tick(unsigned long t)
 {
-    // Read in each channel
-    for(unsigned i = 0; i < input_channels.size(); i++)
+    // While asleep, don't even pull our inputs
+    if(!sleeping)
     {
-        // If there is no channel currently, read in silence
-        if(input_channels[i] == NULL)
-        {
-            //std::cerr << "The requested channel is not connected" << std::endl;
-            input_frame[i] = 0.0;
-        }
-        else
-        {
-            input_frame[i] = input_channels[i]->get_sample(t);
-        }
-    }
+        // Read in each channel
+        read_input_blocks(t);
 
-    // Process
-    filter(input_frame, output_frame, t);
+        // Process
+        filter_block(input_blocks, output_blocks, t);
+    }
 
-    //Write the outputs into the channel
+    // Mark the new block as written
     for(unsigned i = 0; i < output_channels.size(); i++)
-        output_channels[i].push_sample(output_frame[i]);
+        output_channels[i].push_block();
+}
+
+
+void AudioFilter::filter_block(std::vector<const SAMPLE*>& inputs,
+        std::vector<SAMPLE*>& outputs, unsigned long t)
+{
+    // Filter the block one frame at a time
+    for(unsigned j = 0; j < BUFFER_SIZE; j++)
+    {
+        for(unsigned i = 0; i < inputs.size(); i++)
+            input_frame[i] = inputs[i][j];
+
+        filter(input_frame, output_frame, t+j);
+
+        for(unsigned i = 0; i < outputs.size(); i++)
+            outputs[i][j] = output_frame[i];
+    }
 }
@@ -7,6 +7,13 @@
 
 namespace ClickTrack
 {
+    /* Every change to how the signal chain is wired bumps the graph revision.
+     * A compiled AudioGraph uses it to tell when its schedule is out of date.
+     */
+    unsigned long get_graph_revision();
+    void mark_graph_changed();
+
+
     /* An output channel is the basic unit with which an object receives audio.
      * It is contained within an AudioGenerator object, and serves to pipe audio
      * from its parent generator into a buffer that a later element can access.
@@ -19,28 +26,37 @@ namespace ClickTrack
     {
         friend class AudioGenerator;
         friend class AudioFilter;
+        friend class AudioGraph;
 
         public:
-            /* Fills an incoming buffer with one block worth of audio data
-             * beginning at the requested time.
+            /* Returns the sample at the requested time. The channel stores one
+             * block of audio at a time, so this lazily generates the block
+             * containing t if it has not been generated yet.
              */
             SAMPLE get_sample(unsigned long t);
 
+            /* Returns a pointer to one block of BUFFER_SIZE contiguous samples
+             * beginning at the requested time. The time must fall on a block
+             * boundary.
+             */
+            const SAMPLE* get_block(unsigned long t);
+
         private:
             /* A channel can only exist within an audio generator, so protect
              * the constructor
              */
             AudioChannel(AudioGenerator& in_parent, unsigned long start_t=0);
 
-            /* Called by the audio generator, this registers the next time
-             * step's output sample
+            /* Called by the audio generator once it has written the next
+             * block of output into this channel's buffer
              */
-            void push_sample(SAMPLE s);
+            void push_block();
 
-            /* Internal state
+            /* Internal state. The block holds the samples from
+             * next_time-BUFFER_SIZE up to next_time.
              */
             AudioGenerator& parent;
-            SAMPLE last_sample;
+            std::vector<SAMPLE> block;
             unsigned long next_time;
     };
 
@@ -54,6 +70,7 @@ namespace ClickTrack
     {
         friend class AudioChannel;
         friend class AudioFilter;
+        friend class AudioGraph;
 
         public:
             AudioGenerator(unsigned num_output_channels = 1);
@@ -64,24 +81,61 @@ namespace ClickTrack
             unsigned get_num_output_channels();
             AudioChannel* get_output_channel(unsigned i = 0);
 
+            /* A sleeping generator does no work. Each tick only advances its
+             * clock, leaving stale audio in its output channels, so it must
+             * only sleep while nothing reads its output.
+             *
+             * Waking resumes generating with the block at time t. If the
+             * generator was not ticked while asleep, its clock skips ahead to
+             * t rather than catching up on the missed blocks.
+             */
+            void sleep();
+            void wake(unsigned long t);
+            bool is_sleeping();
+
         private:
-            /* Writes outputs into the buffer. Calls tick to determine what to
-             * write out. Used by the output channel
+            /* Writes one block of outputs beginning at time t into the output
+             * channels. Used by the output channel
              */
             virtual void tick(unsigned long t);
 
+            /* When called, fills one block of BUFFER_SIZE samples beginning at
+             * time t for each output channel. outputs[i] points to the block
+             * for channel i.
+             *
+             * By default this adapts the per-sample generate_outputs below, by
+             * calling it once for each time step in the block. Subclasses must
+             * overwrite exactly one of the two.
+             */
+            virtual void generate_block(std::vector<SAMPLE*>& outputs,
+                    unsigned long t);
+
             /* When called, updates the output channels with one more frame of
              * audio at time t.
-             *
-             * Must be overwritten in subclasses.
              */
             virtual void generate_outputs(std::vector<SAMPLE>& outputs, 
-                    unsigned long t) = 0;
+                    unsigned long t) {}
+
+            /* Generators that read channels other than their inputs, such as
+             * an LFO, must report them here so that the audio graph schedules
+             * them first. Setters for these channels must call
+             * mark_graph_changed().
+             */
+            virtual void get_side_channels(std::vector<AudioChannel*>& channels)
+                {}
+
+            /* Returns true if the block beginning at time t has already been
+             * written to our output channels
+             */
+            bool has_generated(unsigned long t);
 
             /* Information about our internal output channels
              */
             std::vector<AudioChannel> output_channels;
             std::vector<SAMPLE> output_frame;
+            std::vector<SAMPLE*> output_blocks;
+
+            bool sleeping;
     };
 
 
@@ -94,7 +148,7 @@ namespace ClickTrack
     class AudioConsumer
     {
         friend class AudioFilter;
-        friend class TimingManager;
+        friend class AudioGraph;
 
         public:
             AudioConsumer(unsigned num_input_channels = 1);
@@ -111,21 +165,35 @@ namespace ClickTrack
             unsigned get_channel_index(AudioChannel* channel);
 
         private:
-            /* When called, reads in the next frame from the input channels
-             * and calls the tick function.
+            /* When called, reads in the next block from the input channels
+             * and processes it.
              */
             virtual void tick(unsigned long t);
 
-            /* When called on input data, processes it. Must be overwritten in
-             * subclass.
+            /* Reads the block beginning at time t from each input channel into
+             * input_blocks. Disconnected channels read in silence.
+             */
+            void read_input_blocks(unsigned long t);
+
+            /* When called on one block of input data, processes it. inputs[i]
+             * points to BUFFER_SIZE samples from channel i.
+             *
+             * By default this adapts the per-sample process_inputs below.
+             * Subclasses must overwrite exactly one of the two.
+             */
+            virtual void process_block(std::vector<const SAMPLE*>& inputs,
+                    unsigned long t);
+
+            /* When called on one frame of input data, processes it.
              */
             virtual void process_inputs(std::vector<SAMPLE>& inputs, 
-                    unsigned long t) = 0;
+                    unsigned long t) {}
 
             /* Information about our internal input channels
              */
             std::vector<AudioChannel*> input_channels;
             std::vector<SAMPLE> input_frame;
+            std::vector<const SAMPLE*> input_blocks;
     };
 
 
@@ -143,22 +211,24 @@ namespace ClickTrack
             virtual ~AudioFilter() {}
 
         private:
-            /* When called, reads in the next frame from the input channels,
+            /* When called, reads in the next block from the input channels,
              * processes it and write to the output channels.
              */
             void tick(unsigned long t);
 
-            /* Given an input frame, generate a frame of output data. Must be
-             * overwritten in subclass.
+            /* Given one block of input data, generate one block of output
+             * data.
+             *
+             * By default this adapts the per-sample filter below. Subclasses
+             * must overwrite exactly one of the two.
              */
-            virtual void filter(std::vector<SAMPLE>& input, 
-                    std::vector<SAMPLE>& output, unsigned long t) = 0;
+            virtual void filter_block(std::vector<const SAMPLE*>& inputs,
+                    std::vector<SAMPLE*>& outputs, unsigned long t);
 
-            /* To properly implement the sublasses, these functions must be
-             * defined. They do nothing.
+            /* Given an input frame, generate a frame of output data.
              */
-            void generate_outputs(std::vector<SAMPLE>& inputs, unsigned long t) {}
-            void process_inputs(std::vector<SAMPLE>& outputs, unsigned long t) {}
+            virtual void filter(std::vector<SAMPLE>& input, 
+                    std::vector<SAMPLE>& output, unsigned long t) {}
     };
 
 
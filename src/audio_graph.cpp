@@ -0,0 +1,257 @@
+#include <algorithm>
+#include <chrono>
+#include "audio_graph.h"
+#include "trace.h"
+
+using namespace ClickTrack;
+
+
+AudioGraph::AudioGraph()
+    : consumers(), schedule(), level_starts(), pool(nullptr), current_time(0),
+      current_level_start(0), visit_state(), visit_level(), compiled(false),
+      compiled_revision(0), profiling(false), node_times()
+{}
+
+
+AudioGraph::~AudioGraph()
+{
+    delete pool;
+}
+
+
+void AudioGraph::set_num_threads(unsigned num_threads)
+{
+    delete pool;
+    pool = nullptr;
+
+    if(num_threads > 1)
+        pool = new ThreadPool(num_threads-1);
+}
+
+
+unsigned AudioGraph::get_num_threads()
+{
+    if(pool == nullptr)
+        return 1;
+    return pool->get_num_workers()+1;
+}
+
+
+void AudioGraph::add_consumer(AudioConsumer* consumer)
+{
+    consumers.push_back(consumer);
+    compiled = false;
+}
+
+
+void AudioGraph::run(unsigned long t)
+{
+    // Recompile if the wiring has changed since we last compiled
+    if(!compiled || compiled_revision != get_graph_revision())
+        compile();
+
+    // On one thread, the sorted schedule runs straight through
+    if(pool == nullptr)
+    {
+        for(unsigned i = 0; i < schedule.size(); i++)
+            run_node(i, t);
+        return;
+    }
+
+    // Otherwise spread each level across the pool
+    current_time = t;
+    for(unsigned level = 0; level+1 < level_starts.size(); level++)
+    {
+        unsigned start = level_starts[level];
+        unsigned num_nodes = level_starts[level+1] - start;
+
+        if(num_nodes == 1)
+        {
+            run_node(start, t);
+        }
+        else
+        {
+            current_level_start = start;
+            pool->run(&AudioGraph::run_level_task, this, num_nodes);
+        }
+    }
+}
+
+
+void AudioGraph::compile()
+{
+    // Read the revision first, so that changes made while we compile will
+    // trigger another compile
+    compiled_revision = get_graph_revision();
+
+    schedule.clear();
+    visit_state.clear();
+    visit_level.clear();
+    for(auto consumer : consumers)
+        visit_consumer(consumer);
+
+    // Group the schedule by level. Every node reads only from lower levels,
+    // so this is still a topological order
+    std::stable_sort(schedule.begin(), schedule.end(),
+            [](const Node& a, const Node& b) { return a.level < b.level; });
+
+    level_starts.clear();
+    for(unsigned i = 0; i < schedule.size(); i++)
+    {
+        while(level_starts.size() <= schedule[i].level)
+            level_starts.push_back(i);
+    }
+    level_starts.push_back(schedule.size());
+    node_times.assign(schedule.size(), 0);
+
+    visit_state.clear();
+    visit_level.clear();
+    compiled = true;
+}
+
+
+unsigned AudioGraph::get_num_nodes()
+{
+    return schedule.size();
+}
+
+
+unsigned AudioGraph::get_num_levels()
+{
+    return level_starts.size()-1;
+}
+
+
+void AudioGraph::set_profiling(bool enabled)
+{
+    profiling = enabled;
+    std::fill(node_times.begin(), node_times.end(), 0);
+}
+
+
+unsigned long long AudioGraph::get_node_time(unsigned i)
+{
+    return node_times[i];
+}
+
+
+const void* AudioGraph::get_node(unsigned i)
+{
+    if(schedule[i].generator != nullptr)
+        return schedule[i].generator;
+    return schedule[i].consumer;
+}
+
+
+const std::type_info& AudioGraph::get_node_type(unsigned i)
+{
+    if(schedule[i].generator != nullptr)
+        return typeid(*schedule[i].generator);
+    return typeid(*schedule[i].consumer);
+}
+
+
+unsigned AudioGraph::get_node_level(unsigned i)
+{
+    return schedule[i].level;
+}
+
+
+void AudioGraph::run_node(unsigned i, unsigned long t)
+{
+    TRACE_BEGIN(get_node_type(i).name(), t);
+    std::chrono::steady_clock::time_point start;
+    if(profiling)
+        start = std::chrono::steady_clock::now();
+
+    // A generator may already have been pulled this block by a node that did
+    // not report it, so only tick it if needed
+    Node& node = schedule[i];
+    if(node.generator != nullptr)
+    {
+        if(!node.generator->has_generated(t))
+            node.generator->tick(t);
+    }
+    else
+    {
+        node.consumer->tick(t);
+    }
+
+    if(profiling)
+        node_times[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+    TRACE_END(get_node_type(i).name(), t);
+}
+
+
+void AudioGraph::run_level_task(void* in_graph, unsigned i)
+{
+    AudioGraph* graph = (AudioGraph*) in_graph;
+    graph->run_node(graph->current_level_start + i, graph->current_time);
+}
+
+
+unsigned AudioGraph::visit_generator(AudioGenerator* generator)
+{
+    auto state = visit_state.find(generator);
+    if(state != visit_state.end())
+    {
+        if(state->second == VISITING)
+            throw AudioGraphCycle();
+        return visit_level[generator];
+    }
+    visit_state[generator] = VISITING;
+
+    // Visit everything we read from. Filters read from their inputs too
+    std::vector<AudioChannel*> channels;
+    generator->get_side_channels(channels);
+
+    AudioConsumer* consumer = dynamic_cast<AudioConsumer*>(generator);
+    if(consumer != nullptr)
+    {
+        channels.insert(channels.end(), consumer->input_channels.begin(),
+                consumer->input_channels.end());
+    }
+    unsigned level = visit_channels(channels);
+
+    visit_state[generator] = VISITED;
+    visit_level[generator] = level;
+    schedule.push_back({generator, consumer, level});
+    return level;
+}
+
+
+unsigned AudioGraph::visit_consumer(AudioConsumer* consumer)
+{
+    // Filters are scheduled as generators
+    AudioGenerator* generator = dynamic_cast<AudioGenerator*>(consumer);
+    if(generator != nullptr)
+        return visit_generator(generator);
+
+    // A pure consumer can't be read from, so it can't be part of a cycle
+    if(visit_state.find(consumer) != visit_state.end())
+        return visit_level[consumer];
+    visit_state[consumer] = VISITED;
+
+    unsigned level = visit_channels(consumer->input_channels);
+    visit_level[consumer] = level;
+    schedule.push_back({nullptr, consumer, level});
+    return level;
+}
+
+
+unsigned AudioGraph::visit_channels(std::vector<AudioChannel*>& channels)
+{
+    // A node sits one level above everything it reads from
+    unsigned level = 0;
+    for(auto channel : channels)
+    {
+        if(channel != NULL)
+        {
+            unsigned parent_level = visit_generator(&channel->parent);
+            if(parent_level+1 > level)
+                level = parent_level+1;
+        }
+    }
+    return level;
+}
@@ -0,0 +1,147 @@
+#ifndef AUDIO_GRAPH_H
+#define AUDIO_GRAPH_H
+
+#include <exception>
+#include <map>
+#include <typeinfo>
+#include <vector>
+#include "audio_generics.h"
+#include "thread_pool.h"
+
+
+namespace ClickTrack
+{
+    /* The audio graph runs the signal chain feeding a set of audio consumers.
+     *
+     * Rather than letting each consumer recursively pull its inputs, the graph
+     * compiles the chain once: it finds every generator and filter reachable
+     * from the consumers, through both their input channels and their side
+     * channels, and sorts them topologically. Each block then runs as a flat
+     * schedule, where every node is ticked after all the nodes it reads from.
+     *
+     * The schedule is cached until the wiring of the signal chain changes.
+     *
+     * The graph may also run on several threads. Nodes are grouped into
+     * dependency levels, where each node's level is one more than the highest
+     * level it reads from. Nodes on the same level are independent, such as
+     * the voices of a polyphonic instrument, so each level is spread across a
+     * thread pool. When running in parallel, every node must report all the
+     * channels it reads, as an unreported read is a race.
+     */
+    class AudioGraph
+    {
+        public:
+            AudioGraph();
+            ~AudioGraph();
+
+            /* Sets the number of threads used to run the graph, including the
+             * calling thread. Defaults to one. This starts or stops worker
+             * threads, so it must not be called while the graph is running.
+             */
+            void set_num_threads(unsigned num_threads);
+            unsigned get_num_threads();
+
+            /* Registers a consumer at the end of the signal chain
+             */
+            void add_consumer(AudioConsumer* consumer);
+
+            /* Runs one block of the schedule beginning at time t. Recompiles
+             * the schedule first if it is out of date.
+             */
+            void run(unsigned long t);
+
+            /* Compiles the schedule. Throws AudioGraphCycle if the signal
+             * chain feeds back into itself.
+             */
+            void compile();
+
+            /* Returns the number of nodes and dependency levels in the
+             * compiled schedule
+             */
+            unsigned get_num_nodes();
+            unsigned get_num_levels();
+
+            /* While profiling is enabled, run records how long each node of
+             * the schedule took, in nanoseconds. These describe the i-th node
+             * of the schedule, and may only be called on the thread calling
+             * run.
+             */
+            void set_profiling(bool enabled);
+            unsigned long long get_node_time(unsigned i);
+            const void* get_node(unsigned i);
+            const std::type_info& get_node_type(unsigned i);
+            unsigned get_node_level(unsigned i);
+
+        protected:
+            /* A node in the schedule is either a generator (including
+             * filters), or a consumer that is only a consumer.
+             */
+            struct Node
+            {
+                AudioGenerator* generator;
+                AudioConsumer* consumer;
+                unsigned level;
+            };
+
+            /* Runs node i of the schedule for the block at time t, timing it
+             * if profiling
+             */
+            void run_node(unsigned i, unsigned long t);
+
+            /* Thread pool task to run one node of the current level
+             */
+            static void run_level_task(void* graph, unsigned i);
+
+            /* Depth first search helpers used to compile the graph. A node is
+             * appended to the schedule after everything it reads from. Each
+             * returns the level of the node it visited.
+             */
+            unsigned visit_generator(AudioGenerator* generator);
+            unsigned visit_consumer(AudioConsumer* consumer);
+            unsigned visit_channels(std::vector<AudioChannel*>& channels);
+
+            /* The registered consumers, and the compiled schedule. The
+             * schedule is sorted by level, and the nodes on level i are those
+             * from level_starts[i] up to level_starts[i+1].
+             */
+            std::vector<AudioConsumer*> consumers;
+            std::vector<Node> schedule;
+            std::vector<unsigned> level_starts;
+
+            /* Parallel execution state. The pool is null when running on a
+             * single thread.
+             */
+            ThreadPool* pool;
+            unsigned long current_time;
+            unsigned current_level_start;
+
+            /* Compile state. Nodes are marked as visiting while the search is
+             * below them, so reaching one again means we found a cycle.
+             */
+            enum VisitState { VISITING, VISITED };
+            std::map<void*, VisitState> visit_state;
+            std::map<void*, unsigned> visit_level;
+
+            bool compiled;
+            unsigned long compiled_revision;
+
+            /* Profiling state. Each node's time is written only by the thread
+             * that ran it.
+             */
+            bool profiling;
+            std::vector<unsigned long long> node_times;
+    };
+
+
+    /* Thrown when the signal chain contains a cycle, and cannot be scheduled
+     */
+    class AudioGraphCycle: public std::exception
+    {
+        virtual const char* what() const throw()
+        {
+            return "The signal chain contains a cycle.";
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,44 @@
+#include "bit_ops.h"
+
+using namespace ClickTrack;
+
+
+unsigned ClickTrack::next_power_of_two(unsigned in)
+{
+    if(in == 0)
+        return 1;
+
+    in--;
+    in |= in >> 1;
+    in |= in >> 2;
+    in |= in >> 4;
+    in |= in >> 8;
+    in |= in >> 16;
+    in++;
+
+    return in;
+}
+
+
+unsigned ClickTrack::bit_reverse(unsigned in)
+{
+    in = (in >> 16) | (in << 16);
+    in = ((in & 0xFF00FF00) >> 8) | ((in & 0x00FF00FF) << 8);
+    in = ((in & 0xF0F0F0F0) >> 4) | ((in & 0x0F0F0F0F) << 4);
+    in = ((in & 0xCCCCCCCC) >> 2) | ((in & 0x33333333) << 2);
+    in = ((in & 0xAAAAAAAA) >> 1) | ((in & 0x55555555) << 1);
+    return in;
+}
+
+
+unsigned ClickTrack::int_log(unsigned in)
+{
+    in--;
+    unsigned result = 0;
+    while(in > 0)
+    {
+        in = in >> 1;
+        result++;
+    }
+    return result;
+}
@@ -0,0 +1,25 @@
+#ifndef BIT_OPS_H
+#define BIT_OPS_H
+
+
+namespace ClickTrack
+{
+    /* Small integer helpers shared by the FFT and the ring buffers. This
+     * header includes nothing else, so the lock-free queue and the driver
+     * wrappers can use it too.
+     */
+
+    /* Given an integer, returns the smallest power of two no less than it
+     */
+    unsigned next_power_of_two(unsigned in);
+
+    /* Given an integer, returns the bitreversed value
+     */
+    unsigned bit_reverse(unsigned in);
+
+    /* Find the log2 of an integer. Rounded up.
+     */
+    unsigned int_log(unsigned in);
+}
+
+#endif
@@ -1,93 +1,57 @@
-#include <iostream>
-#include <complex>
+#include <algorithm>
+#include <cmath>
 #include "convolution_filter.h"
+#include "low_latency_convolver.h"
+#include "uniform_convolver.h"
 #include "wav_reader.h"
 
 using namespace ClickTrack;
 
 
-ConvolutionFilter::ConvolutionFilter(unsigned impulse_length,
-        SAMPLE* in_impulse_response, float in_gain, float in_wetness)
-    : AudioFilter(1),
-
-      gain(pow(10, in_gain/10)),
-      wetness(in_wetness),
-
-      transform_size(CONVOLUTION_BUFFER_SIZE*2),
-      transformer(transform_size),
-
-      num_impulse_blocks((impulse_length - 1) / 
-                         (transform_size-CONVOLUTION_BUFFER_SIZE) + 1),
-        // shift by one so perfect powers of two don't get overallocated
-      impulse_response(num_impulse_blocks, NULL),
-
-      frequency_buffer(num_impulse_blocks),
-      reverb_buffer(transform_size),
-
-      output_queue(CONVOLUTION_BUFFER_SIZE)
+/* Scales the impulse response to unit energy, so the wet signal has a level
+ * comparable to the dry signal.
+ */
+static std::vector<SAMPLE> normalize_impulse(unsigned impulse_length,
+        SAMPLE* impulse_response)
 {
-    // PROVIDE WARNING
-    std::cerr << std::endl <<
-        "WARNING: Convolution reverb is still too slow to run in realtime." <<
-        std::endl << std::endl;
-
-    // Preallocate the buffers
-    input_buffer = new std::complex<SAMPLE>[transform_size];
-    output_buffer = new std::complex<SAMPLE>[transform_size];
-
-    // Zero the input buffer
-    for(int i=0; i < transform_size; i++)
-        input_buffer[i] = 0.0;
-
-
-    // Compute impulse energy to normalize
     float energy = 0.0f;
-    for(int i=0; i < impulse_length; i++)
-        energy += pow(in_impulse_response[i], 2);
+    for(unsigned i=0; i < impulse_length; i++)
+        energy += pow(impulse_response[i], 2);
     energy = sqrt(energy);
 
-
-    // Split the impulse response into segments
-    for(int i=0; i < num_impulse_blocks; i++)
-    {
-        // For each segment, take its FFT
-        for(int j=0; j < transform_size-CONVOLUTION_BUFFER_SIZE; j++)
-        {
-            int t = (transform_size-CONVOLUTION_BUFFER_SIZE)*i + j;
-            if(t < impulse_length)
-                input_buffer[j] = in_impulse_response[t] / energy;
-            else
-                input_buffer[j] = 0.0;
-        }
-
-        impulse_response[i] = new std::complex<SAMPLE>[transform_size];
-        transformer.fft(input_buffer, impulse_response[i]);
-    }
+    std::vector<SAMPLE> result(impulse_length);
+    for(unsigned i=0; i < impulse_length; i++)
+        result[i] = energy > 0.0f ? impulse_response[i] / energy : 0.0f;
+    return result;
+}
 
 
-    // Rezero the input buffer
-    for(int i=0; i < transform_size; i++)
-        input_buffer[i] = 0.0;
+ConvolutionFilter::ConvolutionFilter(unsigned impulse_length,
+        SAMPLE* in_impulse_response, float in_gain, float in_wetness,
+        bool low_latency)
+    : AudioFilter(1),
 
+      gain(pow(10, in_gain/10)),
+      wetness(in_wetness),
 
-    // Initialize the output buffers
-    for(int i=0; i < num_impulse_blocks; i++)
-    {
-        std::complex<SAMPLE>* temp = new std::complex<SAMPLE>[transform_size];
-        frequency_buffer.add(temp);
-    }
+      convolver(nullptr),
 
-    for(int i=0; i < transform_size; i++)
-        reverb_buffer.add(0.0);
+      reverb_buffer(BUFFER_SIZE)
+{
+    std::vector<SAMPLE> impulse =
+        normalize_impulse(impulse_length, in_impulse_response);
+
+    if(low_latency)
+        convolver = new LowLatencyConvolver(impulse.data(), impulse_length);
+    else
+        convolver = new UniformConvolver(CONVOLUTION_BUFFER_SIZE,
+                impulse.data(), impulse_length);
 }
 
 
 ConvolutionFilter::~ConvolutionFilter()
 {
-    for(int i = 0; i < num_impulse_blocks; i++)
-        delete impulse_response[i];
-    delete input_buffer;
-    delete output_buffer;
+    delete convolver;
 }
 
 
@@ -103,80 +67,37 @@ void ConvolutionFilter::set_wetness(float in_wetness)
 }
 
 
-void ConvolutionFilter::filter(std::vector<SAMPLE>& input,
-        std::vector<SAMPLE>& output, unsigned long t)
-{
-    // Pull in the output, return the output
-    input_buffer[t % CONVOLUTION_BUFFER_SIZE] = input[0];
-    output[0] = gain*
-        (wetness*output_queue[t % CONVOLUTION_BUFFER_SIZE] +
-         (1-wetness)*input[0]);
-
-    // Call the processing if we have filled the buffer
-    // Set start time of this block
-    unsigned long start_t = t - CONVOLUTION_BUFFER_SIZE + 1;
-    if((t+1) % CONVOLUTION_BUFFER_SIZE == 0)
-        process(start_t);
-}
-
-void ConvolutionFilter::process(unsigned long start_t)
+void ConvolutionFilter::filter_block(std::vector<const SAMPLE*>& inputs,
+        std::vector<SAMPLE*>& outputs, unsigned long t)
 {
-    // First take the FFT of the input signal
-    transformer.fft(input_buffer, output_buffer);
-
-    // Then perform each frequency multiply
-    for(int i=0; i < num_impulse_blocks; i++)
-    {
-        // Frequency multiply
-        for(int j=0; j < transform_size; j++)
-        {
-            frequency_buffer[start_t/CONVOLUTION_BUFFER_SIZE + i][j] +=
-                output_buffer[j] * impulse_response[i][j];
-        }
-    }
-
-
-    // Perform an inverse transform out of the frequency domain
-    transformer.ifft(frequency_buffer[start_t/CONVOLUTION_BUFFER_SIZE],
-                     output_buffer);
-    for(int i=0; i < transform_size; i++)
-        reverb_buffer[start_t + i] += output_buffer[i].real();
-
-
-    // Fill the new output set
-    for(int i=0; i < CONVOLUTION_BUFFER_SIZE; i++)
-        output_queue[i] = reverb_buffer[start_t + i];
-
-    
-    // Update the frequency buffer
-    // Zero and move the array to avoid allocating extra memory
-    std::complex<SAMPLE>* temp = 
-        frequency_buffer[start_t/CONVOLUTION_BUFFER_SIZE];
-
-    for(int i=0; i < transform_size; i++)
-        temp[i] = 0.0;
-    frequency_buffer.add(temp);
-
-    // Update the time buffer
-    for(int i=0; i < CONVOLUTION_BUFFER_SIZE; i++)
-        reverb_buffer.add(0.0);
+    // Convolve the whole block, one convolver block at a time
+    unsigned block_size = convolver->get_block_size();
+    for(unsigned i = 0; i < BUFFER_SIZE; i += block_size)
+        convolver->process(inputs[0] + i, &reverb_buffer[i]);
+
+    // Then mix wet and dry
+    for(unsigned i = 0; i < BUFFER_SIZE; i++)
+        outputs[0][i] = gain*
+            (wetness*reverb_buffer[i] + (1-wetness)*inputs[0][i]);
 }
 
 
 impulse_pair* ClickTrack::impulse_from_wav(const char* filename)
 {
     WavReader wav(filename);
+    std::vector<std::vector<SAMPLE>> channels;
+    wav.read_all(channels);
+
+    // Mono impulses are used for both sides
+    const std::vector<SAMPLE>& left = channels[0];
+    const std::vector<SAMPLE>& right = channels[channels.size() > 1 ? 1 : 0];
 
     impulse_pair* out = new impulse_pair;
     out->num_samples = wav.get_total_samples();
     out->left = new SAMPLE[out->num_samples];
     out->right = new SAMPLE[out->num_samples];
-
-    for(unsigned t = 0; t < out->num_samples; t++)
-    {
-        out->left[t] = wav.get_output_channel(0)->get_sample(t);
-        out->right[t] = wav.get_output_channel(0)->get_sample(t);
-    }
+    std::copy(left.begin(), left.end(), out->left);
+    std::copy(right.begin(), right.end(), out->right);
 
     return out;
 }
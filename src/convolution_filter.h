@@ -3,8 +3,7 @@
 
 #include <vector>
 #include "audio_generics.h"
-#include "fft.h"
-#include "ringbuffer.h"
+#include "convolver.h"
 
 
 namespace ClickTrack
@@ -12,13 +11,14 @@ namespace ClickTrack
     /* The ConvolutionFilter implements a real time convolution of the input
      * signal with a precomputed impulse response.
      *
-     * Uses the overlap add method to keep a running buffer of the result.
-     * Also uses overlap add to calculate the convolution of each time block
-     * with the impulse response.
+     * The heavy lifting is done by a UniformConvolver, partitioned at the
+     * convolution buffer size. Processing a whole audio block at once, the
+     * wet signal lines up with the dry signal with no added latency.
      *
-     * Computes circular convolution using the property that convolution in time
-     * is equivalent to multiplication in frequency. Uses linearity of the FFT
-     * to only perform a single transform into and out of frequency domain.
+     * In low latency mode a LowLatencyConvolver is used instead, which keeps
+     * the cost of long impulse responses down even when the audio block size
+     * is made small. Either way the convolver's block size must divide the
+     * audio block size.
      */
     const unsigned CONVOLUTION_BUFFER_SIZE = BUFFER_SIZE;
     class ConvolutionFilter : public AudioFilter
@@ -26,36 +26,27 @@ namespace ClickTrack
         public:
             ConvolutionFilter(unsigned impulse_length,
                               SAMPLE* in_impulse_response,
-                              float gain, float wetness);
+                              float gain, float wetness,
+                              bool low_latency = false);
             ~ConvolutionFilter();
 
             void set_gain(float in_gain);
             void set_wetness(float in_wetness);
 
         private:
-            // Filter only queues up its input samples, then when that queue is
-            // full it calls process
-            void filter(std::vector<SAMPLE>& input, 
-                    std::vector<SAMPLE>& output, unsigned long t);
-            void process(unsigned long start_t);
+            ConvolutionFilter(const ConvolutionFilter&) = delete;
+            ConvolutionFilter& operator=(const ConvolutionFilter&) = delete;
+
+            void filter_block(std::vector<const SAMPLE*>& inputs,
+                    std::vector<SAMPLE*>& outputs, unsigned long t);
 
             float gain;
             float wetness;
 
-            const unsigned transform_size;
-            Transformer transformer;
-
-            const unsigned num_impulse_blocks;
-            std::vector<std::complex<SAMPLE>*> impulse_response;
-
-            RingBuffer<std::complex<SAMPLE>*> frequency_buffer;
-            RingBuffer<SAMPLE> reverb_buffer;
-
+            Convolver* convolver;
 
             // Preallocate buffers for speed
-            std::complex<SAMPLE>* input_buffer;
-            std::complex<SAMPLE>* output_buffer;
-            std::vector<SAMPLE> output_queue;
+            std::vector<SAMPLE> reverb_buffer;
     };
 
 
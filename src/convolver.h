@@ -0,0 +1,27 @@
+#ifndef CONVOLVER_H
+#define CONVOLVER_H
+
+#include "portaudio_wrapper.h"
+
+
+namespace ClickTrack
+{
+    /* A convolver computes the linear convolution of a stream with a fixed
+     * impulse response. Input is consumed, and output produced, in fixed size
+     * blocks.
+     */
+    class Convolver
+    {
+        public:
+            virtual ~Convolver() {}
+
+            /* Consumes the next get_block_size() samples of input and writes
+             * the matching samples of output.
+             */
+            virtual void process(const SAMPLE* input, SAMPLE* output) = 0;
+
+            virtual unsigned get_block_size() = 0;
+    };
+}
+
+#endif
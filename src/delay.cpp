@@ -1,3 +1,4 @@
+#include <algorithm>
 #include "delay.h"
 
 using namespace ClickTrack;
@@ -6,18 +7,12 @@ using namespace ClickTrack;
 Delay::Delay(float in_delay_time, float in_feedback, float in_wetness,
         unsigned num_channels)
     : AudioFilter(num_channels, num_channels),
-      delay(SAMPLE_RATE * in_delay_time),
-      feedback(in_feedback), wetness(in_wetness), delay_buffers()
+      delay(0), feedback(in_feedback), wetness(in_wetness),
+      delay_buffers(), next_t(0), delayed(BUFFER_SIZE), feedback_buffer(BUFFER_SIZE)
 {
     for(unsigned i = 0; i < num_channels; i++)
-    {
-        auto rb = new RingBuffer<SAMPLE>(delay);
-        for(unsigned t = 0; t < delay; t++)
-            rb->add(0.0);
-
-        // Add to the buffer set
-        delay_buffers.push_back(rb);
-    }
+        delay_buffers.push_back(nullptr);
+    set_delay(in_delay_time);
 }
 
 
@@ -28,16 +23,18 @@ Delay::~Delay()
 }
 
 
-void Delay::set_delay(float in_delay)
+void Delay::set_delay(float in_delay_time)
 {
-    delay = in_delay;
+    delay = std::max(1u, (unsigned) (SAMPLE_RATE * in_delay_time));
 
-    // Reset buffers to empty
+    // Reset buffers to empty, starting from the next block. They need room
+    // for the delay, plus the block being written.
+    std::vector<SAMPLE> zeros(delay, 0.0);
     for(unsigned i = 0; i < get_num_input_channels(); i++)
     {
-        auto rb = new RingBuffer<SAMPLE>(delay);
-        for(unsigned t = 0; t < delay; t++)
-            rb->add(0.0);
+        auto rb = new MaskedRingBuffer<SAMPLE>(delay + BUFFER_SIZE);
+        rb->set_new_startpoint(next_t);
+        rb->write_block(zeros.data(), delay);
 
         delete delay_buffers[i];
         delay_buffers[i] = rb;
@@ -57,16 +54,30 @@ void Delay::set_wetness(float in_wetness)
 }
 
 
-void Delay::filter(std::vector<SAMPLE>& input,
-        std::vector<SAMPLE>& output, unsigned long t)
+void Delay::filter_block(std::vector<const SAMPLE*>& inputs,
+        std::vector<SAMPLE*>& outputs, unsigned long t)
 {
-    for(int i = 0; i < input.size(); i++)
+    const unsigned chunk = std::min(delay, BUFFER_SIZE);
+    for(unsigned i = 0; i < inputs.size(); i++)
     {
-        // Add the delayed version of the signal in, respecting wetness
-        SAMPLE delayed_value = delay_buffers[i]->get(t);
-        output[i] = (1.0-wetness)*input[i] + wetness*delayed_value;
-
-        // Scale by the feedback and delay our current input
-        delay_buffers[i]->add(input[i] + feedback*delayed_value);
+        for(unsigned offset = 0; offset < BUFFER_SIZE; offset += chunk)
+        {
+            unsigned n = std::min(chunk, BUFFER_SIZE - offset);
+            const SAMPLE* input = inputs[i] + offset;
+            SAMPLE* output = outputs[i] + offset;
+
+            // Add the delayed version of the signal in, respecting wetness
+            delay_buffers[i]->read_block(t + offset, delayed.data(), n);
+            for(unsigned j = 0; j < n; j++)
+            {
+                output[j] = (1.0-wetness)*input[j] + wetness*delayed[j];
+                feedback_buffer[j] = input[j] + feedback*delayed[j];
+            }
+
+            // Scale by the feedback and delay our current input
+            delay_buffers[i]->write_block(feedback_buffer.data(), n);
+        }
     }
+
+    next_t = t + BUFFER_SIZE;
 }
@@ -29,8 +29,11 @@ namespace ClickTrack
             void set_wetness(float wetness);
 
         private:
-            void filter(std::vector<SAMPLE>& input,
-                    std::vector<SAMPLE>& output, unsigned long t);
+            /* Runs in chunks no longer than the delay, so every delayed
+             * sample we read was written by an earlier chunk
+             */
+            void filter_block(std::vector<const SAMPLE*>& inputs,
+                    std::vector<SAMPLE*>& outputs, unsigned long t);
 
             /* Delay parameters
              */
@@ -40,7 +43,12 @@ namespace ClickTrack
 
             /* Buffer to store our delayed samples
              */
-            std::vector<RingBuffer<SAMPLE>*> delay_buffers;
+            std::vector<MaskedRingBuffer<SAMPLE>*> delay_buffers;
+            unsigned long next_t;
+
+            // Preallocate buffers for speed
+            std::vector<SAMPLE> delayed;
+            std::vector<SAMPLE> feedback_buffer;
     };
 }
 
@@ -1,6 +1,14 @@
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
 #include <string>
-#include "wav_reader.h"
+#include <thread>
 #include "drum_machine.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include "vector_ops.h"
 
 using namespace ClickTrack;
 
@@ -53,21 +61,45 @@ void DrumMachine::on_midi_message(MidiMessage message) {}
 
 
 DrumAdder::DrumAdder()
-    : AudioGenerator(1), voices()
+    : AudioGenerator(1), cursors(), num_cursors(0), kit(nullptr),
+      fading_kits(), num_fading_kits(0), pending_kit(nullptr),
+      retired_kits(4*MAX_FADING_KITS)
 {}
 
 
 DrumAdder::~DrumAdder()
 {
-    for(auto noteAndVoice: voices)
-        delete noteAndVoice.second;
+    delete kit;
+    delete pending_kit.load();
+    for(unsigned i = 0; i < num_fading_kits; i++)
+        delete fading_kits[i];
+
+    Kit* old_kit;
+    while(retired_kits.pop(old_kit))
+        delete old_kit;
+}
+
+
+DrumAdder::Kit::Kit()
+{
+    std::fill(voices, voices+NUM_NOTES, nullptr);
+}
+
+
+DrumAdder::Kit::~Kit()
+{
+    for(auto voice : voices)
+        delete voice;
 }
 
 
 void DrumAdder::set_voice(const std::string& path)
 {
-    // First wipe the old voice
-    voices.clear();
+    // First free any old kits the audio thread has finished with. Each call
+    // adds one kit, so the retired queue never fills up between calls
+    Kit* old_kit;
+    while(retired_kits.pop(old_kit))
+        delete old_kit;
 
     // Open the mapping file
     std::string mapping = path + "keymap.txt";
@@ -78,6 +110,10 @@ void DrumAdder::set_voice(const std::string& path)
         throw InvalidKeymap(mapping);
 
     // Read each line
+    std::vector<unsigned> notes;
+    std::map<unsigned, unsigned> choke_groups;
+    unsigned num_choke_groups = 0;
+    KitLoad load;
     std::string line;
     while(std::getline(keymap, line))
     {
@@ -85,85 +121,206 @@ void DrumAdder::set_voice(const std::string& path)
         if(line.size() == 0 || line.front() == '#')
             continue;
 
-        // Parse out the MIDI key and file
+        // Choke groups list their notes
+        if(line.compare(0, 6, "choke ") == 0)
+        {
+            num_choke_groups++;
+            std::istringstream group(line.substr(6));
+            unsigned note;
+            while(group >> note)
+                choke_groups[note] = num_choke_groups;
+            continue;
+        }
+
+        // Parse out the MIDI key and file. Only real MIDI notes can play
         unsigned note = std::strtoul(line.substr(0, line.find(' ')).c_str(), 
                 NULL, 0);
-        std::string filename = path + line.substr(line.find(' ')+1);
-
-        // Create a drum voice
-        voices.insert(std::pair<unsigned,DrumVoice*>
-                (note, new DrumVoice(filename)));
+        if(note >= NUM_NOTES)
+            continue;
+        notes.push_back(note);
+        load.filenames.push_back(path + line.substr(line.find(' ')+1));
     }
 
     keymap.close();
+
+    // Create the drum voices in parallel
+    unsigned num_voices = load.filenames.size();
+    load.voices.resize(num_voices, nullptr);
+    load.errors.resize(num_voices);
+
+    unsigned num_threads = std::min(std::max(1u,
+                std::thread::hardware_concurrency()), std::max(1u, num_voices));
+    ThreadPool pool(num_threads-1);
+    pool.run(&DrumAdder::load_voice, &load, num_voices);
+
+    // Build the kit. Later lines for the same note are ignored
+    std::unique_ptr<Kit> new_kit(new Kit);
+    for(unsigned i = 0; i < num_voices; i++)
+    {
+        DrumVoice* voice = load.voices[i];
+        if(voice == nullptr)
+            continue;
+
+        if(new_kit->voices[notes[i]] != nullptr)
+        {
+            delete voice;
+            continue;
+        }
+
+        auto group = choke_groups.find(notes[i]);
+        voice->choke_group = group == choke_groups.end() ? 0 : group->second;
+        new_kit->voices[notes[i]] = voice;
+    }
+
+    for(unsigned i = 0; i < num_voices; i++)
+        if(load.errors[i])
+            std::rethrow_exception(load.errors[i]);
+
+    // Hand it to the audio thread. If it never picked up the last kit we
+    // sent, that one can be freed right away
+    delete pending_kit.exchange(new_kit.release());
 }
 
 
-void DrumAdder::generate_outputs(std::vector<SAMPLE>& outputs, unsigned long t)
+void DrumAdder::load_voice(void* arg, unsigned i)
 {
-    // Compute the output
-    outputs[0] = 0.0; 
-    for(auto noteAndVoice: voices)
+    KitLoad* load = (KitLoad*) arg;
+    try
+    {
+        load->voices[i] = new DrumVoice(load->filenames[i]);
+    }
+    catch(...)
     {
-        // For each voice, get its next sample
-        auto voice = noteAndVoice.second;
-        if(voice->is_playing())
-            outputs[0] += voice->get_next_sample();
+        load->errors[i] = std::current_exception();
     }
 }
 
-void DrumAdder::on_note_down(unsigned note, float velocity)
+
+void DrumAdder::install_pending_kit()
 {
-    // Ignore if this note doesn't exist
-    if(voices.find(note) == voices.end())
+    Kit* new_kit = pending_kit.exchange(nullptr);
+    if(new_kit == nullptr)
         return;
 
-    voices[note]->on_note_down();
+    TRACE_INSTANT("drum kit swap", 0);
+    if(kit != nullptr)
+        retire(kit);
+    kit = new_kit;
 }
 
 
-
-
-DrumVoice::DrumVoice(const std::string& filename)
-    : samples(), next_i(0), playing(false)
+void DrumAdder::retire(Kit* old_kit)
 {
-    // Read the wavfile into the buffer
-    WavReader wav(filename.c_str());
+    // If too many kits are still ringing, cut off the oldest
+    if(num_fading_kits == MAX_FADING_KITS)
+    {
+        stop_cursors(fading_kits[0], 0);
+        retired_kits.push(fading_kits[0]);
+        std::copy(fading_kits+1, fading_kits+num_fading_kits, fading_kits);
+        num_fading_kits--;
+    }
 
-    for(unsigned t=0; t < wav.get_total_samples(); t++)
-        samples.push_back(wav.get_output_channel()->get_sample(t));
+    fading_kits[num_fading_kits++] = old_kit;
 }
 
 
-SAMPLE DrumVoice::get_next_sample()
+void DrumAdder::stop_cursors(Kit* owner, unsigned choke_group)
 {
-    // Generate sample
-    if(playing)
+    // Stops the cursors from the given kit, in the given choke group or all
+    // of them for group zero. Keep the array packed by moving the last
+    // cursor into each hole
+    for(unsigned i = 0; i < num_cursors; )
     {
-        SAMPLE out = samples[next_i];
-        next_i++;
+        if(cursors[i].kit == owner &&
+                (choke_group == 0 || cursors[i].choke_group == choke_group))
+            cursors[i] = cursors[--num_cursors];
+        else
+            i++;
+    }
+}
 
-        if(next_i >= samples.size())
-            playing = false;
 
-        return out;
+void DrumAdder::generate_block(std::vector<SAMPLE*>& outputs, unsigned long t)
+{
+    // Only switch kits on a block boundary
+    install_pending_kit();
+
+    // Mix each hit in one pass over the block. Samples are zero padded to a
+    // whole number of vectors, so the tail can be mixed as a full vector too
+    SAMPLE* out = outputs[0];
+    std::fill(out, out+BUFFER_SIZE, 0.0);
+    for(unsigned i = 0; i < num_cursors; )
+    {
+        Cursor& cursor = cursors[i];
+        unsigned long remaining = cursor.sample->get_length() - cursor.position;
+        unsigned n = std::min<unsigned long>(BUFFER_SIZE, (remaining+3) & ~3ul);
+        multiply_accumulate(cursor.sample->get_data() + cursor.position, 1.0,
+                out, n);
+
+        cursor.position += n;
+        if(cursor.position >= cursor.sample->get_length())
+            cursors[i] = cursors[--num_cursors];
+        else
+            i++;
     }
-    else
+
+    // Hand back old kits once none of their hits are playing
+    for(unsigned i = 0; i < num_fading_kits; )
     {
-        return 0.0;
+        bool playing = false;
+        for(unsigned j = 0; j < num_cursors; j++)
+            playing |= cursors[j].kit == fading_kits[i];
+
+        if(!playing && retired_kits.push(fading_kits[i]))
+        {
+            std::copy(fading_kits+i+1, fading_kits+num_fading_kits,
+                    fading_kits+i);
+            num_fading_kits--;
+        }
+        else
+            i++;
     }
 }
 
 
-void DrumVoice::on_note_down()
+void DrumAdder::on_note_down(unsigned note, float velocity)
 {
-    // Set state
-    next_i = 0;
-    playing = true;
-}
+    // Notes may arrive before the first block. With nothing playing yet, the
+    // first kit can be installed right away
+    if(kit == nullptr)
+        install_pending_kit();
+
+    // Ignore if this note doesn't exist
+    if(kit == nullptr || note >= NUM_NOTES || kit->voices[note] == nullptr)
+        return;
+    DrumVoice* voice = kit->voices[note];
+    if(voice->sample->get_length() == 0)
+        return;
 
+    TRACE_INSTANT("drum trigger", note);
 
-bool DrumVoice::is_playing()
-{
-    return playing;
+    // Cut off the rest of the choke group
+    if(voice->choke_group != 0)
+        stop_cursors(kit, voice->choke_group);
+
+    // Start a new cursor, replacing the one furthest along if we are full
+    unsigned i = num_cursors;
+    if(num_cursors == MAX_CURSORS)
+    {
+        i = 0;
+        for(unsigned j = 1; j < num_cursors; j++)
+            if(cursors[j].position > cursors[i].position)
+                i = j;
+    }
+    else
+        num_cursors++;
+
+    cursors[i] = {voice->sample.get(), 0, voice->choke_group, kit};
 }
+
+
+
+
+DrumVoice::DrumVoice(const std::string& filename)
+    : sample(get_sample_pool().load(filename)), choke_group(0)
+{}
@@ -1,12 +1,17 @@
 #ifndef DRUM_MACHINE_H
 #define DRUM_MACHINE_H
 
-#include <map>
+#include <atomic>
+#include <exception>
+#include <memory>
 #include <string>
+#include <vector>
 #include "adder.h"
 #include "audio_generics.h"
 #include "gain_filter.h"
 #include "generic_instrument.h"
+#include "sample_pool.h"
+#include "spsc_ringbuffer.h"
 
 namespace ClickTrack
 {
@@ -16,6 +21,12 @@ namespace ClickTrack
      * The config file consists of one sample per line in the following format:
      *      MidiNumber path/to/your sample.wav
      * Blank lines and lines starting with # are ignored.
+     *
+     * A line of the form
+     *      choke MidiNumber MidiNumber ...
+     * puts those notes in a choke group, so triggering any of them cuts off
+     * the others, as an open hi-hat is cut off by a closed one. Otherwise,
+     * every hit plays out in full, even over earlier hits of the same note.
      */
     class DrumVoice;
     class DrumAdder;
@@ -60,6 +71,12 @@ namespace ClickTrack
 
 
     /* Drum adder is an adder with less overhead for large numbers of elements.
+     *
+     * Its voices come as a complete kit. A new kit is loaded in parallel off
+     * the audio thread, then published to it at the next block boundary, so
+     * the audio thread never waits on a load or sees a half built kit. Hits
+     * still ringing from an old kit play out before the kit is handed back
+     * to be freed.
      */
     class DrumAdder : public AudioGenerator
     {
@@ -69,27 +86,86 @@ namespace ClickTrack
             DrumAdder();
             ~DrumAdder();
 
-            /* Used to change the tones on our voices
+            /* Used to change the tones on our voices. Loads the new kit and
+             * queues it for the audio thread. Must not be called from the
+             * audio thread, and only from one thread at a time.
              */
             void set_voice(const std::string& path);
 
-            /* Looks through the voices to determine which are playing
+            /* Mixes every hit currently playing
              */
-            void generate_outputs(std::vector<SAMPLE>& outputs, unsigned long t);
+            void generate_block(std::vector<SAMPLE*>& outputs,
+                    unsigned long t);
 
             /* Callback to trigger a note. Only called by a drum machine.
              */
             void on_note_down(unsigned note, float velocity);
 
-            /* The following map simply maps MIDI numbers to their drum voice
+            /* A kit maps MIDI numbers to their drum voice, and owns them
+             */
+            static const unsigned NUM_NOTES = 128;
+            struct Kit
+            {
+                Kit();
+                ~Kit();
+
+                DrumVoice* voices[NUM_NOTES];
+            };
+
+            /* Thread pool task to load voice i of a kit. Errors are caught and
+             * kept, since they cannot be thrown from a worker.
              */
-            std::map<unsigned, DrumVoice*> voices;
+            struct KitLoad
+            {
+                std::vector<std::string> filenames;
+                std::vector<DrumVoice*> voices;
+                std::vector<std::exception_ptr> errors;
+            };
+            static void load_voice(void* arg, unsigned i);
+
+            /* Every hit currently sounding has a cursor into its sample. They
+             * are kept packed at the front of a fixed array, so mixing only
+             * touches hits that are playing, however big the kit is. When
+             * the array is full, a new hit replaces the one furthest along.
+             */
+            static const unsigned MAX_CURSORS = 64;
+            struct Cursor
+            {
+                const Sample* sample;
+                unsigned long position;
+                unsigned choke_group;
+                Kit* kit;
+            };
+            void stop_cursors(Kit* owner, unsigned choke_group);
+
+            Cursor cursors[MAX_CURSORS];
+            unsigned num_cursors;
+
+            /* Audio thread side. The current kit, and old kits that still
+             * have hits playing, oldest first. install_pending_kit switches
+             * to a newly published kit, and retire queues the old one to
+             * play out.
+             */
+            static const unsigned MAX_FADING_KITS = 4;
+            void install_pending_kit();
+            void retire(Kit* old_kit);
+
+            Kit* kit;
+            Kit* fading_kits[MAX_FADING_KITS];
+            unsigned num_fading_kits;
+
+            /* New kits are handed to the audio thread through pending_kit,
+             * and spent ones come back through retired_kits to be freed
+             */
+            std::atomic<Kit*> pending_kit;
+            SpscRingBuffer<Kit*> retired_kits;
     };
 
 
-    /* Drum voice manages a single sample in a drum machine. It reads its sample
-     * into memory for playback. It will retrigger its sound on repeated note
-     * down.
+    /* Drum voice manages a single sample in a drum machine. It shares its
+     * sample with every other voice playing the same file, through the sample
+     * pool. Playback itself is tracked by the drum adder, so one voice may be
+     * playing several hits at once.
      */
     class DrumVoice
     {
@@ -98,20 +174,8 @@ namespace ClickTrack
         protected:
             DrumVoice(const std::string& filename);
 
-            /* Handle getting notes
-             */
-            SAMPLE get_next_sample();
-            void on_note_down();
-
-            /* Returns true if playing
-             */
-            bool is_playing();
-
-            /* State for audio buffer
-             */
-            std::vector<SAMPLE> samples;
-            unsigned next_i;
-            bool playing;
+            std::shared_ptr<const Sample> sample;
+            unsigned choke_group; // zero for none
     };
 
 
@@ -119,15 +183,18 @@ namespace ClickTrack
     {
         public:
         InvalidKeymap(const std::string in_filename)
-            : filename(in_filename) {}
+            : filename(in_filename),
+              message("DrumMachine could not open the specified keymap: " +
+                      in_filename) {}
 
         const std::string filename;
         virtual const char* what() const throw()
         {
-            std::string message = 
-                "DrumMachine could not open the specified keymap: " + filename;
             return message.c_str();
         }
+
+        private:
+        const std::string message;
     };
 }
 
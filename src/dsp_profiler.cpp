@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <cxxabi.h>
+#include <cstdlib>
+#include "dsp_profiler.h"
+
+using namespace ClickTrack;
+
+
+/* Demangles a type name for display, falling back to the raw name
+ */
+static std::string demangle(const char* name)
+{
+    int status;
+    char* demangled = abi::__cxa_demangle(name, NULL, NULL, &status);
+    if(status != 0)
+        return name;
+
+    std::string result(demangled);
+    free(demangled);
+    return result;
+}
+
+
+const unsigned DspProfiler::MAX_NODES;
+
+
+DspProfiler::DspProfiler()
+    : totals(MAX_NODES), blocks(0), worst_block_ns(0), load(0.0),
+      published_num_nodes(0), published_blocks(0), published_last_block_ns(0),
+      published_worst_block_ns(0), published_load(0.0), sequence(0),
+      xruns(0)
+{
+    for(auto& node : published_nodes)
+    {
+        node.node.store(NULL);
+        node.type.store(NULL);
+        node.level.store(0);
+        node.last_ns.store(0);
+        node.mean_ns.store(0);
+        node.worst_ns.store(0);
+    }
+}
+
+
+void DspProfiler::reset()
+{
+    for(auto& node : totals)
+        node = {NULL, 0, 0, 0};
+    blocks = 0;
+    worst_block_ns = 0;
+    load = 0.0;
+
+    unsigned count = sequence.load(std::memory_order_relaxed);
+    sequence.store(count+1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    published_num_nodes.store(0, std::memory_order_relaxed);
+    published_blocks.store(0, std::memory_order_relaxed);
+    published_last_block_ns.store(0, std::memory_order_relaxed);
+    published_worst_block_ns.store(0, std::memory_order_relaxed);
+    published_load.store(0.0, std::memory_order_relaxed);
+
+    sequence.store(count+2, std::memory_order_release);
+}
+
+
+void DspProfiler::end_block(AudioGraph& graph, unsigned long long block_ns)
+{
+    // Update the rolling load with a one second time constant, starting from
+    // the first block's load
+    const double deadline_ns = 1e9 * BUFFER_SIZE / SAMPLE_RATE;
+    const double alpha = (double) BUFFER_SIZE / SAMPLE_RATE;
+    if(blocks == 0)
+        load = block_ns/deadline_ns;
+    else
+        load += alpha * (block_ns/deadline_ns - load);
+    worst_block_ns = std::max(worst_block_ns, block_ns);
+    blocks++;
+
+    // Mark the statistics as being written, then publish them
+    unsigned count = sequence.load(std::memory_order_relaxed);
+    sequence.store(count+1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    unsigned num_nodes = std::min(graph.get_num_nodes(), MAX_NODES);
+    for(unsigned i = 0; i < num_nodes; i++)
+    {
+        // Restart a node's totals if the schedule has changed under it
+        NodeTotals& node = totals[i];
+        if(node.node != graph.get_node(i))
+            node = {graph.get_node(i), 0, 0, 0};
+
+        unsigned long long ns = graph.get_node_time(i);
+        node.total_ns += ns;
+        node.worst_ns = std::max(node.worst_ns, ns);
+        node.blocks++;
+
+        PublishedNode& published = published_nodes[i];
+        published.node.store(node.node, std::memory_order_relaxed);
+        published.type.store(&graph.get_node_type(i),
+                std::memory_order_relaxed);
+        published.level.store(graph.get_node_level(i),
+                std::memory_order_relaxed);
+        published.last_ns.store(ns, std::memory_order_relaxed);
+        published.mean_ns.store(node.total_ns/node.blocks,
+                std::memory_order_relaxed);
+        published.worst_ns.store(node.worst_ns, std::memory_order_relaxed);
+    }
+    published_num_nodes.store(num_nodes, std::memory_order_relaxed);
+
+    published_blocks.store(blocks, std::memory_order_relaxed);
+    published_last_block_ns.store(block_ns, std::memory_order_relaxed);
+    published_worst_block_ns.store(worst_block_ns, std::memory_order_relaxed);
+    published_load.store(load, std::memory_order_relaxed);
+
+    sequence.store(count+2, std::memory_order_release);
+}
+
+
+void DspProfiler::add_xruns(unsigned long n)
+{
+    xruns.fetch_add(n, std::memory_order_relaxed);
+}
+
+
+DspProfiler::Snapshot DspProfiler::get_snapshot()
+{
+    Snapshot snapshot;
+    snapshot.deadline_us = 1e6 * BUFFER_SIZE / SAMPLE_RATE;
+    snapshot.nodes.reserve(MAX_NODES);
+
+    // Retry until we read the statistics without a publish landing in between
+    std::vector<const std::type_info*> types(MAX_NODES);
+    unsigned before, after;
+    do
+    {
+        before = sequence.load(std::memory_order_acquire);
+
+        snapshot.blocks = published_blocks.load(std::memory_order_relaxed);
+        snapshot.last_block_us =
+            published_last_block_ns.load(std::memory_order_relaxed) / 1e3;
+        snapshot.worst_block_us =
+            published_worst_block_ns.load(std::memory_order_relaxed) / 1e3;
+        snapshot.load = published_load.load(std::memory_order_relaxed);
+
+        unsigned num_nodes =
+            published_num_nodes.load(std::memory_order_relaxed);
+        snapshot.nodes.resize(num_nodes);
+        for(unsigned i = 0; i < num_nodes; i++)
+        {
+            PublishedNode& published = published_nodes[i];
+            NodeStats& node = snapshot.nodes[i];
+            node.node = published.node.load(std::memory_order_relaxed);
+            node.level = published.level.load(std::memory_order_relaxed);
+            node.last_us =
+                published.last_ns.load(std::memory_order_relaxed) / 1e3;
+            node.mean_us =
+                published.mean_ns.load(std::memory_order_relaxed) / 1e3;
+            node.worst_us =
+                published.worst_ns.load(std::memory_order_relaxed) / 1e3;
+            types[i] = published.type.load(std::memory_order_relaxed);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = sequence.load(std::memory_order_relaxed);
+    } while(before != after || before % 2 == 1);
+
+    // Name the nodes once we have a consistent read
+    for(unsigned i = 0; i < snapshot.nodes.size(); i++)
+        snapshot.nodes[i].name = demangle(types[i]->name());
+
+    snapshot.xruns = xruns.load(std::memory_order_relaxed);
+    return snapshot;
+}
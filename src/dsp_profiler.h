@@ -0,0 +1,114 @@
+#ifndef DSP_PROFILER_H
+#define DSP_PROFILER_H
+
+#include <atomic>
+#include <string>
+#include <typeinfo>
+#include <vector>
+#include "audio_graph.h"
+
+
+namespace ClickTrack
+{
+    /* The DSP profiler collects timing for each block of audio the graph
+     * runs, and for each node within it, and publishes it for a monitoring
+     * thread to poll.
+     *
+     * The audio thread publishes its statistics under a sequence count at the
+     * end of each block. Readers retry if they raced a publish, so the audio
+     * thread never waits on a reader. Only the first MAX_NODES nodes of the
+     * schedule are reported individually.
+     */
+    class DspProfiler
+    {
+        public:
+            DspProfiler();
+
+            /* Timing for one node, and for the whole graph. Times are in
+             * microseconds. Means and worst cases cover every block since
+             * profiling was enabled, or since the node was scheduled.
+             *
+             * Load is the rolling fraction of the block deadline spent
+             * running the graph, averaged over about a second. Above one, the
+             * graph can't keep up with the device.
+             */
+            struct NodeStats
+            {
+                const void* node;
+                std::string name;
+                unsigned level;
+                double last_us;
+                double mean_us;
+                double worst_us;
+            };
+
+            struct Snapshot
+            {
+                unsigned long blocks;
+                double deadline_us;
+                double last_block_us;
+                double worst_block_us;
+                double load;
+                unsigned long xruns;
+                std::vector<NodeStats> nodes;
+            };
+
+            /* Called on the audio thread. reset clears all statistics except
+             * the xrun count, and end_block records a block that took
+             * block_ns to run, reading the node times from the graph.
+             */
+            void reset();
+            void end_block(AudioGraph& graph, unsigned long long block_ns);
+
+            /* Counts xruns reported by the sound driver. Safe to call from
+             * any thread.
+             */
+            void add_xruns(unsigned long n);
+
+            /* Returns the latest statistics. Safe to call from any thread, but
+             * allocates, so it should not be called on the audio thread.
+             */
+            Snapshot get_snapshot();
+
+            static const unsigned MAX_NODES = 256;
+
+        private:
+            /* Statistics private to the audio thread
+             */
+            struct NodeTotals
+            {
+                const void* node;
+                unsigned long long total_ns;
+                unsigned long long worst_ns;
+                unsigned long blocks;
+            };
+            std::vector<NodeTotals> totals;
+            unsigned long blocks;
+            unsigned long long worst_block_ns;
+            double load;
+
+            /* The published statistics, guarded by a sequence count that is
+             * odd while a publish is in progress
+             */
+            struct PublishedNode
+            {
+                std::atomic<const void*> node;
+                std::atomic<const std::type_info*> type;
+                std::atomic<unsigned> level;
+                std::atomic<unsigned long long> last_ns;
+                std::atomic<unsigned long long> mean_ns;
+                std::atomic<unsigned long long> worst_ns;
+            };
+            PublishedNode published_nodes[MAX_NODES];
+            std::atomic<unsigned> published_num_nodes;
+            std::atomic<unsigned long> published_blocks;
+            std::atomic<unsigned long long> published_last_block_ns;
+            std::atomic<unsigned long long> published_worst_block_ns;
+            std::atomic<double> published_load;
+            std::atomic<unsigned> sequence;
+
+            std::atomic<unsigned long> xruns;
+    };
+}
+
+#endif
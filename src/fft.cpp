@@ -1,12 +1,17 @@
+#include <cmath>
 #include "fft.h"
+#include "fixed_fft.h"
 
 using namespace ClickTrack;
 const float PI = 3.14159265358979f;
+const double TWO_PI = 6.28318530717958647692;
 
 
 Transformer::Transformer(unsigned in_size)
     : size(in_size), buffer_size(next_power_of_two(in_size)),
-      bit_reverses(), twiddles()
+      bit_reverses(), twiddles(), pass_twiddles(),
+      pass_offsets(int_log(buffer_size)+1, 0),
+      work_real(buffer_size), work_imag(buffer_size)
 {
     // Populate the bit reverses
     // Uses bit shift because we only use the lower log2(size) bits to express
@@ -19,99 +24,210 @@ Transformer::Transformer(unsigned in_size)
     std::complex<SAMPLE> exponent(0,-2*PI/buffer_size);
     for(int i = 0; i < buffer_size; i++)
         twiddles.push_back(exp(exponent * std::complex<SAMPLE>(i,0)));
+
+    // Populate the twiddles for every radix-4 pass we might need. Compute in
+    // double precision so large transforms don't accumulate error.
+    for(unsigned length = 4; length <= buffer_size; length *= 2)
+    {
+        unsigned quarter = length/4;
+        pass_offsets[int_log(length)] = pass_twiddles.size();
+        pass_twiddles.resize(pass_twiddles.size() + 6*quarter);
+
+        SAMPLE* table = &pass_twiddles[pass_offsets[int_log(length)]];
+        for(unsigned p = 1; p <= 3; p++)
+        {
+            SAMPLE* real = table + 2*(p-1)*quarter;
+            SAMPLE* imag = real + quarter;
+            for(unsigned j = 0; j < quarter; j++)
+            {
+                double angle = -TWO_PI*p*j/length;
+                real[j] = cos(angle);
+                imag[j] = sin(angle);
+            }
+        }
+    }
 }
 
 
-void Transformer::fft(std::complex<SAMPLE>* in, std::complex<SAMPLE>* out)
+void Transformer::fft(const std::complex<SAMPLE>* in,
+        std::complex<SAMPLE>* out)
 {
-    // Copy the output into bit reverse order
+    // Copy the input into bit reverse order
     for(unsigned i = 0; i < buffer_size; i++)
     {
         unsigned reverse_i = bit_reverses[i];
-        if(i > size)
-            out[reverse_i] = std::complex<SAMPLE>(0,0);
+        if(i >= size)
+        {
+            work_real[reverse_i] = 0.0;
+            work_imag[reverse_i] = 0.0;
+        }
         else
-            out[reverse_i] = in[i];
+        {
+            work_real[reverse_i] = in[i].real();
+            work_imag[reverse_i] = in[i].imag();
+        }
     }
 
-    // Iteratively perform FFT, starting at 2 poitns
-    for(unsigned N = 2; N <= buffer_size; N *= 2)
-    {
-        // For each of the small FFTs
-        for(unsigned set = 0; set < buffer_size/N; set++)
-        {
-            // For each pair of N
-            for(unsigned i = 0; i < N/2; i++)
-            {
-                unsigned lower_i = N*set + i;
-                unsigned upper_i = lower_i + N/2;
+    transform(buffer_size);
 
-                // Grab out the lower and upper N
-                std::complex<SAMPLE> lower = out[lower_i];
-                std::complex<SAMPLE> upper =
-                    out[upper_i] * twiddles[buffer_size/N * i];
+    for(unsigned i = 0; i < buffer_size; i++)
+        out[i] = std::complex<SAMPLE>(work_real[i], work_imag[i]);
+}
 
-                // Assign them back using a butterfly
-                out[lower_i] = lower + upper;
-                out[upper_i] = lower - upper;
-            }
-        }
-    }
+
+void Transformer::ifft(const std::complex<SAMPLE>* in,
+        std::complex<SAMPLE>* out)
+{
+    ifft(in, out, 1.0/buffer_size);
 }
 
 
-void Transformer::ifft(std::complex<SAMPLE>* in, std::complex<SAMPLE>* out)
+void Transformer::ifft(const std::complex<SAMPLE>* in,
+        std::complex<SAMPLE>* out, SAMPLE scale)
 {
-    // conjugate the input
-    for(int i = 0; i < size; i++)
+    // Copy the input into bit reverse order. A spectrum always covers the
+    // whole transform, so unlike the forward transform there is no padding.
+    for(unsigned i = 0; i < buffer_size; i++)
     {
-        in[i] = conj(in[i]);
+        work_real[bit_reverses[i]] = in[i].real();
+        work_imag[bit_reverses[i]] = in[i].imag();
     }
 
-    // perform forward fft
-    fft(in, out);
+    transform(buffer_size, true);
 
-    // conjugate and normalize the output
-    for(int i = 0; i < size; i++)
+    // Normalize on the way out
+    for(unsigned i = 0; i < buffer_size; i++)
+        out[i] = std::complex<SAMPLE>(scale*work_real[i], scale*work_imag[i]);
+}
+
+
+void Transformer::rfft(const SAMPLE* in, std::complex<SAMPLE>* out)
+{
+    const unsigned half = buffer_size/2;
+
+    // Pack even samples into the real part and odd samples into the imaginary
+    // part, in bit reverse order for a half length transform. The half length
+    // bit reverse is the full length one shifted down by one.
+    for(unsigned i = 0; i < half; i++)
+    {
+        unsigned reverse_i = bit_reverses[i] >> 1;
+        work_real[reverse_i] = 2*i < size ? in[2*i] : 0.0;
+        work_imag[reverse_i] = 2*i+1 < size ? in[2*i+1] : 0.0;
+    }
+    transform(half);
+
+    // Split the spectra of the even and odd samples back apart, then combine
+    // them with one last butterfly. DC and Nyquist only need the real parts.
+    out[0] = std::complex<SAMPLE>(work_real[0] + work_imag[0], 0.0);
+    out[half] = std::complex<SAMPLE>(work_real[0] - work_imag[0], 0.0);
+    for(unsigned k = 1; k < half; k++)
     {
-        out[i] = conj(out[i]) / ((SAMPLE)buffer_size);
+        SAMPLE ar = work_real[k], ai = work_imag[k];
+        SAMPLE br = work_real[half-k], bi = work_imag[half-k];
+
+        SAMPLE even_real = 0.5f*(ar + br);
+        SAMPLE even_imag = 0.5f*(ai - bi);
+        SAMPLE odd_real = 0.5f*(ai + bi);
+        SAMPLE odd_imag = -0.5f*(ar - br);
+
+        SAMPLE wr = twiddles[k].real(), wi = twiddles[k].imag();
+        out[k] = std::complex<SAMPLE>(
+                even_real + wr*odd_real - wi*odd_imag,
+                even_imag + wr*odd_imag + wi*odd_real);
     }
 }
 
 
-unsigned ClickTrack::next_power_of_two(unsigned in)
+void Transformer::irfft(const std::complex<SAMPLE>* in, SAMPLE* out)
 {
-    in--;
-    in |= in >> 1;
-    in |= in >> 2;
-    in |= in >> 4;
-    in |= in >> 8;
-    in |= in >> 16;
-    in++;
-
-    return in;
+    irfft(in, out, 1.0/buffer_size);
 }
 
 
-unsigned ClickTrack::bit_reverse(unsigned in)
+void Transformer::irfft(const std::complex<SAMPLE>* in, SAMPLE* out,
+        SAMPLE scale)
 {
-    in = (in >> 16) | (in << 16);
-    in = ((in & 0xFF00FF00) >> 8) | ((in & 0x00FF00FF) << 8);
-    in = ((in & 0xF0F0F0F0) >> 4) | ((in & 0x0F0F0F0F) << 4);
-    in = ((in & 0xCCCCCCCC) >> 2) | ((in & 0x33333333) << 2);
-    in = ((in & 0xAAAAAAAA) >> 1) | ((in & 0x55555555) << 1);
-    return in;
+    const unsigned half = buffer_size/2;
+
+    // Recover the spectra of the even and odd samples, and pack them into a
+    // single half length spectrum
+    for(unsigned k = 0; k < half; k++)
+    {
+        SAMPLE ar = in[k].real(), ai = in[k].imag();
+        SAMPLE br = in[half-k].real(), bi = in[half-k].imag();
+
+        SAMPLE even_real = 0.5f*(ar + br);
+        SAMPLE even_imag = 0.5f*(ai - bi);
+        SAMPLE diff_real = 0.5f*(ar - br);
+        SAMPLE diff_imag = 0.5f*(ai + bi);
+
+        // Multiply by the conjugate twiddle
+        SAMPLE wr = twiddles[k].real(), wi = twiddles[k].imag();
+        SAMPLE odd_real = diff_real*wr + diff_imag*wi;
+        SAMPLE odd_imag = diff_imag*wr - diff_real*wi;
+
+        unsigned reverse_k = bit_reverses[k] >> 1;
+        work_real[reverse_k] = even_real - odd_imag;
+        work_imag[reverse_k] = even_imag + odd_real;
+    }
+    transform(half, true);
+
+    // Unpack and normalize. Splitting the spectrum halved it, so double
+    // the scale to make up for it
+    const SAMPLE unpack_scale = 2*scale;
+    for(unsigned i = 0; i < half; i++)
+    {
+        out[2*i] = unpack_scale*work_real[i];
+        out[2*i+1] = unpack_scale*work_imag[i];
+    }
+}
+
+
+void Transformer::transform(unsigned n, bool inverse)
+{
+    if(inverse)
+        transform_passes<true>(n);
+    else
+        transform_passes<false>(n);
 }
 
 
-unsigned ClickTrack::int_log(unsigned in)
+template <bool Inverse>
+void Transformer::transform_passes(unsigned n)
 {
-    in--;
-    unsigned result = 0;
-    while(in > 0)
+    SAMPLE* real = &work_real[0];
+    SAMPLE* imag = &work_imag[0];
+
+    // Use a specialized kernel when there is one for this size
+    switch(n)
     {
-        in = in >> 1;
-        result++;
+        case 64:
+            FixedTransformer<64>::transform<Inverse>(real, imag);
+            return;
+        case 128:
+            FixedTransformer<128>::transform<Inverse>(real, imag);
+            return;
+        case 256:
+            FixedTransformer<256>::transform<Inverse>(real, imag);
+            return;
+        case 512:
+            FixedTransformer<512>::transform<Inverse>(real, imag);
+            return;
+        case 1024:
+            FixedTransformer<1024>::transform<Inverse>(real, imag);
+            return;
     }
-    return result;
+
+    // Otherwise pair up stages into radix-4 passes. With an odd number of
+    // stages, the first is done alone.
+    unsigned length = 4;
+    if(int_log(n) % 2 == 1)
+    {
+        FixedFFT::radix2_pass(real, imag, n);
+        length = 8;
+    }
+
+    for(; length <= n; length *= 4)
+        FixedFFT::radix4_pass<Inverse>(real, imag, n, length,
+                &pass_twiddles[pass_offsets[int_log(length)]]);
 }
@@ -3,6 +3,7 @@
 
 #include <complex>
 #include <vector>
+#include "bit_ops.h"
 #include "portaudio_wrapper.h"
 
 
@@ -12,8 +13,15 @@ namespace ClickTrack
      * FFTs. Once initialized, it precomputes lookup tables for bitreversal and
      * twiddle factors. You can then utilize these to perform FFTs.
      *
-     * This function was written from scratch for ClickTrack as a learning
-     * exercise, but is poorly optimized and runs fairly slowly.
+     * Internally this is an iterative decimation in time transform, working
+     * on separate arrays of real and imaginary parts. Stages are combined in
+     * pairs into radix-4 passes, with one radix-2 pass first when the length
+     * is an odd power of two. Each pass has its own contiguous twiddle
+     * tables, so the butterflies stream through memory and run four at a
+     * time with SSE when it is available.
+     *
+     * Common sizes dispatch to FixedTransformer kernels, which the compiler
+     * has specialized for their length.
      */
     class Transformer
     {
@@ -21,34 +29,64 @@ namespace ClickTrack
             Transformer(unsigned in_size);
 
             /* Given the input complex numbers, computes the fft and places the
-             * result in the output buffer. May destructively modify the input
-             * buffer. */
-            void fft(std::complex<SAMPLE>* in, std::complex<SAMPLE>* out);
-            void ifft(std::complex<SAMPLE>* in, std::complex<SAMPLE>* out);
+             * result in the output buffer. The input is left untouched, and
+             * may be the same buffer as the output.
+             *
+             * The forward transform zero pads its input from size up to the
+             * transform size N. The inverse reads and writes all N points,
+             * and scales its output by 1/N unless given another scale factor.
+             * Pass 1 to leave it unnormalized, or fold in a gain for free.
+             */
+            void fft(const std::complex<SAMPLE>* in, std::complex<SAMPLE>* out);
+            void ifft(const std::complex<SAMPLE>* in,
+                    std::complex<SAMPLE>* out);
+            void ifft(const std::complex<SAMPLE>* in,
+                    std::complex<SAMPLE>* out, SAMPLE scale);
+
+            /* Transforms of purely real signals. rfft reads size real samples
+             * (zero padded up to the transform size N) and writes the N/2+1
+             * non-redundant bins of the spectrum. irfft inverts this, reading
+             * N/2+1 bins and writing N real samples. Neither modifies its
+             * input. Like ifft, irfft scales its output by 1/N unless given
+             * another scale factor, so that it inverts rfft.
+             *
+             * Both pack the real signal into a complex signal of half the
+             * length, so they cost one N/2 point transform instead of an N
+             * point one. N must be at least 2.
+             */
+            void rfft(const SAMPLE* in, std::complex<SAMPLE>* out);
+            void irfft(const std::complex<SAMPLE>* in, SAMPLE* out);
+            void irfft(const std::complex<SAMPLE>* in, SAMPLE* out,
+                    SAMPLE scale);
 
         private:
+            /* Performs an n point transform in place on the work arrays,
+             * which must already hold the input in bit reversed order. n must
+             * be a power of two no larger than the buffer size. The inverse
+             * conjugates its twiddles, and is unnormalized.
+             *
+             * All transforms run through the work arrays, which are allocated
+             * once up front, so none of them ever allocate.
+             */
+            void transform(unsigned n, bool inverse = false);
+            template <bool Inverse> void transform_passes(unsigned n);
+
             const unsigned size;
             const unsigned buffer_size;
 
             std::vector<unsigned> bit_reverses;
             std::vector< std::complex<SAMPLE> > twiddles;
-    };
-
 
-    /* Helper function - internally used by transformer.
-     * Given an integer, returns the next highest power of two.
-     */
-    unsigned next_power_of_two(unsigned in);
-
-    /* Helper function - internally used by transformer.
-     * Given an integer, returns the bitreversed value
-     */
-    unsigned bit_reverse(unsigned in);
+            // Twiddles for each radix-4 pass, indexed by the log of the pass
+            // length L. Each pass stores w^j, w^2j and w^3j for j < L/4, as
+            // six arrays: real then imaginary for each.
+            std::vector<SAMPLE> pass_twiddles;
+            std::vector<unsigned> pass_offsets;
 
-    /* Helper function - internally used by transformer.
-     * Find the log2 of an integer. Rounded up.
-     */
-    unsigned int_log(unsigned in);
+            // Work space for the transforms
+            std::vector<SAMPLE> work_real;
+            std::vector<SAMPLE> work_imag;
+    };
 }
 
 #endif
@@ -73,7 +73,7 @@ void FirstOrderFilter::filter(std::vector<SAMPLE>& input,
         // Calculate this time step
         float x  = input[i];
         float y1 = a*x + x_last[i] - a*y1_last[i];
-        float y;
+        float y = 0.0;
         switch(mode)
         {
             case LOWPASS:
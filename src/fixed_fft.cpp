@@ -0,0 +1,325 @@
+#ifndef FIXED_FFT_CPP
+#define FIXED_FFT_CPP
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+#include "fixed_fft.h"
+
+using namespace ClickTrack;
+
+
+// Out of class definitions of the constexpr tables
+template <unsigned N, unsigned... I>
+constexpr unsigned
+FixedFFT::BitReverses< N, FixedFFT::Indices<I...> >::table[N];
+
+template <unsigned L, unsigned... J>
+constexpr SAMPLE
+FixedFFT::PassTwiddles< L, FixedFFT::Indices<J...> >::table[6*(L/4)];
+
+template <unsigned N, unsigned... K>
+constexpr SAMPLE
+FixedFFT::RealTwiddles< N, FixedFFT::Indices<K...> >::real[N/2];
+
+template <unsigned N, unsigned... K>
+constexpr SAMPLE
+FixedFFT::RealTwiddles< N, FixedFFT::Indices<K...> >::imag[N/2];
+
+
+template <unsigned N>
+void FixedTransformer<N>::fft(const std::complex<SAMPLE>* in,
+        std::complex<SAMPLE>* out)
+{
+    const unsigned* reverses = FixedFFT::BitReverses<N>::table;
+    for(unsigned i = 0; i < N; i++)
+    {
+        work_real[reverses[i]] = in[i].real();
+        work_imag[reverses[i]] = in[i].imag();
+    }
+
+    transform(work_real, work_imag);
+
+    for(unsigned i = 0; i < N; i++)
+        out[i] = std::complex<SAMPLE>(work_real[i], work_imag[i]);
+}
+
+
+template <unsigned N>
+void FixedTransformer<N>::ifft(const std::complex<SAMPLE>* in,
+        std::complex<SAMPLE>* out)
+{
+    ifft(in, out, 1.0/N);
+}
+
+
+template <unsigned N>
+void FixedTransformer<N>::ifft(const std::complex<SAMPLE>* in,
+        std::complex<SAMPLE>* out, SAMPLE scale)
+{
+    const unsigned* reverses = FixedFFT::BitReverses<N>::table;
+    for(unsigned i = 0; i < N; i++)
+    {
+        work_real[reverses[i]] = in[i].real();
+        work_imag[reverses[i]] = in[i].imag();
+    }
+
+    transform<true>(work_real, work_imag);
+
+    // Normalize on the way out
+    for(unsigned i = 0; i < N; i++)
+        out[i] = std::complex<SAMPLE>(scale*work_real[i], scale*work_imag[i]);
+}
+
+
+template <unsigned N>
+void FixedTransformer<N>::rfft(const SAMPLE* in, std::complex<SAMPLE>* out)
+{
+    const unsigned half = N/2;
+
+    // Pack even samples into the real part and odd samples into the
+    // imaginary part of a half length transform
+    const unsigned* reverses = FixedFFT::BitReverses<half>::table;
+    for(unsigned i = 0; i < half; i++)
+    {
+        work_real[reverses[i]] = in[2*i];
+        work_imag[reverses[i]] = in[2*i+1];
+    }
+    FixedTransformer<half>::transform(work_real, work_imag);
+
+    // Split the spectra of the even and odd samples back apart, then combine
+    // them with one last butterfly. DC and Nyquist only need the real parts.
+    const SAMPLE* twiddle_real = FixedFFT::RealTwiddles<N>::real;
+    const SAMPLE* twiddle_imag = FixedFFT::RealTwiddles<N>::imag;
+
+    out[0] = std::complex<SAMPLE>(work_real[0] + work_imag[0], 0.0);
+    out[half] = std::complex<SAMPLE>(work_real[0] - work_imag[0], 0.0);
+    for(unsigned k = 1; k < half; k++)
+    {
+        SAMPLE ar = work_real[k], ai = work_imag[k];
+        SAMPLE br = work_real[half-k], bi = work_imag[half-k];
+
+        SAMPLE even_real = 0.5f*(ar + br);
+        SAMPLE even_imag = 0.5f*(ai - bi);
+        SAMPLE odd_real = 0.5f*(ai + bi);
+        SAMPLE odd_imag = -0.5f*(ar - br);
+
+        SAMPLE wr = twiddle_real[k], wi = twiddle_imag[k];
+        out[k] = std::complex<SAMPLE>(
+                even_real + wr*odd_real - wi*odd_imag,
+                even_imag + wr*odd_imag + wi*odd_real);
+    }
+}
+
+
+template <unsigned N>
+void FixedTransformer<N>::irfft(const std::complex<SAMPLE>* in, SAMPLE* out)
+{
+    irfft(in, out, 1.0/N);
+}
+
+
+template <unsigned N>
+void FixedTransformer<N>::irfft(const std::complex<SAMPLE>* in, SAMPLE* out,
+        SAMPLE scale)
+{
+    const unsigned half = N/2;
+    const SAMPLE* twiddle_real = FixedFFT::RealTwiddles<N>::real;
+    const SAMPLE* twiddle_imag = FixedFFT::RealTwiddles<N>::imag;
+
+    // Recover the spectra of the even and odd samples, and pack them into a
+    // single half length spectrum
+    const unsigned* reverses = FixedFFT::BitReverses<half>::table;
+    for(unsigned k = 0; k < half; k++)
+    {
+        SAMPLE ar = in[k].real(), ai = in[k].imag();
+        SAMPLE br = in[half-k].real(), bi = in[half-k].imag();
+
+        SAMPLE even_real = 0.5f*(ar + br);
+        SAMPLE even_imag = 0.5f*(ai - bi);
+        SAMPLE diff_real = 0.5f*(ar - br);
+        SAMPLE diff_imag = 0.5f*(ai + bi);
+
+        // Multiply by the conjugate twiddle
+        SAMPLE wr = twiddle_real[k], wi = twiddle_imag[k];
+        SAMPLE odd_real = diff_real*wr + diff_imag*wi;
+        SAMPLE odd_imag = diff_imag*wr - diff_real*wi;
+
+        work_real[reverses[k]] = even_real - odd_imag;
+        work_imag[reverses[k]] = even_imag + odd_real;
+    }
+    FixedTransformer<half>::template transform<true>(work_real, work_imag);
+
+    // Unpack and normalize. Splitting the spectrum halved it, so double
+    // the scale to make up for it
+    const SAMPLE unpack_scale = 2*scale;
+    for(unsigned i = 0; i < half; i++)
+    {
+        out[2*i] = unpack_scale*work_real[i];
+        out[2*i+1] = unpack_scale*work_imag[i];
+    }
+}
+
+
+template <unsigned N>
+template <bool Inverse>
+void FixedTransformer<N>::transform(SAMPLE* real, SAMPLE* imag)
+{
+    static_assert(N >= 2 && (N & (N-1)) == 0,
+            "FixedTransformer size must be a power of two");
+
+    // Pair up stages into radix-4 passes. With an odd number of stages, the
+    // first is done alone.
+    if(FixedFFT::log_two(N) % 2 == 1)
+    {
+        FixedFFT::radix2_pass(real, imag, N);
+        FixedFFT::Passes<N, 8, Inverse>::run(real, imag);
+    }
+    else
+    {
+        FixedFFT::Passes<N, 4, Inverse>::run(real, imag);
+    }
+}
+
+
+template <unsigned N, unsigned L, bool Inverse, bool Done>
+void FixedFFT::Passes<N, L, Inverse, Done>::run(SAMPLE* real, SAMPLE* imag)
+{
+    radix4_pass<Inverse>(real, imag, N, L, PassTwiddles<L>::table);
+    Passes<N, 4*L, Inverse>::run(real, imag);
+}
+
+
+inline void FixedFFT::radix2_pass(SAMPLE* real, SAMPLE* imag, unsigned n)
+{
+    // Every twiddle is one
+    for(unsigned i = 0; i < n; i += 2)
+    {
+        SAMPLE upper_real = real[i+1];
+        SAMPLE upper_imag = imag[i+1];
+
+        real[i+1] = real[i] - upper_real;
+        imag[i+1] = imag[i] - upper_imag;
+        real[i] += upper_real;
+        imag[i] += upper_imag;
+    }
+}
+
+
+template <bool Inverse>
+inline void FixedFFT::radix4_pass(SAMPLE* real, SAMPLE* imag, unsigned n,
+        unsigned length, const SAMPLE* table)
+{
+    // Each group of the given length holds four transforms a quarter as long.
+    // Input is bit reversed, so they are transforms of the samples at 0, 2,
+    // 1 and 3 mod 4, in that order. We combine them with:
+    //
+    //      X[j]        = A + B + C + D
+    //      X[j + L/4]  = A - iB - C + iD
+    //      X[j + L/2]  = A - B + C - D
+    //      X[j + 3L/4] = A + iB - C - iD
+    //
+    // where B, C and D have been multiplied by w^j, w^2j and w^3j.
+    //
+    // The inverse conjugates every twiddle, which also swaps the outputs at
+    // L/4 and 3L/4.
+    const unsigned quarter = length/4;
+    const SAMPLE* w1_real = table;
+    const SAMPLE* w1_imag = table + quarter;
+    const SAMPLE* w2_real = table + 2*quarter;
+    const SAMPLE* w2_imag = table + 3*quarter;
+    const SAMPLE* w3_real = table + 4*quarter;
+    const SAMPLE* w3_imag = table + 5*quarter;
+
+    for(unsigned group = 0; group < n; group += length)
+    {
+        SAMPLE* r0 = real + group;
+        SAMPLE* i0 = imag + group;
+        SAMPLE* r1 = r0 + quarter;
+        SAMPLE* i1 = i0 + quarter;
+        SAMPLE* r2 = r1 + quarter;
+        SAMPLE* i2 = i1 + quarter;
+        SAMPLE* r3 = r2 + quarter;
+        SAMPLE* i3 = i2 + quarter;
+
+        // Where A - iB - C + iD goes, and where A + iB - C - iD goes
+        SAMPLE* minus_real = Inverse ? r3 : r1;
+        SAMPLE* minus_imag = Inverse ? i3 : i1;
+        SAMPLE* plus_real = Inverse ? r1 : r3;
+        SAMPLE* plus_imag = Inverse ? i1 : i3;
+
+        unsigned j = 0;
+
+#ifdef __SSE__
+        // Four butterflies at a time
+        const __m128 sign = _mm_set1_ps(-0.0f);
+        for(; j+4 <= quarter; j += 4)
+        {
+            __m128 ar = _mm_loadu_ps(r0+j), ai = _mm_loadu_ps(i0+j);
+            __m128 xr = _mm_loadu_ps(r2+j), xi = _mm_loadu_ps(i2+j);
+            __m128 wr = _mm_loadu_ps(w1_real+j), wi = _mm_loadu_ps(w1_imag+j);
+            if(Inverse) wi = _mm_xor_ps(wi, sign);
+            __m128 br = _mm_sub_ps(_mm_mul_ps(xr, wr), _mm_mul_ps(xi, wi));
+            __m128 bi = _mm_add_ps(_mm_mul_ps(xr, wi), _mm_mul_ps(xi, wr));
+
+            xr = _mm_loadu_ps(r1+j), xi = _mm_loadu_ps(i1+j);
+            wr = _mm_loadu_ps(w2_real+j), wi = _mm_loadu_ps(w2_imag+j);
+            if(Inverse) wi = _mm_xor_ps(wi, sign);
+            __m128 cr = _mm_sub_ps(_mm_mul_ps(xr, wr), _mm_mul_ps(xi, wi));
+            __m128 ci = _mm_add_ps(_mm_mul_ps(xr, wi), _mm_mul_ps(xi, wr));
+
+            xr = _mm_loadu_ps(r3+j), xi = _mm_loadu_ps(i3+j);
+            wr = _mm_loadu_ps(w3_real+j), wi = _mm_loadu_ps(w3_imag+j);
+            if(Inverse) wi = _mm_xor_ps(wi, sign);
+            __m128 dr = _mm_sub_ps(_mm_mul_ps(xr, wr), _mm_mul_ps(xi, wi));
+            __m128 di = _mm_add_ps(_mm_mul_ps(xr, wi), _mm_mul_ps(xi, wr));
+
+            __m128 t0r = _mm_add_ps(ar, cr), t0i = _mm_add_ps(ai, ci);
+            __m128 t1r = _mm_sub_ps(ar, cr), t1i = _mm_sub_ps(ai, ci);
+            __m128 t2r = _mm_add_ps(br, dr), t2i = _mm_add_ps(bi, di);
+            __m128 t3r = _mm_sub_ps(br, dr), t3i = _mm_sub_ps(bi, di);
+
+            _mm_storeu_ps(r0+j, _mm_add_ps(t0r, t2r));
+            _mm_storeu_ps(i0+j, _mm_add_ps(t0i, t2i));
+            _mm_storeu_ps(r2+j, _mm_sub_ps(t0r, t2r));
+            _mm_storeu_ps(i2+j, _mm_sub_ps(t0i, t2i));
+            _mm_storeu_ps(minus_real+j, _mm_add_ps(t1r, t3i));
+            _mm_storeu_ps(minus_imag+j, _mm_sub_ps(t1i, t3r));
+            _mm_storeu_ps(plus_real+j, _mm_sub_ps(t1r, t3i));
+            _mm_storeu_ps(plus_imag+j, _mm_add_ps(t1i, t3r));
+        }
+#endif
+
+        // Finish off the remainder, and the short passes
+        for(; j < quarter; j++)
+        {
+            SAMPLE w1i = Inverse ? -w1_imag[j] : w1_imag[j];
+            SAMPLE w2i = Inverse ? -w2_imag[j] : w2_imag[j];
+            SAMPLE w3i = Inverse ? -w3_imag[j] : w3_imag[j];
+
+            SAMPLE ar = r0[j], ai = i0[j];
+            SAMPLE br = r2[j]*w1_real[j] - i2[j]*w1i;
+            SAMPLE bi = r2[j]*w1i + i2[j]*w1_real[j];
+            SAMPLE cr = r1[j]*w2_real[j] - i1[j]*w2i;
+            SAMPLE ci = r1[j]*w2i + i1[j]*w2_real[j];
+            SAMPLE dr = r3[j]*w3_real[j] - i3[j]*w3i;
+            SAMPLE di = r3[j]*w3i + i3[j]*w3_real[j];
+
+            SAMPLE t0r = ar + cr, t0i = ai + ci;
+            SAMPLE t1r = ar - cr, t1i = ai - ci;
+            SAMPLE t2r = br + dr, t2i = bi + di;
+            SAMPLE t3r = br - dr, t3i = bi - di;
+
+            r0[j] = t0r + t2r;
+            i0[j] = t0i + t2i;
+            r2[j] = t0r - t2r;
+            i2[j] = t0i - t2i;
+            minus_real[j] = t1r + t3i;
+            minus_imag[j] = t1i - t3r;
+            plus_real[j] = t1r - t3i;
+            plus_imag[j] = t1i + t3r;
+        }
+    }
+}
+
+#endif
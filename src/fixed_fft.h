@@ -0,0 +1,185 @@
+#ifndef FIXED_FFT_H
+#define FIXED_FFT_H
+
+#include <complex>
+#include "portaudio_wrapper.h"
+
+
+namespace ClickTrack
+{
+    /* The FixedTransformer computes FFTs of a size fixed at compile time. Its
+     * bit reversal permutation and twiddle tables are computed by the
+     * compiler, and every loop bound is a constant, so small transforms can
+     * be unrolled and specialized completely.
+     *
+     * It runs the same split real/imaginary radix-4 passes as Transformer,
+     * which remains the fallback for sizes only known at run time. N must be
+     * a power of two, at least 4.
+     */
+    template <unsigned N>
+    class FixedTransformer
+    {
+        public:
+            /* Complex transforms of N points. Neither modifies its input, and
+             * in and out may be the same buffer. The inverse scales its
+             * output by 1/N, unless given another scale factor.
+             */
+            void fft(const std::complex<SAMPLE>* in, std::complex<SAMPLE>* out);
+            void ifft(const std::complex<SAMPLE>* in,
+                    std::complex<SAMPLE>* out);
+            void ifft(const std::complex<SAMPLE>* in,
+                    std::complex<SAMPLE>* out, SAMPLE scale);
+
+            /* Real transforms. rfft reads N real samples and writes the N/2+1
+             * non-redundant bins, and irfft does the reverse. Its output is
+             * scaled as in ifft.
+             */
+            void rfft(const SAMPLE* in, std::complex<SAMPLE>* out);
+            void irfft(const std::complex<SAMPLE>* in, SAMPLE* out);
+            void irfft(const std::complex<SAMPLE>* in, SAMPLE* out,
+                    SAMPLE scale);
+
+            /* Transforms the split arrays in place. They must already hold
+             * the input in bit reversed order. The inverse is unnormalized.
+             */
+            template <bool Inverse = false>
+            static void transform(SAMPLE* real, SAMPLE* imag);
+
+        private:
+            SAMPLE work_real[N];
+            SAMPLE work_imag[N];
+    };
+
+
+    /* The pieces FixedTransformer is built from, shared with Transformer.
+     */
+    namespace FixedFFT
+    {
+        /* C++11 constexpr functions must be a single return statement, so
+         * these are all recursive.
+         */
+        constexpr unsigned log_two(unsigned n)
+        {
+            return n <= 1 ? 0 : 1 + log_two(n/2);
+        }
+
+        constexpr unsigned reverse_bits(unsigned i, unsigned bits)
+        {
+            return bits == 0 ? 0 :
+                ((i & 1) << (bits-1)) | reverse_bits(i >> 1, bits-1);
+        }
+
+        /* Taylor series, accurate to double precision on [-pi, pi]. Sine
+         * starts from x at n=1, and cosine from 1 at n=0.
+         */
+        constexpr double taylor_series(double x, double term, unsigned n)
+        {
+            return n > 40 ? term :
+                term + taylor_series(x, -term*x*x/((n+1)*(n+2)), n+2);
+        }
+
+        /* The angle of the twiddle w_n^k, wrapped into [-pi, pi]
+         */
+        constexpr double twiddle_angle(unsigned k, unsigned n)
+        {
+            return -6.28318530717958647692 *
+                (2*(k%n) <= n ? (double)(k%n) : (double)(k%n) - n) / n;
+        }
+
+        constexpr SAMPLE twiddle_real(unsigned k, unsigned n)
+        {
+            return taylor_series(twiddle_angle(k, n), 1.0, 0);
+        }
+
+        constexpr SAMPLE twiddle_imag(unsigned k, unsigned n)
+        {
+            return taylor_series(twiddle_angle(k, n), twiddle_angle(k, n), 1);
+        }
+
+
+        /* A pack of indices 0 to N-1, built by halves to keep template
+         * recursion shallow
+         */
+        template <unsigned... I> struct Indices {};
+
+        template <class A, class B> struct Concat;
+        template <unsigned... A, unsigned... B>
+        struct Concat< Indices<A...>, Indices<B...> >
+        {
+            typedef Indices<A..., (sizeof...(A) + B)...> type;
+        };
+
+        template <unsigned N> struct MakeIndices
+        {
+            typedef typename Concat<typename MakeIndices<N/2>::type,
+                    typename MakeIndices<N - N/2>::type>::type type;
+        };
+        template <> struct MakeIndices<0> { typedef Indices<> type; };
+        template <> struct MakeIndices<1> { typedef Indices<0> type; };
+
+
+        /* The bit reversal permutation of N points
+         */
+        template <unsigned N, class Seq = typename MakeIndices<N>::type>
+        struct BitReverses;
+        template <unsigned N, unsigned... I>
+        struct BitReverses< N, Indices<I...> >
+        {
+            static constexpr unsigned table[N] =
+                { reverse_bits(I, log_two(N))... };
+        };
+
+        /* Twiddles for a radix-4 pass of length L, laid out as radix4_pass
+         * expects
+         */
+        template <unsigned L, class Seq = typename MakeIndices<L/4>::type>
+        struct PassTwiddles;
+        template <unsigned L, unsigned... J>
+        struct PassTwiddles< L, Indices<J...> >
+        {
+            static constexpr SAMPLE table[6*(L/4)] = {
+                twiddle_real(J, L)..., twiddle_imag(J, L)...,
+                twiddle_real(2*J, L)..., twiddle_imag(2*J, L)...,
+                twiddle_real(3*J, L)..., twiddle_imag(3*J, L)... };
+        };
+
+        /* Twiddles w_N^k for k < N/2, to split a real transform
+         */
+        template <unsigned N, class Seq = typename MakeIndices<N/2>::type>
+        struct RealTwiddles;
+        template <unsigned N, unsigned... K>
+        struct RealTwiddles< N, Indices<K...> >
+        {
+            static constexpr SAMPLE real[N/2] = { twiddle_real(K, N)... };
+            static constexpr SAMPLE imag[N/2] = { twiddle_imag(K, N)... };
+        };
+
+
+        /* The butterfly passes, on split arrays of n points in bit reversed
+         * order. A radix-4 pass of the given length reads its twiddles as
+         * six arrays of length/4: the real then imaginary parts of w^j, w^2j
+         * and w^3j. The inverse pass conjugates them as it goes.
+         */
+        inline void radix2_pass(SAMPLE* real, SAMPLE* imag, unsigned n);
+        template <bool Inverse>
+        inline void radix4_pass(SAMPLE* real, SAMPLE* imag, unsigned n,
+                unsigned length, const SAMPLE* twiddles);
+
+        /* Runs the radix-4 passes from length L up to N
+         */
+        template <unsigned N, unsigned L, bool Inverse, bool Done = (L > N)>
+        struct Passes
+        {
+            static void run(SAMPLE* real, SAMPLE* imag);
+        };
+        template <unsigned N, unsigned L, bool Inverse>
+        struct Passes<N, L, Inverse, true>
+        {
+            static void run(SAMPLE*, SAMPLE*) {}
+        };
+    }
+}
+
+#include "fixed_fft.cpp"
+
+#endif
@@ -5,21 +5,35 @@
 using namespace ClickTrack;
 
 
-FMSynth::FMSynth(int num_voices)
+FMSynth::FMSynth(int num_voices, VoiceBackend backend)
     : PolyphonicInstrument(num_voices), 
       filter(SecondOrderFilter::LOWPASS, 20000),
       lfo(Oscillator::Sine, 5),
-      volume(-10)
+      volume(-10),
+      voices(),
+      bank(nullptr)
 {
-    // Initialize our voices
+    // Initialize our voices. In the bank, the first oscillator is the carrier
     std::vector<PolyphonicVoice*> temp;
-    for(unsigned i = 0; i < num_voices; i++)
+    if(backend == VOICE_BANK)
     {
-        FMSynthVoice* voice = new FMSynthVoice(this);
-        voices.push_back(voice);
-        temp.push_back(voice);
+        bank = new VoiceBank(num_voices);
+        bank->set_routing(VoiceBank::FM);
+        bank->set_lfo_input(lfo.get_output_channel());
+        for(unsigned i = 0; i < num_voices; i++)
+            temp.push_back(new BankVoice(this, bank, i));
+        add_voices(temp, bank->get_output_channel());
+    }
+    else
+    {
+        for(unsigned i = 0; i < num_voices; i++)
+        {
+            FMSynthVoice* voice = new FMSynthVoice(this);
+            voices.push_back(voice);
+            temp.push_back(voice);
+        }
+        add_voices(temp);
     }
-    add_voices(temp);
 
     // Configure our signal chain
     filter.set_input_channel(PolyphonicInstrument::get_output_channel());
@@ -33,6 +47,12 @@ FMSynth::FMSynth(int num_voices)
 }
 
 
+FMSynth::~FMSynth()
+{
+    delete bank;
+}
+
+
 AudioChannel* FMSynth::get_output_channel()
 {
     return volume.get_output_channel();
@@ -49,6 +69,8 @@ void FMSynth::set_carrier_mode(Oscillator::Mode mode)
 {
     for(auto voice : voices)
         voice->carrier.set_mode(mode);
+    if(bank != nullptr)
+        bank->set_mode(0, mode);
 }
 
 
@@ -56,6 +78,24 @@ void FMSynth::set_modulator_mode(Oscillator::Mode mode)
 {
     for(auto voice : voices)
         voice->modulator.set_mode(mode);
+    if(bank != nullptr)
+        bank->set_mode(1, mode);
+}
+
+void FMSynth::set_carrier_wavetable(std::shared_ptr<const Wavetable> table)
+{
+    for(auto voice : voices)
+        voice->carrier.set_wavetable(table);
+    if(bank != nullptr)
+        bank->set_wavetable(0, table);
+}
+
+void FMSynth::set_modulator_wavetable(std::shared_ptr<const Wavetable> table)
+{
+    for(auto voice : voices)
+        voice->modulator.set_wavetable(table);
+    if(bank != nullptr)
+        bank->set_wavetable(1, table);
 }
 
 
@@ -63,6 +103,8 @@ void FMSynth::set_carrier_transposition(float steps)
 {
     for(auto voice : voices)
         voice->carrier.set_transposition(steps);
+    if(bank != nullptr)
+        bank->set_transposition(0, steps);
 }
 
 
@@ -70,6 +112,8 @@ void FMSynth::set_modulator_transposition(float steps)
 {
     for(auto voice : voices)
         voice->modulator.set_transposition(steps);
+    if(bank != nullptr)
+        bank->set_transposition(1, steps);
 }
 
 
@@ -77,6 +121,8 @@ void FMSynth::set_modulator_intensity(float intensity)
 {
     for(auto voice : voices)
         voice->carrier.set_modulator_intensity(intensity);
+    if(bank != nullptr)
+        bank->set_modulator_intensity(intensity);
 }
 
 
@@ -84,6 +130,8 @@ void FMSynth::set_attack_time(float attack_time)
 {
     for(auto voice : voices)
         voice->adsr.set_attack_time(attack_time);
+    if(bank != nullptr)
+        bank->set_attack_time(attack_time);
 }
 
 
@@ -91,6 +139,8 @@ void FMSynth::set_decay_time(float decay_time)
 {
     for(auto voice : voices)
         voice->adsr.set_decay_time(decay_time);
+    if(bank != nullptr)
+        bank->set_decay_time(decay_time);
 }
 
 
@@ -98,6 +148,8 @@ void FMSynth::set_sustain_level(float sustain_level)
 {
     for(auto voice : voices)
         voice->adsr.set_sustain_level(sustain_level);
+    if(bank != nullptr)
+        bank->set_sustain_level(sustain_level);
 }
 
 
@@ -105,6 +157,8 @@ void FMSynth::set_release_time(float release_time)
 {
     for(auto voice : voices)
         voice->adsr.set_release_time(release_time);
+    if(bank != nullptr)
+        bank->set_release_time(release_time);
 }
 
 
@@ -112,6 +166,8 @@ void FMSynth::set_lfo_vibrato(float steps)
 {
     for(auto voice : voices)
         voice->carrier.set_lfo_intensity(steps);
+    if(bank != nullptr)
+        bank->set_lfo_intensity(0, steps);
 }
 
 
@@ -144,7 +200,7 @@ AudioChannel* FMSynthVoice::get_output_channel()
 void FMSynthVoice::handle_note_down(float velocity)
 {
     // Set velocity gain
-    adsr.set_gain(pow(velocity,0.5));
+    adsr.set_gain(midiVelocityToGain(velocity));
 
     // Trigger frequency and ADSR change
     carrier.set_freq(freq*pitch_multiplier);
@@ -164,3 +220,23 @@ void FMSynthVoice::handle_pitch_wheel(float value)
     carrier.set_freq(freq*pitch_multiplier);
     modulator.set_freq(freq*pitch_multiplier);
 }
+
+
+float FMSynthVoice::get_level()
+{
+    return adsr.get_level();
+}
+
+
+bool FMSynthVoice::is_idle()
+{
+    return !playing && adsr.is_silent();
+}
+
+
+void FMSynthVoice::get_voice_chain(std::vector<AudioGenerator*>& chain)
+{
+    chain.push_back(&carrier);
+    chain.push_back(&modulator);
+    chain.push_back(&adsr);
+}
@@ -6,6 +6,7 @@
 #include "oscillator.h"
 #include "polyphonic_instrument.h"
 #include "second_order_filter.h"
+#include "voice_bank.h"
 
 
 namespace ClickTrack
@@ -16,10 +17,11 @@ namespace ClickTrack
     class FMSynth : public PolyphonicInstrument
     {
         public:
-            /* Constructor/destructor. Takes in how many voices to use, as
-             * well as the MIDI channel
+            /* Constructor/destructor. Takes in how many voices to use, and
+             * how to render them
              */
-            FMSynth(int voices=1);
+            FMSynth(int voices=1, VoiceBackend backend=OBJECT_VOICES);
+            ~FMSynth();
 
             /* Override because we have added more signal chain
              */
@@ -35,6 +37,11 @@ namespace ClickTrack
             void set_carrier_mode(Oscillator::Mode mode);
             void set_modulator_mode(Oscillator::Mode mode);
 
+            /* Wavetables played by each oscillator in Table mode
+             */
+            void set_carrier_wavetable(std::shared_ptr<const Wavetable> table);
+            void set_modulator_wavetable(std::shared_ptr<const Wavetable> table);
+
             /* Transposition selection for each oscillator - transpose in
              * arbitrary step intervals
              */
@@ -73,6 +80,10 @@ namespace ClickTrack
             /* Our list of voices so we may set their parameters
              */
             std::vector<FMSynthVoice*> voices;
+
+            /* Renders all our voices instead when using the voice bank
+             */
+            VoiceBank* bank;
     };
 
 
@@ -95,7 +106,15 @@ namespace ClickTrack
             void handle_note_up();
             void handle_pitch_wheel(float value);
 
+            /* Report the envelope, so quiet voices can be stolen first and
+             * silent voices can sleep
+             */
+            float get_level();
+            bool is_idle();
+
         protected:
+            void get_voice_chain(std::vector<AudioGenerator*>& chain);
+
             /* Define our signal chain
              */
             Oscillator carrier, modulator;
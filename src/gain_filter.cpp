@@ -17,6 +17,7 @@ void GainFilter::set_gain(float in_gain)
 void GainFilter::set_lfo_input(AudioChannel* input)
 {
     lfo = input;
+    mark_graph_changed();
 }
 
 void GainFilter::set_lfo_intensity(float db)
@@ -24,16 +25,32 @@ void GainFilter::set_lfo_intensity(float db)
     lfo_intensity = db;
 }
 
-void GainFilter::filter(std::vector<SAMPLE>& input,
-        std::vector<SAMPLE>& output, unsigned long t)
+void GainFilter::get_side_channels(std::vector<AudioChannel*>& channels)
 {
-    for(int i = 0; i < input.size(); i++)
+    if(lfo != nullptr)
+        channels.push_back(lfo);
+}
+
+void GainFilter::filter_block(std::vector<const SAMPLE*>& inputs,
+        std::vector<SAMPLE*>& outputs, unsigned long t)
+{
+    // Without an LFO, this is a constant gain
+    if(lfo == nullptr)
     {
-        // Use the LFO if set
-        float m = 1.0;
-        if(lfo != nullptr)
-            m *= pow(10, lfo->get_sample(t) * lfo_intensity/10);
+        for(unsigned i = 0; i < inputs.size(); i++)
+        {
+            for(unsigned j = 0; j < BUFFER_SIZE; j++)
+                outputs[i][j] = gain*inputs[i][j];
+        }
+        return;
+    }
 
-        output[i] = gain*m*input[i];
+    // Otherwise compute the gain for each time step once, for all channels
+    const SAMPLE* lfo_block = lfo->get_block(t);
+    for(unsigned j = 0; j < BUFFER_SIZE; j++)
+    {
+        float m = gain*pow(10, lfo_block[j] * lfo_intensity/10);
+        for(unsigned i = 0; i < inputs.size(); i++)
+            outputs[i][j] = m*inputs[i][j];
     }
 }
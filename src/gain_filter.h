@@ -26,8 +26,9 @@ namespace ClickTrack
             void set_lfo_intensity(float db);
 
         private:
-            void filter(std::vector<SAMPLE>& input,
-                    std::vector<SAMPLE>& output, unsigned long t);
+            void filter_block(std::vector<const SAMPLE*>& inputs,
+                    std::vector<SAMPLE*>& outputs, unsigned long t);
+            void get_side_channels(std::vector<AudioChannel*>& channels);
 
             float gain;
 
@@ -98,7 +98,7 @@ void GenericInstrument::process_events(std::vector<MidiMessage>& inputs,
                 std::cout << "Unknown messsage: 0x";
                 std::cout << std::hex << std::setfill('0') << std::setw(2) << 
                     (unsigned) input.type << (unsigned) input.channel;
-                for(int i=0; i < input.message.size(); i++)
+                for(int i=0; i < input.length; i++)
                     std::cout << std::hex << std::setfill('0') << std::setw(2) << 
                         (unsigned) input.message[i];
                 std::cout << std::endl;
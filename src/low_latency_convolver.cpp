@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <chrono>
+#include "low_latency_convolver.h"
+#include "trace.h"
+#include "vector_ops.h"
+
+using namespace ClickTrack;
+
+
+/* Where each uniformly partitioned segment starts. Foreground segments must
+ * start one partition in, and background segments two partitions in. Each
+ * segment ends where the next begins.
+ */
+struct StageLayout
+{
+    unsigned partition_size;
+    unsigned start;
+    bool background;
+};
+static const StageLayout STAGE_LAYOUT[] = {
+    {64,   64,   false},
+    {256,  256,  false},
+    {1024, 2048, true},
+    {4096, 8192, true}
+};
+static const unsigned NUM_STAGES = sizeof(STAGE_LAYOUT)/sizeof(StageLayout);
+
+
+LowLatencyConvolver::Stage::Stage(unsigned in_partition_size,
+        const SAMPLE* impulse, unsigned impulse_length, bool in_background)
+    : convolver(in_partition_size, impulse, impulse_length),
+      partition_size(in_partition_size), background(in_background),
+      input(partition_size, 0.0), output(partition_size, 0.0),
+      job_input(background ? partition_size : 0, 0.0),
+      job_output(background ? partition_size : 0, 0.0),
+      job_pending(false)
+{}
+
+
+LowLatencyConvolver::LowLatencyConvolver(const SAMPLE* impulse,
+        unsigned impulse_length)
+    : head_taps(HEAD_SIZE, 0.0), head_input(2*HEAD_SIZE-1, 0.0),
+      stages(), time(0), missed_deadlines(0),
+      worker(nullptr), worker_mutex(), worker_wake(), running(true)
+{
+    for(unsigned i = 0; i < HEAD_SIZE && i < impulse_length; i++)
+        head_taps[HEAD_SIZE-1-i] = impulse[i];
+
+    // Only build the segments the impulse response reaches
+    bool any_background = false;
+    for(unsigned i = 0; i < NUM_STAGES; i++)
+    {
+        const StageLayout& layout = STAGE_LAYOUT[i];
+        if(layout.start >= impulse_length)
+            break;
+
+        unsigned end = impulse_length;
+        if(i+1 < NUM_STAGES)
+            end = std::min(end, STAGE_LAYOUT[i+1].start);
+
+        stages.push_back(new Stage(layout.partition_size,
+                    impulse + layout.start, end - layout.start,
+                    layout.background));
+        any_background |= layout.background;
+    }
+
+    if(any_background)
+        worker = new std::thread(&LowLatencyConvolver::worker_loop, this);
+}
+
+
+LowLatencyConvolver::~LowLatencyConvolver()
+{
+    if(worker != nullptr)
+    {
+        running.store(false);
+        worker_wake.notify_one();
+        worker->join();
+        delete worker;
+    }
+
+    for(auto stage : stages)
+        delete stage;
+}
+
+
+void LowLatencyConvolver::process(const SAMPLE* input, SAMPLE* output)
+{
+    // Run the head directly, sliding the history along first
+    std::copy(head_input.begin() + HEAD_SIZE, head_input.end(),
+            head_input.begin());
+    std::copy(input, input + HEAD_SIZE, head_input.begin() + HEAD_SIZE-1);
+    for(unsigned i = 0; i < HEAD_SIZE; i++)
+        output[i] = dot_product(&head_taps[0], &head_input[i], HEAD_SIZE);
+
+    // Add in each segment, and buffer up the input for its next partition
+    for(auto stage : stages)
+    {
+        unsigned offset = time % stage->partition_size;
+        if(offset == 0)
+            start_partition(*stage);
+
+        for(unsigned i = 0; i < HEAD_SIZE; i++)
+            output[i] += stage->output[offset + i];
+        std::copy(input, input + HEAD_SIZE, stage->input.begin() + offset);
+    }
+
+    time += HEAD_SIZE;
+}
+
+
+unsigned LowLatencyConvolver::get_block_size()
+{
+    return HEAD_SIZE;
+}
+
+
+unsigned long LowLatencyConvolver::get_missed_deadlines()
+{
+    return missed_deadlines.load();
+}
+
+
+void LowLatencyConvolver::start_partition(Stage& stage)
+{
+    // Foreground stages are cheap enough to run right away
+    if(!stage.background)
+    {
+        TRACE_BEGIN("convolver partition", stage.partition_size);
+        stage.convolver.process(&stage.input[0], &stage.output[0]);
+        TRACE_END("convolver partition", stage.partition_size);
+        return;
+    }
+
+    // Collect the job handed off last partition, waiting if we must
+    if(stage.job_pending.load(std::memory_order_acquire))
+    {
+        missed_deadlines.fetch_add(1, std::memory_order_relaxed);
+        TRACE_INSTANT("convolver missed deadline", stage.partition_size);
+        while(stage.job_pending.load(std::memory_order_acquire))
+            std::this_thread::yield();
+    }
+    stage.output.swap(stage.job_output);
+
+    // Hand off the input we just buffered
+    stage.job_input.swap(stage.input);
+    stage.job_pending.store(true, std::memory_order_release);
+    worker_wake.notify_one();
+}
+
+
+void LowLatencyConvolver::worker_loop()
+{
+    // The audio thread never takes the lock, so a wakeup can slip past us
+    // while we check for work. Waking up periodically bounds the delay.
+    const std::chrono::milliseconds poll_interval(1);
+    TRACE_THREAD_NAME("convolver worker");
+
+    while(running.load(std::memory_order_relaxed))
+    {
+        bool worked = false;
+        for(auto stage : stages)
+        {
+            if(stage->background &&
+                    stage->job_pending.load(std::memory_order_acquire))
+            {
+                TRACE_BEGIN("convolver partition", stage->partition_size);
+                stage->convolver.process(&stage->job_input[0],
+                        &stage->job_output[0]);
+                TRACE_END("convolver partition", stage->partition_size);
+                stage->job_pending.store(false, std::memory_order_release);
+                worked = true;
+            }
+        }
+
+        if(!worked)
+        {
+            std::unique_lock<std::mutex> lock(worker_mutex);
+            worker_wake.wait_for(lock, poll_interval);
+        }
+    }
+}
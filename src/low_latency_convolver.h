@@ -0,0 +1,106 @@
+#ifndef LOW_LATENCY_CONVOLVER_H
+#define LOW_LATENCY_CONVOLVER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "convolver.h"
+#include "uniform_convolver.h"
+
+
+namespace ClickTrack
+{
+    /* The LowLatencyConvolver computes a zero latency convolution with short
+     * blocks, while keeping the cost of long impulse responses down.
+     *
+     * The head of the impulse response is run as a direct form FIR filter,
+     * so output never waits on a transform. The rest is cut into segments
+     * with growing partition sizes, each run by a UniformConvolver:
+     *
+     *      [0, 64)         direct FIR
+     *      [64, 256)       64 sample partitions
+     *      [256, 2048)     256 sample partitions
+     *      [2048, 8192)    1024 sample partitions, in the background
+     *      [8192, ...)     4096 sample partitions, in the background
+     *
+     * A segment starting at least one partition in only needs input from
+     * earlier partitions, so it can be computed as soon as the last one
+     * finishes. Segments starting two partitions in get a whole partition of
+     * slack, so they are handed off to a background thread and collected one
+     * partition later. This spreads the cost of the large transforms out
+     * instead of spiking every few blocks.
+     *
+     * If a background job has not finished by the time its output is due,
+     * the audio thread waits for it and counts a missed deadline.
+     */
+    class LowLatencyConvolver : public Convolver
+    {
+        public:
+            LowLatencyConvolver(const SAMPLE* impulse,
+                    unsigned impulse_length);
+            ~LowLatencyConvolver();
+
+            /* Blocks are the length of the direct FIR head
+             */
+            void process(const SAMPLE* input, SAMPLE* output);
+            unsigned get_block_size();
+
+            /* Returns how many times a background job was late
+             */
+            unsigned long get_missed_deadlines();
+
+            static const unsigned HEAD_SIZE = 64;
+
+        private:
+            /* One uniformly partitioned segment of the impulse response. Its
+             * output for the current partition is computed from input up to
+             * the previous partition, which is buffered as it arrives.
+             *
+             * Background stages double buffer their job. At each partition
+             * boundary the audio thread collects the finished output, then
+             * hands the worker the input it just buffered.
+             */
+            struct Stage
+            {
+                Stage(unsigned partition_size, const SAMPLE* impulse,
+                        unsigned impulse_length, bool background);
+
+                UniformConvolver convolver;
+                const unsigned partition_size;
+                const bool background;
+
+                std::vector<SAMPLE> input;
+                std::vector<SAMPLE> output;
+
+                std::vector<SAMPLE> job_input;
+                std::vector<SAMPLE> job_output;
+                std::atomic<bool> job_pending;
+            };
+
+            /* Run the given stage's work at a partition boundary
+             */
+            void start_partition(Stage& stage);
+
+            /* Background thread waits for pending jobs, and runs them
+             */
+            void worker_loop();
+
+            // Direct FIR head. The taps are stored reversed, and the input
+            // keeps HEAD_SIZE-1 samples of history before the current block
+            std::vector<SAMPLE> head_taps;
+            std::vector<SAMPLE> head_input;
+
+            std::vector<Stage*> stages;
+            unsigned long time;
+            std::atomic<unsigned long> missed_deadlines;
+
+            std::thread* worker;
+            std::mutex worker_mutex;
+            std::condition_variable worker_wake;
+            std::atomic<bool> running;
+    };
+}
+
+#endif
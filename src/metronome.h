@@ -1,8 +1,10 @@
 #ifndef METRONOME_H
 #define METRONOME_H
 
+#include <memory>
 #include <string>
 #include "audio_generics.h"
+#include "sample_pool.h"
 #include "timing_manager.h"
 
 
@@ -20,22 +22,22 @@ namespace ClickTrack
                     const std::string& unaccented_sound);
 
         private:
-            void generate_outputs(std::vector<SAMPLE>& output, unsigned long t);
+            void generate_block(std::vector<SAMPLE*>& outputs, unsigned long t);
 
             /* We need a pointer to the global metronome
              */
             RhythmManager& rhythm_manager;
 
-            /* Load the click sounds into memory
+            /* The click sounds, shared through the sample pool
              */ 
-            std::vector<SAMPLE> downbeat;
-            std::vector<SAMPLE> accented;
-            std::vector<SAMPLE> unaccented;
+            std::shared_ptr<const Sample> downbeat;
+            std::shared_ptr<const Sample> accented;
+            std::shared_ptr<const Sample> unaccented;
 
             /* State for the current beat playing and sample index for it
              */
-            unsigned current_sample;
-            std::vector<SAMPLE>* current_beat;
+            unsigned long current_sample;
+            const Sample* current_beat;
     };
 }
 
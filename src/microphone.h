@@ -16,11 +16,8 @@ namespace ClickTrack
             Microphone(unsigned num_channels = 1, bool defaultDevice=true);
 
         private:
-            void generate_outputs(std::vector<SAMPLE>& output, unsigned long t);
+            void generate_block(std::vector<SAMPLE*>& outputs, unsigned long t);
 
-            /* Store our stream results
-             */
-            std::vector< std::vector<SAMPLE> > buffer;
             InputStream stream;
     };
 }
@@ -11,14 +11,23 @@ float ClickTrack::midiNoteToFreq(unsigned note)
 }
 
 
+float ClickTrack::midiVelocityToGain(float velocity)
+{
+    // TODO: change this curve
+    return pow(velocity,0.5);
+}
+
+
 
 
 MidiChannel::MidiChannel(MidiGenerator& in_parent, unsigned long start_t)
     : parent(in_parent), last_events(), next_time(start_t)
-{}
+{
+    last_events.reserve(MAX_EVENTS_PER_STEP);
+}
 
 
-std::vector<MidiMessage> MidiChannel::get_events(unsigned long t)
+const std::vector<MidiMessage>& MidiChannel::get_events(unsigned long t)
 {
     // If this block already fell out of the buffer, just return silence
     if(next_time > t+1)
@@ -48,7 +57,9 @@ void MidiChannel::push_events(std::vector<MidiMessage>& events)
 
 MidiGenerator::MidiGenerator()
     : output_channel(*this), output_frame()
-{}
+{
+    output_frame.reserve(MAX_EVENTS_PER_STEP);
+}
 
 
 MidiChannel* MidiGenerator::get_output_midi_channel()
@@ -71,7 +82,9 @@ void MidiGenerator::tick(unsigned long t)
 
 MidiConsumer::MidiConsumer()
     : input_channel(nullptr), input_frame()
-{}
+{
+    input_frame.reserve(MAX_EVENTS_PER_STEP);
+}
 
 
 void MidiConsumer::set_input_midi_channel(MidiChannel* channel)
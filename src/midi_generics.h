@@ -9,6 +9,10 @@ namespace ClickTrack
     /* The following message packet defines a standard MIDI protocol. A message
      * is broken into its message type, the channel it was sent to, and the
      * remaining (unprocessed) raw bytes of the message
+     *
+     * The raw bytes are stored inline, so messages are passed around the
+     * audio thread without allocating. Messages longer than MAX_LENGTH, such
+     * as most system exclusive dumps, cannot be represented.
      */
     enum MidiMessageType
     {
@@ -24,17 +28,32 @@ namespace ClickTrack
 
     struct MidiMessage
     {
+        static const unsigned MAX_LENGTH = 15;
+
         MidiMessageType type;
         unsigned char channel;
-        std::vector<unsigned char> message;
+        unsigned char length;
+        unsigned char message[MAX_LENGTH];
     };
 
 
+    /* Event buffers reserve room for this many events in one time step up
+     * front. Generators must not produce more, so the buffers never grow on
+     * the audio thread.
+     */
+    const unsigned MAX_EVENTS_PER_STEP = 64;
+
+
     /* Converts a MIDI note number to a frequency
      */
     float midiNoteToFreq(unsigned note);
 
 
+    /* Converts a MIDI velocity, from 0 to 1, to a note's gain in decibels
+     */
+    float midiVelocityToGain(float velocity);
+
+
     /* An output channel is the basic unit with which an object receives events.
      * It is contained within an MidiGenerator object, and serves to pipe events
      * from its parent generator into a buffer that a later element can access.
@@ -52,7 +71,7 @@ namespace ClickTrack
             /* Fills an incoming buffer with one block worth of audio data
              * beginning at the requested time.
              */
-            std::vector<MidiMessage> get_events(unsigned long t);
+            const std::vector<MidiMessage>& get_events(unsigned long t);
 
         private:
             /* A channel can only exist within an audio generator, so protect
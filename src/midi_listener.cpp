@@ -1,15 +1,17 @@
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <iomanip>
 #include "generic_instrument.h"
 #include "midi_listener.h"
+#include "trace.h"
 
 using namespace ClickTrack;
 namespace chr = std::chrono;
 
 
 MidiListener::MidiListener(TimingManager& in_timer, int channel)
-    : stream(), timer(in_timer), event_i(0), events()
+    : stream(), timer(in_timer), events(1024), last_event_time(0)
 {
     // If no channel specified, ask the user for a channel
     if(channel == -1)
@@ -43,15 +45,15 @@ MidiListener::MidiListener(TimingManager& in_timer, int channel)
 void MidiListener::generate_events(std::vector<MidiMessage>& outputs,
         unsigned long t)
 {
-    // Check for untriggered events at this time
-    while(!events.empty() && events.top().t <= t)
+    // Check for untriggered events at this time. Our outputs only have room
+    // for so many, so any more wait for the next time step
+    struct event_t event;
+    while(events.front() != nullptr && events.front()->t <= t &&
+            outputs.size() < MAX_EVENTS_PER_STEP)
     {
-        // Get the event
-        struct event_t event = events.top();
-        events.pop();
-        
-        // Push it to our outgoing events
-        outputs.push_back(event.m);
+        events.pop(event);
+        TRACE_INSTANT("midi event", event.t);
+        outputs.push_back(event.message);
     }
 }
 
@@ -66,17 +68,22 @@ void MidiListener::midi_callback(double deltaTime,
         return;
     }
 
-    // Break out the actual message
-    unsigned char first = in_message->at(0);
-    unsigned char type = first >> 4;
-    unsigned char channel = first & 0x0F;
-    in_message->erase(in_message->begin());
+    // Drop anything too long to fit in a queue slot
+    if(in_message->size() - 1 > MidiMessage::MAX_LENGTH)
+    {
+        std::cerr << "Ignoring MIDI message of " << in_message->size() <<
+            " bytes." << std::endl;
+        return;
+    }
 
-    // Package into a MidiMessage
-    MidiMessage message;
-    message.type = (MidiMessageType) type;
-    message.channel = channel;
-    message.message = *in_message;
+    // Break out the actual message
+    struct event_t event;
+    unsigned char status = in_message->at(0);
+    event.message.type = (MidiMessageType) (status >> 4);
+    event.message.channel = status & 0x0F;
+    event.message.length = in_message->size() - 1;
+    std::copy(in_message->begin() + 1, in_message->end(),
+            event.message.message);
 
 
     // Get the offset, delay by one frame, if we have received callback info
@@ -92,8 +99,21 @@ void MidiListener::midi_callback(double deltaTime,
         time = sync.sample_time + BUFFER_SIZE + delay;
     }
 
+    // Audio only runs at block boundaries, so an event in the middle of a
+    // block could not be heard until the next one anyway. Round up to it, so
+    // every event is due exactly when it takes effect
+    time = (time + BUFFER_SIZE-1) / BUFFER_SIZE * BUFFER_SIZE;
+
+
+    // Never schedule an event before one already queued, so that the queue
+    // stays in both arrival and time order
+    time = std::max(time, listener->last_event_time);
+    listener->last_event_time = time;
+    event.t = time;
 
-    // Package the message into an event and push it to the queue
-    listener->events.push( {listener->event_i, time, message} );
-    listener->event_i++;
+    // Push it to the queue, marking when it arrived and when it's due
+    TRACE_THREAD_NAME("midi");
+    TRACE_INSTANT("midi in", time);
+    if(!listener->events.push(event))
+        std::cerr << "MIDI queue full, dropping message." << std::endl;
 }
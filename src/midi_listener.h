@@ -2,9 +2,9 @@
 #define MIDI_WRAPPER_H
 
 #include <chrono>
-#include <queue>
 #include <rtmidi.h>
 #include "midi_generics.h"
+#include "spsc_ringbuffer.h"
 #include "timing_manager.h"
 
 
@@ -37,6 +37,10 @@ namespace ClickTrack
             /* Callback for registering with the input stream
              * Parses the MIDI message and passes on its message to the
              * specified destination.
+             *
+             * Events are scheduled at the first block boundary at or after
+             * their arrival, as audio is only rendered a block at a time.
+             * This quantizes MIDI timing to BUFFER_SIZE samples.
              */
             static void midi_callback(double deltaTime,
                     std::vector<unsigned char>* message, void* in_listener);
@@ -46,25 +50,23 @@ namespace ClickTrack
             RtMidiIn stream;
             TimingManager& timer;
 
-            /* Internally, we map sample timestamps to their time, function,
-             * and payload to be triggered. Events are ordered by their time and
-             * stored in a priority queue. Attach an index to ensure first in
-             * first out ordering
+            /* Events are handed from RtMidi's thread to the audio thread
+             * through a lock-free queue, already unpacked into a MidiMessage
+             * and tagged with the time they are due. Messages too long for a
+             * MidiMessage are dropped.
+             *
+             * Timestamps are kept non-decreasing as they are pushed, so the
+             * queue is already in time order and the audio thread only ever
+             * looks at its front.
              */
-            unsigned event_i;
-            struct event_t { unsigned i; unsigned long t; MidiMessage m; };
-            struct event_t_comp
-            { 
-                bool operator()(const struct event_t e1, const struct event_t e2)
-                {
-                    if(e1.t == e2.t)
-                        return e1.i > e2.i;
-                    return e1.t > e2.t;
-                }
+            struct event_t
+            {
+                unsigned long t;
+                MidiMessage message;
             };
 
-            std::priority_queue<struct event_t, std::vector<struct event_t>,
-                struct event_t_comp> events;
+            SpscRingBuffer<struct event_t> events;
+            unsigned long last_event_time;
     };
 }
 
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cmath>
 #include "wav_reader.h"
 #include "moorer_reverb.h"
@@ -9,8 +10,9 @@ MoorerReverb::MoorerReverb(Room in_room, float in_rev_time, float in_gain,
         float in_wetness, unsigned num_channels)
     : AudioFilter(num_channels, num_channels), room(in_room), 
       rev_time(in_rev_time), gain(pow(10,in_gain/10)), wetness(in_wetness),
-      tapped_delay_lines(), comb_delay_lines(), tapped_delay_line_outputs(), 
-      comb_outputs()
+      tapped_delay_lines(), comb_delay_lines(),
+      zeros(BUFFER_SIZE, 0.0), tapped_out(BUFFER_SIZE),
+      comb_out(BUFFER_SIZE), comb_delayed(BUFFER_SIZE)
 {
     // Get room parameters 
     switch(room)
@@ -28,11 +30,6 @@ MoorerReverb::MoorerReverb(Room in_room, float in_rev_time, float in_gain,
             break;
     }
 
-    // Set output delays so last FIR exit corresponds to first exit from the
-    // comb filter. Set lowest to one to avoid breaking
-    tapped_out_delay = 0;
-    comb_out_delay = tapped_delays.back();
-
     // Set the comb filter gains
     set_comb_filter_gains();
 
@@ -74,72 +71,84 @@ void MoorerReverb::set_comb_filter_gains()
 
 void MoorerReverb::allocate_ringbuffers()
 {
-    // Allocated ringbuffers and pad them with zeros
+    // Allocated ringbuffers and pad them with zeros. Each needs room for its
+    // delay, plus the block being written.
+    std::vector<SAMPLE> padding(std::max(tapped_delays.back(),
+                *std::max_element(comb_delays.begin(), comb_delays.end())),
+            0.0);
     for(unsigned i = 0; i < get_num_input_channels(); i++)
     {
-        // Tapped delay line out - one more element than the largest delay
-        // Then pad out the buffer
-        tapped_delay_lines.push_back(RingBuffer<SAMPLE>(tapped_delays.back()+1));
-        while(tapped_delay_lines[i].get_highest_timestamp() < tapped_delays.back())
-            tapped_delay_lines[i].add(0.0);
-
-        // Comb delays - each one needs one more than the delay of that filter
-        comb_delay_lines.push_back(std::vector< RingBuffer<SAMPLE> >());
+        // Tapped delay line out
+        tapped_delay_lines.push_back(MaskedRingBuffer<SAMPLE>(
+                    tapped_delays.back() + BUFFER_SIZE));
+        tapped_delay_lines[i].write_block(padding.data(),
+                tapped_delays.back());
+
+        // Comb delays
+        comb_delay_lines.push_back(std::vector< MaskedRingBuffer<SAMPLE> >());
         for(unsigned j = 0; j < comb_delays.size(); j++)
         {
-            comb_delay_lines[i].push_back(RingBuffer<SAMPLE>(comb_delays[j]+1));
-            while(comb_delay_lines[i][j].get_highest_timestamp() < comb_delays[j])
-                comb_delay_lines[i][j].add(0.0);
+            comb_delay_lines[i].push_back(MaskedRingBuffer<SAMPLE>(
+                        comb_delays[j] + BUFFER_SIZE));
+            comb_delay_lines[i][j].write_block(padding.data(),
+                    comb_delays[j]);
         }
-
-        // Outputs - each one needs one more than its delay
-        tapped_delay_line_outputs.push_back(RingBuffer<SAMPLE>(tapped_out_delay+1));
-        while(tapped_delay_line_outputs[i].get_highest_timestamp() < tapped_out_delay)
-            tapped_delay_line_outputs[i].add(0.0);
-
-        comb_outputs.push_back(RingBuffer<SAMPLE>(comb_out_delay+1));
-        while(comb_outputs[i].get_highest_timestamp() < tapped_out_delay)
-            comb_outputs[i].add(0.0);
     }
 }
 
 
-void MoorerReverb::filter(std::vector<SAMPLE>& input,
-        std::vector<SAMPLE>& output, unsigned long t) 
+void MoorerReverb::filter_block(std::vector<const SAMPLE*>& inputs,
+        std::vector<SAMPLE*>& outputs, unsigned long t)
 {
-    for(unsigned i = 0; i < input.size(); i++)
+    const unsigned chunk = std::min(BUFFER_SIZE,
+            *std::min_element(comb_delays.begin(), comb_delays.end()));
+
+    for(unsigned i = 0; i < inputs.size(); i++)
     {
-        // First perform tapped delay line
-        RingBuffer<SAMPLE>& tapped_delay_line = tapped_delay_lines[i];
-        tapped_delay_line.add(0.0);
+        const SAMPLE* in = inputs[i];
+
+        // First perform tapped delay line. Spread the whole block across the
+        // taps, then read back what has arrived at the output
+        MaskedRingBuffer<SAMPLE>& tapped_delay_line = tapped_delay_lines[i];
+        tapped_delay_line.write_block(zeros.data(), BUFFER_SIZE);
 
-        SAMPLE in = input[i];
         for(unsigned j = 0; j < tapped_delays.size(); j++)
         {
-            tapped_delay_line[t + tapped_delays[j]] += 
-                tapped_gains[j] * in;
+            tapped_delay_line.add_block(t + tapped_delays[j], in,
+                    BUFFER_SIZE, tapped_gains[j]);
         }
-        SAMPLE tapped_out = (in + tapped_delay_line[t])/tapped_delays.size();
 
-        tapped_delay_line_outputs[i].add(tapped_out);
+        tapped_delay_line.read_block(t, tapped_out.data(), BUFFER_SIZE);
+        for(unsigned k = 0; k < BUFFER_SIZE; k++)
+            tapped_out[k] = (in[k] + tapped_out[k])/tapped_delays.size();
 
         // Then perform comb filters
-        SAMPLE comb_out = 0.0;
+        std::fill(comb_out.begin(), comb_out.end(), 0.0);
         for(unsigned j = 0; j < comb_delays.size(); j++)
         {
-            RingBuffer<SAMPLE>& buf = comb_delay_lines[i][j];
-            buf.add(0.0);
-
-            SAMPLE comb_in = tapped_out + comb_gains[j]*buf[t];
-            buf[t + comb_delays[j]] += comb_in;
-
-            comb_out += buf[t];
+            MaskedRingBuffer<SAMPLE>& buf = comb_delay_lines[i][j];
+            for(unsigned offset = 0; offset < BUFFER_SIZE; offset += chunk)
+            {
+                unsigned n = std::min(chunk, BUFFER_SIZE - offset);
+                unsigned long now = t + offset;
+                buf.write_block(zeros.data(), n);
+
+                buf.read_block(now, comb_delayed.data(), n);
+                multiply_accumulate(comb_delayed.data(), 1.0,
+                        &comb_out[offset], n);
+
+                buf.add_block(now + comb_delays[j], &tapped_out[offset], n);
+                buf.add_block(now + comb_delays[j], comb_delayed.data(), n,
+                        comb_gains[j]);
+            }
         }
-        comb_out *= comb_out_gain/comb_delays.size();
-        comb_outputs[i].add(comb_out);
 
         // Combine the results
-        float rev_out = tapped_delay_line_outputs[i][t] + comb_outputs[i][t];
-        output[i] = gain * (wetness*(rev_out) + (1.0-wetness)*input[i]);
+        float comb_scale = comb_out_gain/comb_delays.size();
+        for(unsigned k = 0; k < BUFFER_SIZE; k++)
+        {
+            float rev_out = tapped_out[k] + comb_scale*comb_out[k];
+            outputs[i][k] = gain * (wetness*(rev_out) + (1.0-wetness)*in[k]);
+        }
     }
 }
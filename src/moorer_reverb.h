@@ -42,10 +42,11 @@ namespace ClickTrack
             void set_comb_filter_gains();
             void allocate_ringbuffers();
 
-            /* The filter function 
+            /* The filter function. Works on whole blocks, except for the comb
+             * filters which run in chunks no longer than their shortest delay.
              */
-            void filter(std::vector<SAMPLE>& input,
-                    std::vector<SAMPLE>& output, unsigned long t);
+            void filter_block(std::vector<const SAMPLE*>& inputs,
+                    std::vector<SAMPLE*>& outputs, unsigned long t);
 
             /* Filter parameters
              */
@@ -60,7 +61,7 @@ namespace ClickTrack
              * tapped_delay_lines is a vector of ringbuffers, one for each
              * output channel
              */
-            std::vector< RingBuffer<SAMPLE> > tapped_delay_lines;
+            std::vector< MaskedRingBuffer<SAMPLE> > tapped_delay_lines;
             std::vector<unsigned> tapped_delays;
             std::vector<float>    tapped_gains;
 
@@ -70,20 +71,20 @@ namespace ClickTrack
              * vector is for each channel, the inner vector is for each comb
              * filter
              */
-            std::vector< std::vector< RingBuffer<SAMPLE> > > comb_delay_lines;
+            std::vector< std::vector< MaskedRingBuffer<SAMPLE> > >
+                comb_delay_lines;
             std::vector<unsigned> comb_delays;
             std::vector<float>    comb_gains;
 
             /* Combination parameters
-             *
-             * The output buffers are vectors of ringbuffers, one for each
-             * output channel
              */
-            std::vector< RingBuffer<SAMPLE> > tapped_delay_line_outputs;
-            std::vector< RingBuffer<SAMPLE> > comb_outputs;
-            unsigned tapped_out_delay;
-            unsigned comb_out_delay;
-            float    comb_out_gain;
+            float comb_out_gain;
+
+            // Preallocate buffers for speed
+            std::vector<SAMPLE> zeros;
+            std::vector<SAMPLE> tapped_out;
+            std::vector<SAMPLE> comb_out;
+            std::vector<SAMPLE> comb_delayed;
     };
 }
 
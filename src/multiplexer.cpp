@@ -1,3 +1,4 @@
+#include <algorithm>
 #include "multiplexer.h"
 
 using namespace ClickTrack;
@@ -12,8 +13,8 @@ void Multiplexer::select_channel(unsigned in_channel)
     channel = in_channel;
 }
 
-void Multiplexer::filter(std::vector<SAMPLE>& input,
-        std::vector<SAMPLE>& output, unsigned long t)
+void Multiplexer::filter_block(std::vector<const SAMPLE*>& inputs,
+        std::vector<SAMPLE*>& outputs, unsigned long t)
 {
-    output[0] = input[channel];
+    std::copy(inputs[channel], inputs[channel] + BUFFER_SIZE, outputs[0]);
 }
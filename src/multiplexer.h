@@ -21,8 +21,8 @@ namespace ClickTrack
             void select_channel(unsigned channel);
 
         private:
-            void filter(std::vector<SAMPLE>& input,
-                    std::vector<SAMPLE>& output, unsigned long t);
+            void filter_block(std::vector<const SAMPLE*>& inputs,
+                    std::vector<SAMPLE*>& outputs, unsigned long t);
             
             unsigned channel;
     };
@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include "offline_renderer.h"
+
+using namespace ClickTrack;
+
+
+OfflineRenderer::OfflineRenderer(TimingManager& in_timer)
+    : timer(in_timer),
+      stop_samples(std::numeric_limits<unsigned long>::max()),
+      max_samples(std::numeric_limits<unsigned long>::max()),
+      conditions(),
+      tails()
+{}
+
+
+void OfflineRenderer::stop_after(unsigned long num_samples)
+{
+    stop_samples = num_samples;
+}
+
+
+void OfflineRenderer::stop_when(bool (*condition)(void*), void* arg)
+{
+    conditions.push_back({condition, arg});
+}
+
+
+void OfflineRenderer::stop_when_done(WavReader& reader)
+{
+    stop_when([](void* arg) { return ((WavReader*) arg)->is_done(); },
+            &reader);
+}
+
+
+void OfflineRenderer::wait_for_tail(AudioChannel* channel, float threshold_db,
+        float hold_seconds)
+{
+    SAMPLE threshold = pow(10, threshold_db/20);
+    unsigned long hold_samples = hold_seconds*SAMPLE_RATE;
+    tails.push_back({channel, threshold, hold_samples, 0});
+}
+
+
+void OfflineRenderer::set_max_samples(unsigned long num_samples)
+{
+    max_samples = num_samples;
+}
+
+
+OfflineRenderer::Report OfflineRenderer::render()
+{
+    auto start = std::chrono::steady_clock::now();
+
+    // Start on a block boundary, so every block is rendered whole
+    while(timer.get_current_time() % BUFFER_SIZE != 0)
+        timer.tick();
+
+    const unsigned long first = timer.get_current_time();
+    unsigned long rendered = 0;
+    bool stopping = false;
+    for(auto& tail : tails)
+        tail.quiet_samples = 0;
+
+    while(rendered < max_samples)
+    {
+        // Once stopping, we're done when every tail has been quiet long
+        // enough
+        if(!stopping)
+            stopping = should_stop(rendered);
+        if(stopping)
+        {
+            bool ringing = false;
+            for(auto& tail : tails)
+                ringing |= tail.quiet_samples < tail.hold_samples;
+            if(!ringing)
+                break;
+        }
+
+        // Render one block, then check the tails
+        for(unsigned i = 0; i < BUFFER_SIZE; i++)
+            timer.tick();
+
+        for(auto& tail : tails)
+        {
+            if(block_peak(tail.channel, first + rendered) < tail.threshold)
+                tail.quiet_samples += BUFFER_SIZE;
+            else
+                tail.quiet_samples = 0;
+        }
+
+        rendered += BUFFER_SIZE;
+    }
+
+    // Build the report
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    Report report;
+    report.samples_rendered = rendered;
+    report.audio_seconds = (double) rendered / SAMPLE_RATE;
+    report.render_seconds = elapsed.count();
+    report.realtime_factor = report.audio_seconds / report.render_seconds;
+    return report;
+}
+
+
+bool OfflineRenderer::should_stop(unsigned long t)
+{
+    if(t >= stop_samples)
+        return true;
+
+    for(auto& condition : conditions)
+        if(condition.condition(condition.arg))
+            return true;
+
+    return false;
+}
+
+
+SAMPLE OfflineRenderer::block_peak(AudioChannel* channel, unsigned long t)
+{
+    const SAMPLE* block = channel->get_block(t);
+
+    SAMPLE peak = 0.0;
+    for(unsigned i = 0; i < BUFFER_SIZE; i++)
+        peak = std::max(peak, std::abs(block[i]));
+    return peak;
+}
@@ -0,0 +1,91 @@
+#ifndef OFFLINE_RENDERER_H
+#define OFFLINE_RENDERER_H
+
+#include <vector>
+#include "audio_generics.h"
+#include "timing_manager.h"
+#include "wav_reader.h"
+
+
+namespace ClickTrack
+{
+    /* The offline renderer runs a timing manager's signal chain with no sound
+     * device, as fast as the CPU allows, until a stop condition holds. Sinks
+     * such as a WavWriter still see whole blocks, exactly as they would live.
+     *
+     * Rendering stops at the first block boundary where any stop condition
+     * holds, then continues while any watched tail is still ringing. A
+     * maximum length caps the whole render, tails included. Without a stop
+     * condition or a maximum, render never returns.
+     */
+    class OfflineRenderer
+    {
+        public:
+            OfflineRenderer(TimingManager& timer);
+
+            /* Stop conditions. stop_after counts samples from the start of
+             * the render, and stop_when calls condition with arg once per
+             * block.
+             */
+            void stop_after(unsigned long num_samples);
+            void stop_when(bool (*condition)(void*), void* arg);
+            void stop_when_done(WavReader& reader);
+
+            /* Once stopping, keep rendering until the channel's peak has
+             * stayed below the threshold for hold_seconds, e.g. to let a
+             * reverb ring out.
+             */
+            void wait_for_tail(AudioChannel* channel,
+                    float threshold_db = -80.0, float hold_seconds = 0.5);
+
+            /* Caps the render at this many samples, tails included
+             */
+            void set_max_samples(unsigned long num_samples);
+
+            /* Runs the signal chain until it stops. The report compares the
+             * audio rendered to the wall clock time it took, so a realtime
+             * factor of 10 renders ten seconds of audio every second.
+             */
+            struct Report
+            {
+                unsigned long samples_rendered;
+                double audio_seconds;
+                double render_seconds;
+                double realtime_factor;
+            };
+            Report render();
+
+        private:
+            /* Returns true if any stop condition holds at time t, measured
+             * from the start of the render
+             */
+            bool should_stop(unsigned long t);
+
+            /* Returns the peak of the block beginning at time t
+             */
+            static SAMPLE block_peak(AudioChannel* channel, unsigned long t);
+
+            TimingManager& timer;
+
+            unsigned long stop_samples;
+            unsigned long max_samples;
+
+            struct Condition
+            {
+                bool (*condition)(void*);
+                void* arg;
+            };
+            std::vector<Condition> conditions;
+
+            struct Tail
+            {
+                AudioChannel* channel;
+                SAMPLE threshold;
+                unsigned long hold_samples;
+                unsigned long quiet_samples;
+            };
+            std::vector<Tail> tails;
+    };
+}
+
+#endif
@@ -8,6 +8,7 @@ using namespace ClickTrack;
 Oscillator::Oscillator(Mode in_mode, float in_freq)
     : AudioGenerator(1), 
       last_output(0.0), 
+      last_phase(0.0),
       lfo(nullptr),
       lfo_intensity(0.0),
       modulator(nullptr),
@@ -16,13 +17,112 @@ Oscillator::Oscillator(Mode in_mode, float in_freq)
       phase_inc(in_freq * 2*M_PI/SAMPLE_RATE), 
       transpose(1.0),
       mode(in_mode),
-      freq(in_freq)
+      freq(in_freq),
+      waveform(in_mode)
 {}
 
 
 void Oscillator::set_mode(Mode in_mode)
 {
-    mode = in_mode;
+    waveform.set_mode(in_mode);
+}
+
+
+void Oscillator::set_wavetable(std::shared_ptr<const Wavetable> in_table)
+{
+    waveform.set_wavetable(in_table);
+}
+
+
+std::shared_ptr<const Wavetable> Oscillator::get_mode_table(Mode mode)
+{
+    switch(mode)
+    {
+        case TableSine:
+            return Wavetable::get_shape(Wavetable::SINE);
+        case TableSaw:
+            return Wavetable::get_shape(Wavetable::SAW);
+        case TableSquare:
+            return Wavetable::get_shape(Wavetable::SQUARE);
+        case TableTri:
+            return Wavetable::get_shape(Wavetable::TRIANGLE);
+        default:
+            return nullptr;
+    }
+}
+
+
+Oscillator::WaveformSlot::WaveformSlot(Mode mode)
+    : current(new Waveform{mode, get_mode_table(mode)}), pending(nullptr),
+      retired(4), next_mode(mode), user_table()
+{}
+
+
+Oscillator::WaveformSlot::~WaveformSlot()
+{
+    delete current;
+    delete pending.load();
+
+    Waveform* old_waveform;
+    while(retired.pop(old_waveform))
+        delete old_waveform;
+}
+
+
+void Oscillator::WaveformSlot::set_mode(Mode mode)
+{
+    next_mode = mode;
+    publish();
+}
+
+
+void Oscillator::WaveformSlot::set_wavetable(
+        std::shared_ptr<const Wavetable> table)
+{
+    user_table = table;
+    if(next_mode == Table)
+        publish();
+}
+
+
+void Oscillator::WaveformSlot::publish()
+{
+    // First free any waveforms the audio thread has finished with. Each call
+    // publishes one, so the retired queue never fills up between calls
+    Waveform* old_waveform;
+    while(retired.pop(old_waveform))
+        delete old_waveform;
+
+    // If the audio thread never picked up the last one, it can be freed
+    // right away
+    Waveform* waveform = new Waveform{next_mode,
+        next_mode == Table ? user_table : get_mode_table(next_mode)};
+    delete pending.exchange(waveform);
+}
+
+
+void Oscillator::WaveformSlot::update()
+{
+    if(pending.load(std::memory_order_relaxed) == nullptr)
+        return;
+
+    Waveform* waveform = pending.exchange(nullptr);
+    if(waveform == nullptr)
+        return;
+    retired.push(current);
+    current = waveform;
+}
+
+
+Oscillator::Mode Oscillator::WaveformSlot::get_mode()
+{
+    return current->mode;
+}
+
+
+const Wavetable* Oscillator::WaveformSlot::get_table()
+{
+    return current->table.get();
 }
 
 
@@ -42,6 +142,7 @@ void Oscillator::set_transposition(float steps)
 void Oscillator::set_lfo_input(AudioChannel* input)
 {
     lfo = input;
+    mark_graph_changed();
 }
 
 
@@ -54,6 +155,7 @@ void Oscillator::set_lfo_intensity(float steps)
 void Oscillator::set_modulator_input(AudioChannel* input)
 {
     modulator = input;
+    mark_graph_changed();
 }
 
 
@@ -63,8 +165,22 @@ void Oscillator::set_modulator_intensity(float intensity)
 }
 
 
+void Oscillator::get_side_channels(std::vector<AudioChannel*>& channels)
+{
+    if(lfo != nullptr)
+        channels.push_back(lfo);
+    if(modulator != nullptr)
+        channels.push_back(modulator);
+}
+
+
 void Oscillator::generate_outputs(std::vector<SAMPLE>& outputs, unsigned long t)
 {
+    // Pick up any new waveform
+    waveform.update();
+    mode = waveform.get_mode();
+    const Wavetable* table = waveform.get_table();
+
     // Compute the LFO contribution
     float lfo_transpose = 1.0;
     if(lfo != nullptr)
@@ -83,7 +199,7 @@ void Oscillator::generate_outputs(std::vector<SAMPLE>& outputs, unsigned long t)
     }
 
     // Generate this output
-    SAMPLE out;
+    SAMPLE out = 0.0;
     switch(mode)
     {
         case Sine:
@@ -161,6 +277,24 @@ void Oscillator::generate_outputs(std::vector<SAMPLE>& outputs, unsigned long t)
                 out = 0.0;
             break;
         }
+
+        case TableSine:
+        case TableSaw:
+        case TableSquare:
+        case TableTri:
+        case Table:
+        {
+            // Pick the level from how far the phase actually moved, so
+            // vibrato and FM stay band limited
+            float step = phase - last_phase;
+            if(step > M_PI) step -= 2*M_PI;
+            else if(step < -M_PI) step += 2*M_PI;
+            last_phase = phase;
+
+            if(table != nullptr)
+                out = table->read(phase, step);
+            break;
+        }
     }
     outputs[0] = out;
 }
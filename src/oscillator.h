@@ -1,7 +1,11 @@
 #ifndef OSCILLATOR_H
 #define OSCILLATOR_H
 
+#include <atomic>
+#include <memory>
 #include "audio_generics.h"
+#include "spsc_ringbuffer.h"
+#include "wavetable.h"
 
 
 namespace ClickTrack
@@ -14,15 +18,81 @@ namespace ClickTrack
         public:
             /* The oscillator supports many waveform modes.
              * Blep oscillators use PolyBlep to generate alias-free waveforms
+             *
+             * Table oscillators read band-limited wavetables, which stay alias
+             * free under modulation. Table plays the wavetable given to
+             * set_wavetable, and is silent until one is set.
              */
             enum Mode { Sine, Saw, Square, Tri, WhiteNoise, 
-                BlepSaw, BlepSquare, BlepTri, PulseTrain};
+                BlepSaw, BlepSquare, BlepTri, PulseTrain,
+                TableSine, TableSaw, TableSquare, TableTri, Table};
             Oscillator(Mode mode, float in_freq);
 
             /* Sets the waveform mode
              */
             void set_mode(Mode mode);
 
+            /* Sets the wavetable played in Table mode
+             *
+             * These two may be called while the audio thread is running, but
+             * only from one thread at a time. The change is heard from the
+             * next sample.
+             */
+            void set_wavetable(std::shared_ptr<const Wavetable> table);
+
+            /* Returns the shared wavetable for a table mode, or null for any
+             * other mode
+             */
+            static std::shared_ptr<const Wavetable> get_mode_table(Mode mode);
+
+            /* Hands a mode and its wavetable from the thread that sets them
+             * to the audio thread that plays them, as a single waveform.
+             *
+             * The setters publish a new waveform, and the audio thread picks
+             * up the latest one with update. Waveforms it replaces come back
+             * to be freed by the next setter, so a table is never freed while
+             * it is being read, and the audio thread never frees anything.
+             */
+            class WaveformSlot
+            {
+                public:
+                    WaveformSlot(Mode mode);
+                    ~WaveformSlot();
+
+                    /* Setter side. Only one thread may call these.
+                     */
+                    void set_mode(Mode mode);
+                    void set_wavetable(std::shared_ptr<const Wavetable> table);
+
+                    /* Audio thread side. Get the current mode and table,
+                     * which only change on update.
+                     */
+                    void update();
+                    Mode get_mode();
+                    const Wavetable* get_table();
+
+                private:
+                    WaveformSlot(const WaveformSlot&) = delete;
+                    WaveformSlot& operator=(const WaveformSlot&) = delete;
+
+                    struct Waveform
+                    {
+                        Mode mode;
+                        std::shared_ptr<const Wavetable> table;
+                    };
+                    void publish();
+
+                    Waveform* current;
+                    std::atomic<Waveform*> pending;
+                    SpscRingBuffer<Waveform*> retired;
+
+                    /* Setter side. The mode last set, and the table for Table
+                     * mode
+                     */
+                    Mode next_mode;
+                    std::shared_ptr<const Wavetable> user_table;
+            };
+
             /* Sets the frequency
              */
             void set_freq(float freq);
@@ -53,7 +123,12 @@ namespace ClickTrack
              */
             void generate_outputs(std::vector<SAMPLE>& outputs, unsigned long t);
             float polyBlepOffset(float t);
+
+            /* Report the LFO and modulator to the audio graph
+             */
+            void get_side_channels(std::vector<AudioChannel*>& channels);
             float last_output; // used by blep triangle
+            float last_phase;  // used by table modes
 
             /* LFO input
              */
@@ -71,10 +146,12 @@ namespace ClickTrack
             float phase_inc;    // rads
             float transpose;
 
-            /* Oscillator state
+            /* Oscillator state. The mode is the waveform's, as of the last
+             * sample
              */
             Mode mode;
             float freq; // hz
+            WaveformSlot waveform;
     };
 }
 
@@ -1,15 +1,65 @@
+#include <algorithm>
 #include <cmath>
 #include "polyphonic_instrument.h"
 
 using namespace ClickTrack;
 
 
-PolyphonicInstrument::PolyphonicInstrument(int in_num_voices)
-    : GenericInstrument(), adder(in_num_voices),
-      num_voices(in_num_voices), all_voices(), free_voices(), note_to_voice()
+VoiceMixer::VoiceMixer(unsigned num_voices)
+    : AudioFilter(num_voices, 1), voices(num_voices, nullptr), next_time(0)
 {}
 
 
+void VoiceMixer::set_voice(PolyphonicVoice* voice, unsigned i)
+{
+    voices[i] = voice;
+    set_input_channel(voice->get_output_channel(), i);
+}
+
+
+unsigned long VoiceMixer::get_next_time()
+{
+    return next_time;
+}
+
+
+void VoiceMixer::filter_block(std::vector<const SAMPLE*>& inputs,
+        std::vector<SAMPLE*>& outputs, unsigned long t)
+{
+    SAMPLE* out = outputs[0];
+    for(unsigned j = 0; j < BUFFER_SIZE; j++)
+        out[j] = 0;
+
+    for(unsigned i = 0; i < inputs.size(); i++)
+    {
+        // Sleeping voices have nothing to add
+        PolyphonicVoice* voice = voices[i];
+        if(voice == nullptr || voice->asleep)
+            continue;
+
+        const SAMPLE* in = inputs[i];
+        for(unsigned j = 0; j < BUFFER_SIZE; j++)
+            out[j] += in[j];
+
+        // Once this block has faded out, stop running the voice
+        if(voice->is_idle())
+            voice->sleep();
+    }
+
+    next_time = t + BUFFER_SIZE;
+}
+
+
+
+
+PolyphonicInstrument::PolyphonicInstrument(int in_num_voices)
+    : GenericInstrument(), mixer(in_num_voices), voice_output(nullptr),
+      all_voices(), active_voices(), free_voices(), steal_policy(STEAL_OLDEST)
+{
+    std::fill(note_to_voice, note_to_voice+NUM_NOTES, nullptr);
+}
+
+
 PolyphonicInstrument::~PolyphonicInstrument()
 {
     for(auto voice : all_voices)
@@ -19,62 +69,104 @@ PolyphonicInstrument::~PolyphonicInstrument()
 
 AudioChannel* PolyphonicInstrument::get_output_channel()
 {
-    return adder.get_output_channel();
+    if(voice_output != nullptr)
+        return voice_output;
+    return mixer.get_output_channel();
+}
+
+
+void PolyphonicInstrument::set_steal_policy(StealPolicy policy)
+{
+    steal_policy = policy;
 }
 
 
-void PolyphonicInstrument::add_voices(std::vector<PolyphonicVoice*>& voices)
+void PolyphonicInstrument::add_voices(std::vector<PolyphonicVoice*>& voices,
+        AudioChannel* in_voice_output)
 {
-    // Count our voices
-    num_voices = voices.size();
+    voice_output = in_voice_output;
 
-    // Add all our oscillators to the free queue to start
-    for(unsigned i = 0; i < num_voices; i++)
+    // Add all our oscillators to the free queue to start. They sleep until
+    // their first note
+    for(unsigned i = 0; i < voices.size(); i++)
     {
-        all_voices.push_back(voices[i]);
-        free_voices.push_back(voices[i]);
-        adder.set_input_channel(voices[i]->get_output_channel(),i);
+        PolyphonicVoice* voice = voices[i];
+        all_voices.push_back(voice);
+        free_voices.push_back(voice);
+        if(voice_output == nullptr)
+            mixer.set_voice(voice, i);
+
+        voice->chain.clear();
+        voice->get_voice_chain(voice->chain);
+        voice->sleep();
     }
 }
 
 
 void PolyphonicInstrument::on_note_down(unsigned note, float velocity)
 {
+    if(note >= NUM_NOTES || all_voices.empty())
+        return;
+
     // To play a note, we need a voice to trigger.
-    // If this note is already playing, stop it first.
-    // Then pull the front voice, move it to the back and use it
-    PolyphonicVoice* voice;
-    if(note_to_voice[note] != NULL)
+    // If this note is already playing, retrigger its voice. Then try a free
+    // voice, and only steal one if there are none.
+    PolyphonicVoice* voice = note_to_voice[note];
+    if(voice != nullptr && voice->get_note() == note && voice->is_playing())
+        active_voices.remove(voice);
+    else if(voice != nullptr && voice->get_note() == note &&
+            steal_policy == STEAL_SAME_NOTE)
+        free_voices.remove(voice);
+    else if(free_voices.head != nullptr)
     {
-        voice = note_to_voice[note];
-        all_voices.remove(voice);
-        all_voices.push_back(voice);
-    }
-    else if(free_voices.empty())
-    {
-        voice = all_voices.front();
-        all_voices.pop_front();
-        all_voices.push_back(voice);
-        
-        note_to_voice.erase(voice->get_note());
+        voice = free_voices.head;
+        free_voices.remove(voice);
     }
     else
     {
-        voice = free_voices.front();
-        free_voices.pop_front();
+        voice = steal_voice();
+        active_voices.remove(voice);
     }
 
     // Trigger it and continue
+    active_voices.push_back(voice);
     note_to_voice[note] = voice;
+    if(voice->asleep)
+        voice->wake(mixer.get_next_time());
     voice->on_note_down(note, velocity);
 }
 
 
+PolyphonicVoice* PolyphonicInstrument::steal_voice()
+{
+    if(steal_policy != STEAL_QUIETEST)
+        return active_voices.head;
+
+    // Scan for the quietest, favoring older voices on a tie
+    PolyphonicVoice* quietest = active_voices.head;
+    float quietest_level = quietest->get_level();
+    for(auto voice = quietest->next_voice; voice != nullptr;
+            voice = voice->next_voice)
+    {
+        float level = voice->get_level();
+        if(level < quietest_level)
+        {
+            quietest = voice;
+            quietest_level = level;
+        }
+    }
+    return quietest;
+}
+
+
 void PolyphonicInstrument::on_note_up(unsigned note, float velocity)
 {
     // Get the voice, release and mark it as free if done playing
+    if(note >= NUM_NOTES)
+        return;
+
     PolyphonicVoice* voice = note_to_voice[note];
-    if(voice != NULL)
+    if(voice != nullptr && voice->get_note() == note)
         voice->on_note_up();
 }
 
@@ -113,16 +205,51 @@ void PolyphonicInstrument::on_midi_message(MidiMessage message)
 
 void PolyphonicInstrument::voice_done(PolyphonicVoice* voice)
 {
-    note_to_voice.erase(voice->get_note());
+    active_voices.remove(voice);
     free_voices.push_back(voice);
 }
 
 
+PolyphonicInstrument::VoiceList::VoiceList()
+    : head(nullptr), tail(nullptr)
+{}
+
+
+void PolyphonicInstrument::VoiceList::push_back(PolyphonicVoice* voice)
+{
+    voice->prev_voice = tail;
+    voice->next_voice = nullptr;
+    if(tail != nullptr)
+        tail->next_voice = voice;
+    else
+        head = voice;
+    tail = voice;
+}
+
+
+void PolyphonicInstrument::VoiceList::remove(PolyphonicVoice* voice)
+{
+    if(voice->prev_voice != nullptr)
+        voice->prev_voice->next_voice = voice->next_voice;
+    else
+        head = voice->next_voice;
+
+    if(voice->next_voice != nullptr)
+        voice->next_voice->prev_voice = voice->prev_voice;
+    else
+        tail = voice->prev_voice;
+
+    voice->prev_voice = nullptr;
+    voice->next_voice = nullptr;
+}
+
+
 
 
 PolyphonicVoice::PolyphonicVoice(PolyphonicInstrument* in_parent)
-    :  parent(in_parent), note(0), pitch_multiplier(1.0),
-       playing(false), sustained(false), held(false)
+    :  parent(in_parent), note(0), freq(0.0), pitch_multiplier(1.0),
+       playing(false), sustained(false), held(false), chain(),
+       asleep(false), prev_voice(nullptr), next_voice(nullptr)
 {}
 
 
@@ -148,7 +275,6 @@ void PolyphonicVoice::on_note_up()
             handle_note_up();
 
             parent->voice_done(this);
-            note = 0;
         }
     }
 }
@@ -171,7 +297,6 @@ void PolyphonicVoice::on_sustain_up()
             handle_note_up();
 
             parent->voice_done(this);
-            note = 0;
         }
     }
 }
@@ -194,3 +319,31 @@ unsigned PolyphonicVoice::get_note()
 {
     return note;
 }
+
+
+float PolyphonicVoice::get_level()
+{
+    return playing ? 1.0 : 0.0;
+}
+
+
+bool PolyphonicVoice::is_idle()
+{
+    return !playing;
+}
+
+
+void PolyphonicVoice::sleep()
+{
+    for(auto generator : chain)
+        generator->sleep();
+    asleep = true;
+}
+
+
+void PolyphonicVoice::wake(unsigned long t)
+{
+    for(auto generator : chain)
+        generator->wake(t);
+    asleep = false;
+}
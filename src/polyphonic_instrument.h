@@ -1,15 +1,42 @@
 #ifndef POLYPHONIC_INSTRUMENT_H
 #define POLYPHONIC_INSTRUMENT_H
 
-#include <list>
-#include <map>
-#include "adder.h"
+#include <vector>
 #include "audio_generics.h"
 #include "generic_instrument.h"
 
 namespace ClickTrack
 {
+    /* The voice mixer sums the outputs of a polyphonic instrument's voices.
+     *
+     * Idle voices are skipped, and their signal chains are put to sleep until
+     * their next note, so the instrument only pays for the voices that are
+     * sounding.
+     */
     class PolyphonicVoice;
+    class VoiceMixer : public AudioFilter
+    {
+        public:
+            VoiceMixer(unsigned num_voices);
+
+            /* Connects the voice to input i
+             */
+            void set_voice(PolyphonicVoice* voice, unsigned i);
+
+            /* Returns the start time of the next block we will mix, so that a
+             * voice woken between blocks rejoins in step
+             */
+            unsigned long get_next_time();
+
+        private:
+            void filter_block(std::vector<const SAMPLE*>& inputs,
+                    std::vector<SAMPLE*>& outputs, unsigned long t);
+
+            std::vector<PolyphonicVoice*> voices;
+            unsigned long next_time;
+    };
+
+
     class PolyphonicInstrument : public GenericInstrument
     {
         friend class PolyphonicVoice;
@@ -18,9 +45,9 @@ namespace ClickTrack
             PolyphonicInstrument(int voices);
             ~PolyphonicInstrument();
 
-            /* By default, the instrument feeds all its voices into an adder and
+            /* By default, the instrument feeds all its voices into a mixer and
              * returns that as the output. If there is a signal chain after the
-             * adder, you must override the following function to return the
+             * mixer, you must override the following function to return the
              * output channel
              */
             virtual AudioChannel* get_output_channel();
@@ -40,11 +67,34 @@ namespace ClickTrack
              */
             virtual void on_midi_message(MidiMessage message);
 
+            /* When every voice is held down, a new note must steal one. By
+             * default we take the oldest. Quietest takes the voice with the
+             * lowest envelope level. Same note also takes the oldest, but
+             * first restarts a voice still releasing the same note, rather
+             * than stacking another tail of it on a free voice.
+             *
+             * Whatever the policy, a note that is already held retriggers
+             * its own voice.
+             */
+            enum StealPolicy { STEAL_OLDEST, STEAL_QUIETEST, STEAL_SAME_NOTE };
+            void set_steal_policy(StealPolicy policy);
+
+            /* Instruments may render their voices as separate objects, each
+             * with its own signal chain, or all at once in a VoiceBank, which
+             * is much faster with many voices
+             */
+            enum VoiceBackend { OBJECT_VOICES, VOICE_BANK };
+
         protected:
             /* The constructor for an inherited class must call this function to
              * add its voices to our internal queues.
+             *
+             * If the voices render together into a single output, such as a
+             * VoiceBank, pass it here. It then replaces the mixer as our
+             * output.
              */
-            void add_voices(std::vector<PolyphonicVoice*>& voices);
+            void add_voices(std::vector<PolyphonicVoice*>& voices,
+                    AudioChannel* voice_output = nullptr);
 
             /* Used by the voice to signal that its note is done playing.
              */ 
@@ -52,28 +102,47 @@ namespace ClickTrack
 
             /* Sums the output of our voices
              */
-            Adder adder;
+            VoiceMixer mixer;
 
         private:
-            /* Voices are tracked in two lists. First, all voices are kept in
-             * all_voices, in ascending order of when they were last triggered.
-             * Then, voices that aren't playing are kept in free_voice. This
-             * allows us to first take unused voices, and then recycle in the
-             * order they were triggered.
-             *
-             * In the map, voices are indexed by the MIDI note number
-             * identifying them.
+            /* Voices are tracked in two intrusive lists, linked through the
+             * voices themselves. Voices held down are kept in active_voices,
+             * in the order they were triggered. Voices that aren't playing
+             * are kept in free_voices, in the order they were released, so
+             * we take the one whose tail has faded the longest. Nothing is
+             * allocated after the voices are added.
              */
-            unsigned num_voices;
-            std::list<PolyphonicVoice*> all_voices;
-            std::list<PolyphonicVoice*> free_voices;
-            std::map<unsigned, PolyphonicVoice*> note_to_voice;
+            struct VoiceList
+            {
+                VoiceList();
+                void push_back(PolyphonicVoice* voice);
+                void remove(PolyphonicVoice* voice);
+
+                PolyphonicVoice* head;
+                PolyphonicVoice* tail;
+            };
+
+            /* Picks a voice to steal when none are free
+             */
+            PolyphonicVoice* steal_voice();
+
+            AudioChannel* voice_output;
+            std::vector<PolyphonicVoice*> all_voices;
+            VoiceList active_voices;
+            VoiceList free_voices;
+            StealPolicy steal_policy;
+
+            /* Voices are indexed by the MIDI note they last played. An entry
+             * is stale once its voice moves on to another note.
+             */
+            static const unsigned NUM_NOTES = 128;
+            PolyphonicVoice* note_to_voice[NUM_NOTES];
     };
 
 
     class PolyphonicVoice
     {
-        friend class PolyphoncInstrument;
+        friend class PolyphonicInstrument;
 
         public:
             PolyphonicVoice(PolyphonicInstrument* parent);
@@ -104,11 +173,30 @@ namespace ClickTrack
              */
             bool is_playing();
 
-            /* Returns the midi value of the playing note
+            /* Returns the midi value of the playing note, or the last note
+             * played once the voice is free
              */
             unsigned get_note();
 
+            /* Returns the voice's current envelope level, from 0 to 1. Voices
+             * without an envelope are always at full level while playing.
+             */
+            virtual float get_level();
+
+            /* Returns true once the voice has fallen silent, so the mixer may
+             * stop running it. By default this is as soon as the note is
+             * released. Voices with a release tail must override this.
+             */
+            virtual bool is_idle();
+
         protected:
+            /* Voices report the generators in their own signal chain here, so
+             * the chain can sleep while the voice is idle. Generators shared
+             * with other voices, such as an LFO, must not be reported.
+             */
+            virtual void get_voice_chain(std::vector<AudioGenerator*>& chain)
+                {}
+
             PolyphonicInstrument* parent;
 
             /* The MIDI note value being played
@@ -122,6 +210,23 @@ namespace ClickTrack
             bool playing;
             bool sustained;
             bool held;
+
+        private:
+            friend class VoiceMixer;
+
+            /* Puts our signal chain to sleep, or wakes it with the block at
+             * time t
+             */
+            void sleep();
+            void wake(unsigned long t);
+
+            std::vector<AudioGenerator*> chain;
+            bool asleep;
+
+            /* Links for the instrument's voice lists
+             */
+            PolyphonicVoice* prev_voice;
+            PolyphonicVoice* next_voice;
     };
 }
 
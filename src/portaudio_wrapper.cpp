@@ -1,5 +1,9 @@
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <thread>
 #include "portaudio_wrapper.h"
+#include "vector_ops.h"
 
 using namespace ClickTrack;
 
@@ -82,7 +86,7 @@ InputStream::InputStream(unsigned in_channels, bool useDefault)
 InputStream::~InputStream()
 {
     // Free the buffer
-    delete buffer;
+    delete[] buffer;
 
     // Close portaudio
     pa_error_check("Pa_StopStream", Pa_StopStream(stream));
@@ -91,24 +95,31 @@ InputStream::~InputStream()
 }
 
 
-void InputStream::readFromStream(std::vector< std::vector<SAMPLE> >& out)
+void InputStream::readFromStream(std::vector<SAMPLE*>& out)
 {
     // Read in from the sream
     Pa_ReadStream(stream, buffer, BUFFER_SIZE);    
 
     // Deinterleave our results
-    for(int i = 0; i < channels; i++)
-    {
-        for(int j = 0; j < BUFFER_SIZE; j++)
-            out[i][j] = buffer[channels*j + i];
-    }
+    deinterleave(buffer, channels, out.data(), BUFFER_SIZE);
 }
 
 
 
 
-OutputStream::OutputStream(unsigned in_channels, bool useDefault)
-    : channels(in_channels)
+OutputStream::OutputStream(unsigned in_channels, bool useDefault,
+        unsigned in_blocks_ahead)
+    : channels(in_channels),
+      blocks_ahead(in_blocks_ahead),
+      ready_blocks(in_blocks_ahead),
+      free_blocks(in_blocks_ahead),
+      current_block(),
+      current_offset(0),
+      playing(false),
+      underflows(0),
+      xruns(0),
+      play_callback(NULL),
+      play_callback_arg(NULL)
 {
     // Initialize portaudio
     pa_error_check("PaInitialize", Pa_Initialize());
@@ -160,44 +171,142 @@ OutputStream::OutputStream(unsigned in_channels, bool useDefault)
         Pa_GetDeviceInfo(outputParams.device)->defaultLowOutputLatency;
     outputParams.hostApiSpecificStreamInfo = NULL;
 
+    // Initialize buffer for writing. In callback mode, this holds all the
+    // queued blocks back to back, and they all start out free
+    if(blocks_ahead == 0)
+        buffer = new SAMPLE[channels*BUFFER_SIZE];
+    else
+    {
+        buffer = new SAMPLE[blocks_ahead*channels*BUFFER_SIZE];
+        for(unsigned i = 0; i < blocks_ahead; i++)
+            free_blocks.push({buffer + i*channels*BUFFER_SIZE, 0});
+    }
+
     //Open the stream!
     pa_error_check("Pa_OpenStream",
         Pa_OpenStream(&stream, NULL, &outputParams,
             SAMPLE_RATE, BUFFER_SIZE, paNoFlag,
-            NULL, NULL));
+            blocks_ahead == 0 ? NULL : &OutputStream::stream_callback,
+            this));
     pa_error_check("Pa_StartStream", Pa_StartStream(stream));
-
-    // Initialize buffer for writing
-    buffer = new SAMPLE[channels*BUFFER_SIZE];
 }
 
 
 OutputStream::~OutputStream()
 {
-    // Free the buffer
-    delete buffer;
-
-    // Close portaudio
+    // Close portaudio. This waits for the callback to finish
     pa_error_check("Pa_StopStream", Pa_StopStream(stream));
     pa_error_check("Pa_CloseStream", Pa_CloseStream(stream));
     pa_error_check("Pa_Terminate", Pa_Terminate());
+
+    // Free the buffer
+    delete[] buffer;
 }
 
 
-void OutputStream::writeToStream(std::vector< std::vector<SAMPLE> >& in)
+void OutputStream::writeToStream(const std::vector<const SAMPLE*>& in,
+        unsigned long t)
 {
+    // In callback mode, wait for the callback to free up a block. Poll a few
+    // times per block, rather than have the callback signal us
+    Block block = {buffer, t};
+    if(blocks_ahead != 0)
+    {
+        const std::chrono::microseconds poll_period(
+                1000000ul * BUFFER_SIZE / SAMPLE_RATE / 4);
+        while(!free_blocks.pop(block))
+            std::this_thread::sleep_for(poll_period);
+        block.t = t;
+    }
+
     // Interleave channels
-    for(int i = 0; i < channels; i++)
+    interleave_clamp(in.data(), channels, block.samples, BUFFER_SIZE);
+
+    // Write out to the stream, or queue it for the callback. There is always
+    // room in the queue for a block we took from the free list
+    if(blocks_ahead == 0)
+    {
+        if(Pa_WriteStream(stream, buffer, BUFFER_SIZE) == paOutputUnderflowed)
+            xruns.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+        ready_blocks.push(block);
+}
+
+
+void OutputStream::set_play_callback(void (*callback)(void*, unsigned long),
+        void* arg)
+{
+    play_callback = callback;
+    play_callback_arg = arg;
+}
+
+
+unsigned long OutputStream::get_underflows()
+{
+    return underflows.load(std::memory_order_relaxed);
+}
+
+
+unsigned long OutputStream::get_xruns()
+{
+    return xruns.load(std::memory_order_relaxed);
+}
+
+
+int OutputStream::stream_callback(const void* input, void* output,
+        unsigned long frames, const PaStreamCallbackTimeInfo* time_info,
+        PaStreamCallbackFlags status, void* user_data)
+{
+    OutputStream* self = (OutputStream*) user_data;
+    if(status & paOutputUnderflow)
+        self->xruns.fetch_add(1, std::memory_order_relaxed);
+    self->fill_output((SAMPLE*) output, frames);
+    return paContinue;
+}
+
+
+void OutputStream::fill_output(SAMPLE* output, unsigned long frames)
+{
+    // Copy out of queued blocks until we fill the device's buffer. The device
+    // may not ask for whole blocks, so we may stop partway through one
+    unsigned long written = 0;
+    while(written < frames)
     {
-        for(int j = 0; j < BUFFER_SIZE; j++)
+        if(current_block.samples == NULL)
+        {
+            if(!ready_blocks.pop(current_block))
+                break;
+            current_offset = 0;
+            playing = true;
+        }
+
+        unsigned long n = std::min<unsigned long>(frames - written,
+                BUFFER_SIZE - current_offset);
+        std::copy(current_block.samples + channels*current_offset,
+                current_block.samples + channels*(current_offset + n),
+                output + channels*written);
+        written += n;
+        current_offset += n;
+
+        // Hand finished blocks back to the writer
+        if(current_offset == BUFFER_SIZE)
         {
-            SAMPLE sample = in[i][j];
-            if(sample > 1.0) sample = 1.0;
-            if(sample < -1.0) sample = -1.0;
-            buffer[channels*j + i] = sample;
+            if(play_callback != NULL)
+                play_callback(play_callback_arg,
+                        current_block.t + BUFFER_SIZE - 1);
+            free_blocks.push(current_block);
+            current_block.samples = NULL;
         }
     }
 
-    // Write out to the stream
-    Pa_WriteStream(stream, buffer, BUFFER_SIZE);
+    // On underflow, play silence for the rest. Don't count the wait for the
+    // first block
+    if(written < frames)
+    {
+        std::fill(output + channels*written, output + channels*frames,
+                SAMPLE_SILENCE);
+        if(playing)
+            underflows.fetch_add(1, std::memory_order_relaxed);
+    }
 }
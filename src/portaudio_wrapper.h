@@ -1,8 +1,10 @@
 #ifndef PORTAUDIO_WRAPPER_H
 #define PORTAUDIO_WRAPPER_H
 
+#include <atomic>
 #include <portaudio.h>
 #include <vector>
+#include "spsc_ringbuffer.h"
 
 
 /* Define the constants for portaudio library.
@@ -21,9 +23,17 @@ namespace ClickTrack
      *
      * Currently, a buffer size of 128 is the lowest power of two that will run
      * skipfree on my laptop.
+     *
+     * The buffer size may be overridden at build time by defining
+     * CLICKTRACK_BUFFER_SIZE. It must be a power of two of at least 64.
      */
+#ifndef CLICKTRACK_BUFFER_SIZE
+#define CLICKTRACK_BUFFER_SIZE 256
+#endif
     const unsigned SAMPLE_RATE = 44100; //hz
-    const unsigned BUFFER_SIZE = 256;
+    const unsigned BUFFER_SIZE = CLICKTRACK_BUFFER_SIZE;
+    static_assert(BUFFER_SIZE >= 64 && (BUFFER_SIZE & (BUFFER_SIZE-1)) == 0,
+            "CLICKTRACK_BUFFER_SIZE must be a power of two of at least 64");
 
 
     /* A wrapper for the portaudio boilerplate code. Should initialize and close
@@ -40,10 +50,10 @@ namespace ClickTrack
             InputStream(unsigned in_channels = 1, bool useDefault=true);
             ~InputStream();
 
-            /* Given a reference to a vector of channel data, reads the data
-             * from a stream.
+            /* Reads one block from the stream, deinterleaving it straight
+             * into the given channel blocks of BUFFER_SIZE samples each
              */
-            void readFromStream(std::vector< std::vector<SAMPLE> >& out);
+            void readFromStream(std::vector<SAMPLE*>& out);
 
         private:
             PaStream* stream;
@@ -54,6 +64,15 @@ namespace ClickTrack
 
     /* A wrapper for the portaudio boilerplate code. Should initialize and close
      * the streams for us, and provide the ability to write to the audio stream.
+     *
+     * By default, writes block in Pa_WriteStream until the device has room,
+     * so any hiccup in the caller is heard directly as an underrun.
+     *
+     * If blocks_ahead is nonzero, the stream instead runs from a PortAudio
+     * callback. Writes fill a queue of that many preallocated blocks, and
+     * only block while the queue is full. The callback only copies blocks
+     * out of the queue, so the caller may run up to blocks_ahead blocks
+     * early to absorb its slow blocks. That adds as many blocks of latency.
      */
     class OutputStream {
         public:
@@ -63,18 +82,68 @@ namespace ClickTrack
              *
              * If useDefault is false, then a chooser is presented to the user
              */
-            OutputStream(unsigned in_channels = 1, bool useDefault=true);
+            OutputStream(unsigned in_channels = 1, bool useDefault=true,
+                    unsigned blocks_ahead = 0);
             ~OutputStream();
 
-            /* Given a reference to a vector of channel data, writes the data to
-             * a stream.
+            /* Writes one block to the stream, interleaving and clamping the
+             * given channel blocks of BUFFER_SIZE samples each straight into
+             * the device buffer, or the next queued block in callback mode.
+             * The sample time t of the block's first sample is passed on to
+             * the play callback.
+             */
+            void writeToStream(const std::vector<const SAMPLE*>& in,
+                    unsigned long t = 0);
+
+            /* In callback mode, registers a function to be called from the
+             * driver's thread with the last sample time of each block as it
+             * is handed to the device. It must not block or allocate.
              */
-            void writeToStream(std::vector< std::vector<SAMPLE> >& in);
+            void set_play_callback(void (*callback)(void*, unsigned long),
+                    void* arg);
+
+            /* In callback mode, returns how many times the device asked for
+             * samples after the first block, and the queue was empty
+             */
+            unsigned long get_underflows();
+
+            /* Returns how many output underflows the driver has reported
+             */
+            unsigned long get_xruns();
 
         private:
             PaStream* stream;
             const unsigned channels;
             SAMPLE* buffer;
+
+            /* Callback mode state. Blocks are handed to the callback through
+             * ready_blocks, and back to the writer through free_blocks.
+             */
+            struct Block
+            {
+                SAMPLE* samples;
+                unsigned long t;
+            };
+
+            static int stream_callback(const void* input, void* output,
+                    unsigned long frames,
+                    const PaStreamCallbackTimeInfo* time_info,
+                    PaStreamCallbackFlags status, void* user_data);
+            void fill_output(SAMPLE* output, unsigned long frames);
+
+            const unsigned blocks_ahead;
+            SpscRingBuffer<Block> ready_blocks;
+            SpscRingBuffer<Block> free_blocks;
+
+            // Only touched by the callback
+            Block current_block;
+            unsigned current_offset;
+            bool playing;
+
+            std::atomic<unsigned long> underflows;
+            std::atomic<unsigned long> xruns;
+            void (*play_callback)(void*, unsigned long);
+            void* play_callback_arg;
     };
 }
 
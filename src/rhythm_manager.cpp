@@ -33,21 +33,23 @@ const RhythmManager::meter_t& RhythmManager::get_current_meter()
 }
 
 
-bool RhythmManager::is_on_beat()
+bool RhythmManager::is_on_beat(unsigned offset)
 {
-    return (current_tick % samples_per_beat) == 0;
+    return ((current_tick + offset) % samples_per_beat) == 0;
 }
 
 
-unsigned RhythmManager::get_current_beat()
+unsigned RhythmManager::get_current_beat(unsigned offset)
 {
-    return current_beat;
+    unsigned beats_ahead = (current_tick%samples_per_beat + offset) / 
+        samples_per_beat;
+    return (current_beat + beats_ahead) % meter.size();
 }
 
 
-RhythmManager::BeatType RhythmManager::get_current_beat_type()
+RhythmManager::BeatType RhythmManager::get_current_beat_type(unsigned offset)
 {
-    return meter[current_beat];
+    return meter[get_current_beat(offset)];
 }
 
 
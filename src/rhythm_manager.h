@@ -42,15 +42,19 @@ namespace ClickTrack
              * get_current_beat_type() returns the type of beat we are
              *     currently playing
              *
+             * The offset looks that many samples ahead of the current sample.
+             * It is used by audio generators, which generate a whole block
+             * ahead of the current time.
+             *
              * is_xxx_subdivision() takes in a multiple, and returns whether or
              *     not we fall directly on a subdivision samples.
              *     i.e. is_beat_subdivision(2) tells us whether we fall on an
              *     eighth note in 4/4, and is_beat_subdivision(3,2) tells us
              *     whether we fall on an eight note triplet
              */
-            bool is_on_beat();
-            unsigned get_current_beat();
-            BeatType get_current_beat_type();
+            bool is_on_beat(unsigned offset=0);
+            unsigned get_current_beat(unsigned offset=0);
+            BeatType get_current_beat_type(unsigned offset=0);
 
             bool is_beat_subdivision(unsigned numerator, 
                     unsigned denominator=1);
@@ -16,6 +16,12 @@ void RingModulator::set_wetness(float in_wetness)
 }
 
 
+void RingModulator::get_side_channels(std::vector<AudioChannel*>& channels)
+{
+    channels.push_back(modulator.get_output_channel());
+}
+
+
 void RingModulator::filter(std::vector<SAMPLE>& input,
         std::vector<SAMPLE>& output, unsigned long t)
 {
@@ -26,6 +26,7 @@ namespace ClickTrack
         private:
             void filter(std::vector<SAMPLE>& input,
                     std::vector<SAMPLE>& output, unsigned long t);
+            void get_side_channels(std::vector<AudioChannel*>& channels);
 
             float wetness;
     };
@@ -1,6 +1,8 @@
 #ifndef RINGBUFFER_CPP
 #define RINGBUFFER_CPP
 
+#include <algorithm>
+#include "bit_ops.h"
 #include "ringbuffer.h"
 
 using namespace ClickTrack;
@@ -82,4 +84,172 @@ void RingBuffer<SampleT>::set_new_startpoint(unsigned t)
     size = 0;
 }
 
+
+
+template <class SampleT>
+MaskedRingBuffer<SampleT>::MaskedRingBuffer(unsigned min_size)
+    : start_t(0), end_t(0), mask(next_power_of_two(min_size)-1),
+      samples(mask+1)
+{}
+
+
+template <class SampleT>
+void MaskedRingBuffer<SampleT>::check_range(unsigned long start,
+        unsigned long end)
+{
+#ifdef RINGBUFFER_DEBUG
+    if(start < start_t || end > end_t)
+        throw RingBufferOutOfRange(start_t, end_t,
+                start < start_t ? start : end-1);
+#endif
+}
+
+
+template <class SampleT>
+SampleT& MaskedRingBuffer<SampleT>::operator[] (unsigned long t)
+{
+    check_range(t, t+1);
+    return samples[t & mask];
+}
+template <class SampleT>
+SampleT MaskedRingBuffer<SampleT>::get(const unsigned long t)
+{
+    return operator[](t);
+}
+
+
+template <class SampleT>
+unsigned long MaskedRingBuffer<SampleT>::add(SampleT s)
+{
+    samples[end_t & mask] = s;
+    end_t++;
+
+    // Drop the earliest time if nessecary
+    if(end_t - start_t > mask+1)
+        start_t++;
+
+    return end_t-1;
+}
+
+
+template <class SampleT>
+typename MaskedRingBuffer<SampleT>::Spans MaskedRingBuffer<SampleT>::spans(
+        unsigned long start, unsigned n)
+{
+    unsigned i = start & mask;
+    unsigned first = std::min<unsigned long>(n, mask+1 - i);
+
+    Spans result;
+    result.first.data = &samples[i];
+    result.first.length = first;
+    result.second.data = &samples[0];
+    result.second.length = n - first;
+    return result;
+}
+
+
+template <class SampleT>
+typename MaskedRingBuffer<SampleT>::Spans
+MaskedRingBuffer<SampleT>::read_block(const unsigned long start, unsigned n)
+{
+    check_range(start, start+n);
+    return spans(start, n);
+}
+
+
+template <class SampleT>
+void MaskedRingBuffer<SampleT>::read_block(const unsigned long start,
+        SampleT* out, unsigned n)
+{
+    Spans block = read_block(start, n);
+    std::copy(block.first.data, block.first.data + block.first.length, out);
+    std::copy(block.second.data, block.second.data + block.second.length,
+            out + block.first.length);
+}
+
+
+template <class SampleT>
+typename MaskedRingBuffer<SampleT>::Spans
+MaskedRingBuffer<SampleT>::write_block(unsigned n)
+{
+    Spans block = spans(end_t, n);
+    end_t += n;
+
+    // Drop the earliest times if nessecary
+    if(end_t - start_t > mask+1)
+        start_t = end_t - (mask+1);
+
+    return block;
+}
+
+
+template <class SampleT>
+void MaskedRingBuffer<SampleT>::write_block(const SampleT* in, unsigned n)
+{
+    Spans block = write_block(n);
+    std::copy(in, in + block.first.length, block.first.data);
+    std::copy(in + block.first.length, in + n, block.second.data);
+}
+
+
+/* Scaled accumulate for add_block. Samples use the vectorized kernel, and
+ * anything else gets a plain loop.
+ */
+namespace ClickTrack
+{
+    template <class SampleT>
+    inline void ringbuffer_accumulate(const SampleT* in, SampleT gain,
+            SampleT* out, unsigned n)
+    {
+        for(unsigned i = 0; i < n; i++)
+            out[i] += gain*in[i];
+    }
+
+    inline void ringbuffer_accumulate(const SAMPLE* in, SAMPLE gain,
+            SAMPLE* out, unsigned n)
+    {
+        multiply_accumulate(in, gain, out, n);
+    }
+}
+
+
+template <class SampleT>
+void MaskedRingBuffer<SampleT>::add_block(const unsigned long start,
+        const SampleT* in, unsigned n, SampleT gain)
+{
+    Spans block = read_block(start, n);
+    ringbuffer_accumulate(in, gain, block.first.data, block.first.length);
+    ringbuffer_accumulate(in + block.first.length, gain, block.second.data,
+            block.second.length);
+}
+
+
+template <class SampleT>
+unsigned long MaskedRingBuffer<SampleT>::get_lowest_timestamp()
+{
+    return start_t;
+}
+
+
+template <class SampleT>
+unsigned long MaskedRingBuffer<SampleT>::get_highest_timestamp()
+{
+    return end_t;
+}
+
+
+template <class SampleT>
+unsigned MaskedRingBuffer<SampleT>::get_capacity()
+{
+    return mask+1;
+}
+
+
+template <class SampleT>
+void MaskedRingBuffer<SampleT>::set_new_startpoint(unsigned long t)
+{
+    start_t = t;
+    end_t = t;
+}
+
 #endif
@@ -4,6 +4,7 @@
 #include <exception>
 #include <cstdio>
 #include <vector>
+#include "vector_ops.h"
 
 
 namespace ClickTrack{
@@ -61,6 +62,96 @@ namespace ClickTrack{
     };
 
 
+    /* MaskedRingBuffer is a faster variant of RingBuffer for delay lines in
+     * the audio path. Its capacity is rounded up to a power of two, so
+     * timestamps map into the ring with a mask instead of a modulo.
+     *
+     * Its accessors are unchecked. Define RINGBUFFER_DEBUG across the whole
+     * build to have them check the requested range and throw
+     * RingBufferOutOfRange like RingBuffer does.
+     *
+     * Whole blocks can be read, appended and accumulated at once. A block of
+     * timestamps lands in at most two contiguous spans of the ring, one up to
+     * the end of the array and one wrapping around from its start, so each
+     * block operation is at most two memcpy or vector calls.
+     */
+    template <class SampleT>
+    class MaskedRingBuffer
+    {
+        public:
+            /* Allocates a ring holding at least min_size values
+             */
+            MaskedRingBuffer(unsigned min_size);
+
+            /* Unchecked access to the values in the current time range
+             */
+            inline SampleT& operator[] (const unsigned long t);
+            inline SampleT get(const unsigned long t);
+
+            /* Adds a sample as the next time step in the buffer. May overwrite
+             * the oldest time step. Returns the timestamp of the added value.
+             */
+            inline unsigned long add(SampleT s);
+
+            /* A contiguous run of values in the ring. The second span is
+             * empty unless the block wraps around the end of the array.
+             */
+            struct Span
+            {
+                SampleT* data;
+                unsigned length;
+            };
+            struct Spans
+            {
+                Span first;
+                Span second;
+            };
+
+            /* Returns the spans holding timestamps [start, start+n), or copies
+             * them into out
+             */
+            Spans read_block(const unsigned long start, unsigned n);
+            void read_block(const unsigned long start, SampleT* out,
+                    unsigned n);
+
+            /* Appends n time steps to the buffer, overwriting the oldest.
+             * Either returns the spans of the new values for the caller to
+             * fill, or copies them in from in.
+             */
+            Spans write_block(unsigned n);
+            void write_block(const SampleT* in, unsigned n);
+
+            /* Accumulates gain*in into timestamps [start, start+n)
+             */
+            void add_block(const unsigned long start, const SampleT* in,
+                    unsigned n, SampleT gain = 1);
+
+            /* Getters to expose the lowest and high timestamp
+             */
+            inline unsigned long get_lowest_timestamp();
+            inline unsigned long get_highest_timestamp();
+            unsigned get_capacity();
+
+            /* Empties the buffer, so the next value added has timestamp t
+             */
+            void set_new_startpoint(unsigned long t);
+
+        private:
+            /* Throws if [start, end) is not all stored, when compiled with
+             * RINGBUFFER_DEBUG. Otherwise does nothing.
+             */
+            inline void check_range(unsigned long start, unsigned long end);
+
+            inline Spans spans(unsigned long start, unsigned n);
+
+            unsigned long start_t; // earliest time still in the buffer
+            unsigned long end_t;   // one past the latest time in the buffer
+
+            const unsigned long mask;     // capacity-1
+            std::vector<SampleT> samples; // the actual ring array
+    };
+
+
     /* Define an exceptions for use in RingBuffer. Thrown when requesting a time
      * value that is not in the ring buffer.
      */
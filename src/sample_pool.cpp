@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <sys/stat.h>
+#include "sample_pool.h"
+#include "wav_reader.h"
+
+using namespace ClickTrack;
+
+
+Sample::Sample(unsigned long in_length, unsigned in_num_channels)
+    : data(nullptr), length(in_length),
+      stride((in_length + PADDING-1) / PADDING * PADDING),
+      num_channels(in_num_channels)
+{
+    // Allocate every channel at once, padded with silence
+    void* memory;
+    size_t size = std::max(1ul, stride*num_channels)*sizeof(SAMPLE);
+    if(posix_memalign(&memory, PADDING*sizeof(SAMPLE), size) != 0)
+        throw std::bad_alloc();
+    data = (SAMPLE*) memory;
+    std::fill(data, data + stride*num_channels, 0.0);
+}
+
+
+Sample::~Sample()
+{
+    free(data);
+}
+
+
+const SAMPLE* Sample::get_data(unsigned channel) const
+{
+    return data + channel*stride;
+}
+
+
+unsigned long Sample::get_length() const
+{
+    return length;
+}
+
+
+unsigned Sample::get_num_channels() const
+{
+    return num_channels;
+}
+
+
+
+
+SamplePool::SamplePool()
+    : lock(), entries()
+{}
+
+
+std::shared_ptr<const Sample> SamplePool::load(const std::string& path)
+{
+    // Look up the version on disk. If the file is missing, let the reader
+    // throw for us
+    struct stat info;
+    bool found = stat(path.c_str(), &info) == 0;
+    long modified = found ? info.st_mtime : 0;
+    long long size = found ? info.st_size : 0;
+
+    // Reuse a live copy of the same version
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto entry = entries.find(path);
+        if(found && entry != entries.end() &&
+                entry->second.modified == modified &&
+                entry->second.size == size)
+        {
+            std::shared_ptr<const Sample> sample = entry->second.sample.lock();
+            if(sample)
+                return sample;
+        }
+    }
+
+    // Decode it without holding the lock
+    WavReader wav(path.c_str());
+    std::shared_ptr<Sample> sample(new Sample(wav.get_total_samples(),
+                wav.get_num_channels()));
+    std::vector<SAMPLE*> channels(sample->num_channels);
+    for(unsigned c = 0; c < sample->num_channels; c++)
+        channels[c] = sample->data + c*sample->stride;
+    wav.read_all(channels.data());
+
+    // Publish it. If another thread loaded the same version meanwhile, use
+    // theirs so there is only ever one copy
+    std::lock_guard<std::mutex> guard(lock);
+    Entry& entry = entries[path];
+    std::shared_ptr<const Sample> existing = entry.sample.lock();
+    if(existing && entry.modified == modified && entry.size == size)
+        return existing;
+
+    entry.modified = modified;
+    entry.size = size;
+    entry.sample = sample;
+    prune();
+    return sample;
+}
+
+
+unsigned SamplePool::size()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    prune();
+    return entries.size();
+}
+
+
+void SamplePool::prune()
+{
+    for(auto entry = entries.begin(); entry != entries.end(); )
+    {
+        if(entry->second.sample.expired())
+            entry = entries.erase(entry);
+        else
+            entry++;
+    }
+}
+
+
+SamplePool& ClickTrack::get_sample_pool()
+{
+    static SamplePool pool;
+    return pool;
+}
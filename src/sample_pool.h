@@ -0,0 +1,93 @@
+#ifndef SAMPLE_POOL_H
+#define SAMPLE_POOL_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "portaudio_wrapper.h"
+
+
+namespace ClickTrack
+{
+    /* A sample is one decoded wav file, shared by everything that plays it.
+     * It never changes once loaded, so any number of threads may read it.
+     *
+     * Each channel starts on a cache line, and is zero padded up to a
+     * multiple of PADDING samples, so SIMD loops may read whole vectors past
+     * the end.
+     */
+    class Sample
+    {
+        friend class SamplePool;
+
+        public:
+            ~Sample();
+
+            static const unsigned PADDING = 16;
+
+            const SAMPLE* get_data(unsigned channel = 0) const;
+            unsigned long get_length() const;
+            unsigned get_num_channels() const;
+
+        private:
+            Sample(unsigned long length, unsigned num_channels);
+            Sample(const Sample&) = delete;
+            Sample& operator=(const Sample&) = delete;
+
+            SAMPLE* data;
+            unsigned long length;
+            unsigned long stride; // padded length of each channel
+            unsigned num_channels;
+    };
+
+
+    /* The sample pool decodes each wav file once, and hands out shared
+     * references to the result. Files are keyed by path, modification time
+     * and size, so editing a file on disk loads the new version next time.
+     *
+     * The pool only holds weak references. A sample is freed as soon as the
+     * last voice playing it lets go.
+     *
+     * Loading is thread safe, and decodes outside the pool's lock, so
+     * several files can load at once.
+     */
+    class SamplePool
+    {
+        public:
+            SamplePool();
+
+            /* Returns the decoded file at path, loading it if the pool has no
+             * live copy of its current version. Throws InvalidWavFile if it
+             * cannot be read.
+             */
+            std::shared_ptr<const Sample> load(const std::string& path);
+
+            /* Returns the number of files currently loaded
+             */
+            unsigned size();
+
+        private:
+            struct Entry
+            {
+                long modified;
+                long long size;
+                std::weak_ptr<const Sample> sample;
+            };
+
+            /* Forgets entries whose samples have been freed. Called with the
+             * lock held.
+             */
+            void prune();
+
+            std::mutex lock;
+            std::map<std::string, Entry> entries;
+    };
+
+
+    /* Returns the pool shared by the whole process
+     */
+    SamplePool& get_sample_pool();
+}
+
+#endif
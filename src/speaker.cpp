@@ -3,28 +3,45 @@
 using namespace ClickTrack;
 
 
-Speaker::Speaker(TimingManager& in_timer, unsigned num_inputs, bool defaultDevice)
+Speaker::Speaker(TimingManager& in_timer, unsigned num_inputs, bool defaultDevice,
+        unsigned blocks_ahead)
     : AudioConsumer(num_inputs), 
-      buffer(), 
-      stream(num_inputs,defaultDevice),
-      timer(in_timer)
+      stream(num_inputs,defaultDevice,blocks_ahead),
+      timer(in_timer),
+      callback_mode(blocks_ahead != 0),
+      reported_xruns(0)
+{
+    if(callback_mode)
+        stream.set_play_callback(&Speaker::synchronize_timer, &timer);
+}
 
+
+unsigned long Speaker::get_underflows()
 {
-    for(unsigned i = 0; i < num_inputs; i++)
-        buffer.push_back(std::vector<SAMPLE>(BUFFER_SIZE));
+    return stream.get_underflows();
 }
 
 
-void Speaker::process_inputs(std::vector<SAMPLE>& inputs, unsigned long t)
+void Speaker::process_block(std::vector<const SAMPLE*>& inputs,
+        unsigned long t)
 {
-    // Copy one frame in
-    for(unsigned i = 0; i < inputs.size(); i++)
-        buffer[i][t % BUFFER_SIZE] = inputs[i];
-    
-    // If we have filled our buffer, write out
-    if((t+1) % BUFFER_SIZE == 0)
+    // Write out, and mark the end of the block as written. In callback mode,
+    // that happens when the block actually plays
+    stream.writeToStream(inputs, t);
+    if(!callback_mode)
+        timer.synchronize(t + BUFFER_SIZE - 1);
+
+    // Pass on any new xruns
+    unsigned long xruns = stream.get_xruns() + stream.get_underflows();
+    if(xruns != reported_xruns)
     {
-        stream.writeToStream(buffer);
-        timer.synchronize(t);
+        timer.report_xruns(xruns - reported_xruns);
+        reported_xruns = xruns;
     }
 }
+
+
+void Speaker::synchronize_timer(void* timer, unsigned long t)
+{
+    ((TimingManager*) timer)->synchronize(t);
+}
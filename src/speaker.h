@@ -10,24 +10,37 @@ namespace ClickTrack
 {
     /* The speaker is an output device. It uses the default output device on
      * your computer, and pushes its data out to portaudio.
+     *
+     * If blocks_ahead is nonzero, the speaker uses PortAudio's callback mode,
+     * and the signal chain may run up to that many blocks ahead of the
+     * device. See OutputStream.
      */
     class Speaker : public AudioConsumer
     {
         public:
             Speaker(TimingManager& timer, unsigned num_inputs = 1, 
-                    bool defaultDevice=true);
+                    bool defaultDevice=true, unsigned blocks_ahead = 0);
+
+            /* Returns how many times the device ran out of queued blocks.
+             * Always zero in blocking mode. These, and the underflows the
+             * driver reports, are passed on to the timer as xruns.
+             */
+            unsigned long get_underflows();
 
         private:
-            void process_inputs(std::vector<SAMPLE>& input, unsigned long t);
+            void process_block(std::vector<const SAMPLE*>& inputs,
+                    unsigned long t);
 
-            /* Store our stream results
-             */
-            std::vector< std::vector<SAMPLE> > buffer;
             OutputStream stream;
 
-            /* The TimingManager used for synchronization
+            /* The TimingManager used for synchronization. In callback mode,
+             * it is synchronized from the driver's thread as each block
+             * plays.
              */
             TimingManager& timer;
+            const bool callback_mode;
+            unsigned long reported_xruns;
+            static void synchronize_timer(void* timer, unsigned long t);
     };
 }
 
@@ -0,0 +1,108 @@
+#ifndef SPSC_RINGBUFFER_CPP
+#define SPSC_RINGBUFFER_CPP
+
+#include <algorithm>
+#include "bit_ops.h"
+#include "spsc_ringbuffer.h"
+
+using namespace ClickTrack;
+
+
+template <class T>
+SpscRingBuffer<T>::SpscRingBuffer(unsigned min_size)
+    : mask(next_power_of_two(min_size)-1), slots(mask+1)
+{
+    producer.index.store(0);
+    producer.cached_other = 0;
+    consumer.index.store(0);
+    consumer.cached_other = 0;
+}
+
+
+template <class T>
+bool SpscRingBuffer<T>::push(const T& item)
+{
+    return push_batch(&item, 1) == 1;
+}
+
+
+template <class T>
+unsigned SpscRingBuffer<T>::push_batch(const T* items, unsigned n)
+{
+    unsigned long tail = producer.index.load(std::memory_order_relaxed);
+
+    // Only look at the consumer's index if our cached copy says we're full
+    unsigned long capacity = mask+1;
+    if(tail - producer.cached_other + n > capacity)
+        producer.cached_other =
+            consumer.index.load(std::memory_order_acquire);
+
+    n = std::min<unsigned long>(n, capacity - (tail - producer.cached_other));
+    for(unsigned i = 0; i < n; i++)
+        slots[(tail + i) & mask] = items[i];
+
+    // Publish the new items
+    producer.index.store(tail + n, std::memory_order_release);
+    return n;
+}
+
+
+template <class T>
+bool SpscRingBuffer<T>::pop(T& item)
+{
+    return pop_batch(&item, 1) == 1;
+}
+
+
+template <class T>
+unsigned SpscRingBuffer<T>::pop_batch(T* items, unsigned max)
+{
+    unsigned long head = consumer.index.load(std::memory_order_relaxed);
+
+    // Only look at the producer's index if our cached copy says we're empty
+    if(consumer.cached_other - head < max)
+        consumer.cached_other =
+            producer.index.load(std::memory_order_acquire);
+
+    unsigned n = std::min<unsigned long>(max, consumer.cached_other - head);
+    for(unsigned i = 0; i < n; i++)
+        items[i] = slots[(head + i) & mask];
+
+    // Hand the slots back to the producer
+    consumer.index.store(head + n, std::memory_order_release);
+    return n;
+}
+
+
+template <class T>
+T* SpscRingBuffer<T>::front()
+{
+    unsigned long head = consumer.index.load(std::memory_order_relaxed);
+    if(consumer.cached_other == head)
+    {
+        consumer.cached_other =
+            producer.index.load(std::memory_order_acquire);
+        if(consumer.cached_other == head)
+            return nullptr;
+    }
+
+    return &slots[head & mask];
+}
+
+
+template <class T>
+unsigned SpscRingBuffer<T>::size()
+{
+    unsigned long head = consumer.index.load(std::memory_order_acquire);
+    unsigned long tail = producer.index.load(std::memory_order_acquire);
+    return tail - head;
+}
+
+
+template <class T>
+unsigned SpscRingBuffer<T>::get_capacity()
+{
+    return mask+1;
+}
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef SPSC_RINGBUFFER_H
+#define SPSC_RINGBUFFER_H
+
+#include <atomic>
+#include <vector>
+
+
+namespace ClickTrack
+{
+    /* SpscRingBuffer is a wait-free queue for handing values from exactly
+     * one producer thread to exactly one consumer thread, such as from a
+     * driver callback to the audio thread. Neither side ever blocks, takes a
+     * lock or allocates.
+     *
+     * All slots are allocated up front, with the capacity rounded up to a
+     * power of two. The read and write indices live on separate cache lines,
+     * and each side keeps a cached copy of the other's index so it only
+     * touches the other side's line when its copy runs out.
+     *
+     * Pushing to a full queue or popping from an empty one fails, and the
+     * caller decides what to do about it.
+     */
+    template <class T>
+    class SpscRingBuffer
+    {
+        public:
+            SpscRingBuffer(unsigned min_size);
+
+            /* Producer side. Batch pushes add as many items as fit, and
+             * return how many that was.
+             */
+            bool push(const T& item);
+            unsigned push_batch(const T* items, unsigned n);
+
+            /* Consumer side. Batch pops return how many items they read.
+             * front returns the next item without popping it, or nullptr if
+             * the queue is empty.
+             */
+            bool pop(T& item);
+            unsigned pop_batch(T* items, unsigned max);
+            T* front();
+
+            /* Either side. The size may be stale by the time it returns.
+             */
+            unsigned size();
+            unsigned get_capacity();
+
+        private:
+            /* Each side's index, and its cached copy of the other side's,
+             * padded out to its own cache line
+             */
+            static const unsigned CACHE_LINE_SIZE = 64;
+            struct Side
+            {
+                std::atomic<unsigned long> index;
+                unsigned long cached_other;
+                char padding[CACHE_LINE_SIZE - sizeof(unsigned long) -
+                    sizeof(std::atomic<unsigned long>)];
+            };
+
+            Side producer; // next slot to write
+            Side consumer; // next slot to read
+
+            const unsigned long mask;
+            std::vector<T> slots;
+    };
+}
+
+#include "spsc_ringbuffer.cpp"
+
+#endif
@@ -4,21 +4,36 @@
 using namespace ClickTrack;
 
 
-SubtractiveSynth::SubtractiveSynth(int num_voices)
+SubtractiveSynth::SubtractiveSynth(int num_voices, VoiceBackend backend)
     : PolyphonicInstrument(num_voices), 
       filter(SecondOrderFilter::LOWPASS, 20000),
       lfo(Oscillator::Sine, 5),
-      volume(-10)
+      volume(-10),
+      voices(),
+      bank(nullptr)
 {
     // Initialize our voices
     std::vector<PolyphonicVoice*> temp;
-    for(unsigned i = 0; i < num_voices; i++)
+    if(backend == VOICE_BANK)
     {
-        SubtractiveSynthVoice* voice = new SubtractiveSynthVoice(this);
-        voices.push_back(voice);
-        temp.push_back(voice);
+        bank = new VoiceBank(num_voices);
+        bank->set_mode(0, Oscillator::Saw);
+        bank->set_mode(1, Oscillator::Saw);
+        bank->set_lfo_input(lfo.get_output_channel());
+        for(unsigned i = 0; i < num_voices; i++)
+            temp.push_back(new BankVoice(this, bank, i));
+        add_voices(temp, bank->get_output_channel());
+    }
+    else
+    {
+        for(unsigned i = 0; i < num_voices; i++)
+        {
+            SubtractiveSynthVoice* voice = new SubtractiveSynthVoice(this);
+            voices.push_back(voice);
+            temp.push_back(voice);
+        }
+        add_voices(temp);
     }
-    add_voices(temp);
 
     // Configure our signal chain
     filter.set_input_channel(PolyphonicInstrument::get_output_channel());
@@ -34,6 +49,12 @@ SubtractiveSynth::SubtractiveSynth(int num_voices)
 }
 
 
+SubtractiveSynth::~SubtractiveSynth()
+{
+    delete bank;
+}
+
+
 AudioChannel* SubtractiveSynth::get_output_channel()
 {
     return volume.get_output_channel();
@@ -50,6 +71,8 @@ void SubtractiveSynth::set_osc1_mode(Oscillator::Mode mode)
 {
     for(auto voice : voices)
         voice->osc1.set_mode(mode);
+    if(bank != nullptr)
+        bank->set_mode(0, mode);
 }
 
 
@@ -57,6 +80,24 @@ void SubtractiveSynth::set_osc2_mode(Oscillator::Mode mode)
 {
     for(auto voice : voices)
         voice->osc2.set_mode(mode);
+    if(bank != nullptr)
+        bank->set_mode(1, mode);
+}
+
+void SubtractiveSynth::set_osc1_wavetable(std::shared_ptr<const Wavetable> table)
+{
+    for(auto voice : voices)
+        voice->osc1.set_wavetable(table);
+    if(bank != nullptr)
+        bank->set_wavetable(0, table);
+}
+
+void SubtractiveSynth::set_osc2_wavetable(std::shared_ptr<const Wavetable> table)
+{
+    for(auto voice : voices)
+        voice->osc2.set_wavetable(table);
+    if(bank != nullptr)
+        bank->set_wavetable(1, table);
 }
 
 
@@ -64,6 +105,8 @@ void SubtractiveSynth::set_osc1_transposition(float steps)
 {
     for(auto voice : voices)
         voice->osc1.set_transposition(steps);
+    if(bank != nullptr)
+        bank->set_transposition(0, steps);
 }
 
 
@@ -71,6 +114,8 @@ void SubtractiveSynth::set_osc2_transposition(float steps)
 {
     for(auto voice : voices)
         voice->osc2.set_transposition(steps);
+    if(bank != nullptr)
+        bank->set_transposition(1, steps);
 }
 
 
@@ -78,6 +123,8 @@ void SubtractiveSynth::set_attack_time(float attack_time)
 {
     for(auto voice : voices)
         voice->adsr.set_attack_time(attack_time);
+    if(bank != nullptr)
+        bank->set_attack_time(attack_time);
 }
 
 
@@ -85,6 +132,8 @@ void SubtractiveSynth::set_decay_time(float decay_time)
 {
     for(auto voice : voices)
         voice->adsr.set_decay_time(decay_time);
+    if(bank != nullptr)
+        bank->set_decay_time(decay_time);
 }
 
 
@@ -92,6 +141,8 @@ void SubtractiveSynth::set_sustain_level(float sustain_level)
 {
     for(auto voice : voices)
         voice->adsr.set_sustain_level(sustain_level);
+    if(bank != nullptr)
+        bank->set_sustain_level(sustain_level);
 }
 
 
@@ -99,6 +150,8 @@ void SubtractiveSynth::set_release_time(float release_time)
 {
     for(auto voice : voices)
         voice->adsr.set_release_time(release_time);
+    if(bank != nullptr)
+        bank->set_release_time(release_time);
 }
 
 
@@ -109,6 +162,12 @@ void SubtractiveSynth::set_lfo_vibrato(float steps)
         voice->osc1.set_lfo_intensity(steps);
         voice->osc2.set_lfo_intensity(steps);
     }
+
+    if(bank != nullptr)
+    {
+        bank->set_lfo_intensity(0, steps);
+        bank->set_lfo_intensity(1, steps);
+    }
 }
 
 
@@ -141,8 +200,7 @@ void SubtractiveSynthVoice::handle_note_down(float velocity)
 {
 
     // Set velocity gain
-    // TODO: change this curve
-    adsr.set_gain(pow(velocity,0.5));
+    adsr.set_gain(midiVelocityToGain(velocity));
 
     // Trigger frequency and ADSR change
     osc1.set_freq(freq*pitch_multiplier);
@@ -162,3 +220,24 @@ void SubtractiveSynthVoice::handle_pitch_wheel(float value)
     osc1.set_freq(freq*pitch_multiplier);
     osc2.set_freq(freq*pitch_multiplier);
 }
+
+
+float SubtractiveSynthVoice::get_level()
+{
+    return adsr.get_level();
+}
+
+
+bool SubtractiveSynthVoice::is_idle()
+{
+    return !playing && adsr.is_silent();
+}
+
+
+void SubtractiveSynthVoice::get_voice_chain(std::vector<AudioGenerator*>& chain)
+{
+    chain.push_back(&osc1);
+    chain.push_back(&osc2);
+    chain.push_back(&adder);
+    chain.push_back(&adsr);
+}
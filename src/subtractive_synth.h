@@ -1,11 +1,13 @@
 #ifndef SUBTRACTIVE_SYNTH_H
 #define SUBTRACTIVE_SYNTH_H
 
+#include "adder.h"
 #include "adsr.h"
 #include "gain_filter.h"
 #include "oscillator.h"
 #include "polyphonic_instrument.h"
 #include "second_order_filter.h"
+#include "voice_bank.h"
 
 
 namespace ClickTrack
@@ -16,10 +18,11 @@ namespace ClickTrack
     class SubtractiveSynth : public PolyphonicInstrument
     {
         public:
-            /* Constructor/destructor. Takes in how many voices to use, as
-             * well as the MIDI channel
+            /* Constructor/destructor. Takes in how many voices to use, and
+             * how to render them
              */
-            SubtractiveSynth(int voices=1);
+            SubtractiveSynth(int voices=1, VoiceBackend backend=OBJECT_VOICES);
+            ~SubtractiveSynth();
 
             /* Override because we have added more signal chain
              */
@@ -35,6 +38,11 @@ namespace ClickTrack
             void set_osc1_mode(Oscillator::Mode mode);
             void set_osc2_mode(Oscillator::Mode mode);
 
+            /* Wavetables played by each oscillator in Table mode
+             */
+            void set_osc1_wavetable(std::shared_ptr<const Wavetable> table);
+            void set_osc2_wavetable(std::shared_ptr<const Wavetable> table);
+
             /* Transposition selection for each oscillator - transpose in
              * arbitrary step intervals
              */
@@ -69,6 +77,10 @@ namespace ClickTrack
             /* Our list of voices so we may set their parameters
              */
             std::vector<SubtractiveSynthVoice*> voices;
+
+            /* Renders all our voices instead when using the voice bank
+             */
+            VoiceBank* bank;
     };
 
 
@@ -91,7 +103,15 @@ namespace ClickTrack
             void handle_note_up();
             void handle_pitch_wheel(float value);
 
+            /* Report the envelope, so quiet voices can be stolen first and
+             * silent voices can sleep
+             */
+            float get_level();
+            bool is_idle();
+
         protected:
+            void get_voice_chain(std::vector<AudioGenerator*>& chain);
+
             /* Define our signal chain
              */
             Oscillator osc1, osc2;
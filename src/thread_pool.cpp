@@ -0,0 +1,156 @@
+#include <chrono>
+#include "thread_pool.h"
+#include "trace.h"
+
+using namespace ClickTrack;
+namespace chr = std::chrono;
+
+
+ThreadPool::ThreadPool(unsigned in_num_workers)
+    : num_workers(in_num_workers), workers(), task(nullptr), arg(nullptr),
+      generation(0), remaining(0), running(true)
+{
+    // One partition for each worker and one for the calling thread
+    partitions = new Partition[num_workers+1];
+    for(unsigned i = 0; i < num_workers+1; i++)
+    {
+        partitions[i].cursor.store(0);
+        partitions[i].end.store(0);
+    }
+
+    for(unsigned i = 0; i < num_workers; i++)
+        workers.push_back(std::thread(&ThreadPool::worker_loop, this, i+1));
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    running.store(false);
+    for(auto& worker : workers)
+        worker.join();
+
+    delete[] partitions;
+}
+
+
+void ThreadPool::run(Task in_task, void* in_arg, unsigned num_tasks)
+{
+    if(num_tasks == 0)
+        return;
+
+    // Publish the batch. The workers only look at it once they see the new
+    // generation, so it must be written first
+    unsigned next_generation = generation.load(std::memory_order_relaxed) + 1;
+    task.store(in_task, std::memory_order_relaxed);
+    arg.store(in_arg, std::memory_order_relaxed);
+    remaining.store(num_tasks, std::memory_order_relaxed);
+
+    // A thread still finishing the last batch may have read a cursor, and be
+    // about to read its end. Move the cursor to an empty claim on the new
+    // generation before the end changes, so a stale claim can never pair the
+    // old cursor with the new end
+    unsigned num_partitions = num_workers+1;
+    unsigned long long tag = (unsigned long long) next_generation << 32;
+    for(unsigned i = 0; i < num_partitions; i++)
+    {
+        unsigned long long begin = (unsigned long long) num_tasks*i /
+            num_partitions;
+        unsigned end = (unsigned long long) num_tasks*(i+1) / num_partitions;
+
+        partitions[i].cursor.store(tag | 0xFFFFFFFF,
+                std::memory_order_relaxed);
+        partitions[i].end.store(end, std::memory_order_release);
+        partitions[i].cursor.store(tag | begin, std::memory_order_release);
+    }
+    generation.store(next_generation, std::memory_order_release);
+
+    // Work alongside the workers, then wait for the stragglers
+    work(0, next_generation);
+    while(remaining.load(std::memory_order_acquire) != 0)
+        std::this_thread::yield();
+}
+
+
+unsigned ThreadPool::get_num_workers()
+{
+    return num_workers;
+}
+
+
+void ThreadPool::worker_loop(unsigned participant)
+{
+    // Spin while batches keep arriving, and only sleep once we have been idle
+    // for a while
+    const chr::milliseconds idle_timeout(50);
+    const chr::milliseconds idle_sleep(1);
+
+    TRACE_THREAD_NAME("audio worker");
+
+    unsigned seen = 0;
+    auto last_batch = chr::steady_clock::now();
+    while(running.load(std::memory_order_relaxed))
+    {
+        unsigned current = generation.load(std::memory_order_acquire);
+        if(current != seen)
+        {
+            seen = current;
+            work(participant, current);
+            last_batch = chr::steady_clock::now();
+        }
+        else if(chr::steady_clock::now() - last_batch < idle_timeout)
+        {
+            std::this_thread::yield();
+        }
+        else
+        {
+            std::this_thread::sleep_for(idle_sleep);
+        }
+    }
+}
+
+
+void ThreadPool::work(unsigned participant, unsigned current)
+{
+    Task current_task = task.load(std::memory_order_relaxed);
+    void* current_arg = arg.load(std::memory_order_relaxed);
+
+    // Drain our own partition, then steal from the others in turn
+    unsigned num_partitions = num_workers+1;
+    for(unsigned i = 0; i < num_partitions; i++)
+    {
+        Partition& partition = partitions[(participant+i) % num_partitions];
+
+        unsigned task_i;
+        while(claim(partition, current, task_i))
+        {
+            current_task(current_arg, task_i);
+            remaining.fetch_sub(1, std::memory_order_release);
+        }
+    }
+}
+
+
+bool ThreadPool::claim(Partition& partition, unsigned current, unsigned& i)
+{
+    unsigned long long cursor = 
+        partition.cursor.load(std::memory_order_acquire);
+    while(true)
+    {
+        // Stop if this partition has moved on to another batch, or is empty
+        if((cursor >> 32) != current)
+            return false;
+
+        // Reading a new end means the cursor has already moved on, so the
+        // exchange below fails
+        unsigned next = cursor & 0xFFFFFFFF;
+        if(next >= partition.end.load(std::memory_order_acquire))
+            return false;
+
+        if(partition.cursor.compare_exchange_weak(cursor, cursor+1,
+                    std::memory_order_acq_rel))
+        {
+            i = next;
+            return true;
+        }
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+
+namespace ClickTrack
+{
+    /* The thread pool runs a batch of independent tasks across a fixed set of
+     * worker threads, and the calling thread. It is built for the audio
+     * thread: all its state is allocated up front, and running a batch never
+     * takes a lock or allocates.
+     *
+     * Each batch is split into one contiguous partition of task indices per
+     * thread. Threads claim tasks from their own partition first, then steal
+     * from the others once theirs is empty, so uneven tasks still balance.
+     *
+     * Idle workers spin while batches are arriving, and fall back to polling
+     * sleeps once the pool has been quiet for a while.
+     */
+    class ThreadPool
+    {
+        public:
+            /* Starts the given number of workers, in addition to the calling
+             * thread
+             */
+            ThreadPool(unsigned num_workers);
+            ~ThreadPool();
+
+            /* Runs task(arg, i) for every i in [0, num_tasks), and returns
+             * once they have all completed. Must only be called from one
+             * thread at a time.
+             */
+            typedef void (*Task)(void* arg, unsigned i);
+            void run(Task task, void* arg, unsigned num_tasks);
+
+            unsigned get_num_workers();
+
+        private:
+            /* Each partition's cursor packs the batch generation into its
+             * upper half, and the next unclaimed task into its lower half.
+             * Claims compare the generation, so a thread still finishing an
+             * old batch can never claim from a new one. The end is only
+             * changed while the cursor holds an empty claim on the new
+             * generation. Partitions are padded to keep threads off each
+             * other's cache lines.
+             */
+            static const unsigned CACHE_LINE_SIZE = 64;
+            struct Partition
+            {
+                std::atomic<unsigned long long> cursor;
+                std::atomic<unsigned> end;
+                char padding[CACHE_LINE_SIZE - sizeof(unsigned long long) -
+                    sizeof(unsigned)];
+            };
+
+            /* Worker threads wait for a new generation, then work on it
+             */
+            void worker_loop(unsigned participant);
+
+            /* Claims and runs tasks from every partition, starting at our own,
+             * until none are left
+             */
+            void work(unsigned participant, unsigned generation);
+            bool claim(Partition& partition, unsigned generation, unsigned& i);
+
+            const unsigned num_workers;
+            std::vector<std::thread> workers;
+            Partition* partitions;
+
+            /* The current batch
+             */
+            std::atomic<Task> task;
+            std::atomic<void*> arg;
+            std::atomic<unsigned> generation;
+            std::atomic<unsigned> remaining;
+            std::atomic<bool> running;
+    };
+}
+
+#endif
@@ -1,4 +1,5 @@
 #include "timing_manager.h"
+#include "trace.h"
 
 using namespace ClickTrack;
 
@@ -7,12 +8,16 @@ TimingManager::TimingManager()
     : rhythm_manager(),
       time(0),
       midi_consumers(), 
-      audio_consumers(),
-      last_sync()
-{
-    // Set unsynced
-    last_sync.synced = false;
-}
+      audio_graph(),
+      profiling(false),
+      was_profiling(false),
+      profiler(),
+      parameter_changes(256),
+      sync_sequence(0),
+      synced(false),
+      sync_sample_time(0),
+      sync_timestamp(0.0)
+{}
 
 
 void TimingManager::add_midi_consumer(MidiConsumer* consumer)
@@ -23,37 +28,138 @@ void TimingManager::add_midi_consumer(MidiConsumer* consumer)
 
 void TimingManager::add_audio_consumer(AudioConsumer* consumer)
 {
-    audio_consumers.push_back(consumer);
+    audio_graph.add_consumer(consumer);
+}
+
+
+void TimingManager::set_num_threads(unsigned num_threads)
+{
+    audio_graph.set_num_threads(num_threads);
 }
 
 
 void TimingManager::tick()
 {
-    // Tick the consumers
+    // Only this thread writes the time
+    unsigned long now = time.load(std::memory_order_relaxed);
+
+    // Tick the MIDI consumers every time step
     for(auto consumer : midi_consumers)
-        consumer->tick(time);
-    for(auto consumer : audio_consumers)
-        consumer->tick(time);
+        consumer->tick(now);
+
+    // Audio is processed one block at a time, at the start of each block,
+    // after any parameter changes posted since the last one
+    if(now % BUFFER_SIZE == 0)
+    {
+        TRACE_THREAD_NAME("audio");
+        TRACE_BEGIN("block", now);
+
+        ParameterChange change;
+        while(parameter_changes.pop(change))
+            change.apply(change.target, change.value);
+
+        // Pick up profiling changes between blocks
+        bool profile = profiling.load(std::memory_order_relaxed);
+        if(profile != was_profiling)
+        {
+            audio_graph.set_profiling(profile);
+            if(profile)
+                profiler.reset();
+            was_profiling = profile;
+        }
+
+        if(profile)
+        {
+            auto start = std::chrono::steady_clock::now();
+            audio_graph.run(now);
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            profiler.end_block(audio_graph,
+                std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+                    .count());
+        }
+        else
+        {
+            audio_graph.run(now);
+        }
+
+        TRACE_END("block", now);
+    }
 
     // Tick time forward
     rhythm_manager.tick();
-    time++;
+    time.store(now+1, std::memory_order_relaxed);
 }
 
 
 unsigned long TimingManager::get_current_time()
 {
-    return time;
+    return time.load(std::memory_order_relaxed);
+}
+
+
+bool TimingManager::post_parameter_change(void (*apply)(void*, float),
+        void* target, float value)
+{
+    return parameter_changes.push({apply, target, value});
+}
+
+
+void TimingManager::set_profiling(bool enabled)
+{
+    profiling.store(enabled, std::memory_order_relaxed);
+}
+
+
+void TimingManager::report_xruns(unsigned long n)
+{
+    profiler.add_xruns(n);
+}
+
+
+DspProfiler::Snapshot TimingManager::get_dsp_snapshot()
+{
+    return profiler.get_snapshot();
 }
 
 
 void TimingManager::synchronize(unsigned long t)
 {
-    last_sync = {true, t, std::chrono::high_resolution_clock::now()};
+    double timestamp = std::chrono::duration<double>(
+            std::chrono::high_resolution_clock::now().time_since_epoch())
+        .count();
+
+    // Mark the status as being written, then write it
+    unsigned sequence = sync_sequence.load(std::memory_order_relaxed);
+    sync_sequence.store(sequence+1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    synced.store(true, std::memory_order_relaxed);
+    sync_sample_time.store(t, std::memory_order_relaxed);
+    sync_timestamp.store(timestamp, std::memory_order_relaxed);
+
+    sync_sequence.store(sequence+2, std::memory_order_release);
 }
 
 
 TimingManager::SynchronizationStatus TimingManager::get_last_synchronization()
 {
-    return last_sync;
+    // Retry until we read the status without a write landing in between
+    SynchronizationStatus status;
+    double timestamp;
+    unsigned before, after;
+    do
+    {
+        before = sync_sequence.load(std::memory_order_acquire);
+
+        status.synced = synced.load(std::memory_order_relaxed);
+        status.sample_time = sync_sample_time.load(std::memory_order_relaxed);
+        timestamp = sync_timestamp.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = sync_sequence.load(std::memory_order_relaxed);
+    } while(before != after || before % 2 == 1);
+
+    status.timestamp = decltype(status.timestamp)(
+            std::chrono::duration<double>(timestamp));
+    return status;
 }
@@ -1,11 +1,15 @@
 #ifndef TIMING_MANGER_H
 #define TIMING_MANGER_H
 
+#include <atomic>
 #include <chrono>
 #include <vector>
 #include "audio_generics.h"
+#include "audio_graph.h"
+#include "dsp_profiler.h"
 #include "generic_instrument.h"
 #include "rhythm_manager.h"
+#include "spsc_ringbuffer.h"
 
 namespace ClickTrack
 {
@@ -30,15 +34,52 @@ namespace ClickTrack
             void add_midi_consumer(MidiConsumer* consumer);
             void add_audio_consumer(AudioConsumer* consumer);
 
-            /* Used to tick the processing one time step forward
+            /* Sets the number of threads used to process audio, including the
+             * thread calling tick. Independent branches of the signal chain,
+             * such as the voices of an instrument, then run in parallel.
+             */
+            void set_num_threads(unsigned num_threads);
+
+            /* Used to tick the processing one time step forward. MIDI is
+             * processed every time step, while audio is processed one block
+             * at a time at the start of each block.
+             *
+             * An event in the middle of a block therefore only changes the
+             * audio from the start of the next block. Sources of events
+             * should schedule them on block boundaries, as MidiListener does,
+             * so the delay does not depend on where in a block they land.
              */
             void tick();
 
-            /* Returns the next time step to be processed
+            /* Returns the next time step to be processed. Safe to call from
+             * any thread.
              */
             unsigned long get_current_time();
 
 
+            /* Parameter changes from a control thread, such as a GUI, are
+             * queued and applied by the audio thread at the start of the next
+             * block, so the audio thread never has to take a lock. The apply
+             * function is called with the target and value.
+             *
+             * The typed overload calls a float setter on the target, e.g.
+             *     timer.post_parameter_change<GainFilter,
+             *         &GainFilter::set_gain>(&gain, -6.0);
+             *
+             * Only one thread may post changes. Returns false if the queue
+             * was full and the change was dropped.
+             */
+            bool post_parameter_change(void (*apply)(void*, float),
+                    void* target, float value);
+
+            template <class Target, void (Target::*Setter)(float)>
+            bool post_parameter_change(Target* target, float value)
+            {
+                return post_parameter_change(
+                        &apply_setter<Target, Setter>, target, value);
+            }
+
+
             /* The timing manager contains a time signature class used to track
              * the current meter and beat status. It is public so that its API
              * is exposed directly.
@@ -49,7 +90,8 @@ namespace ClickTrack
             /* An audio consumer may synchronize the timing manager. This
              * informs the manager that the specified sample time has been
              * written out at the time synchronize is called. This status is
-             * stored with a timestamp, and returned by get_last_synchronziation
+             * stored with a timestamp, and returned by get_last_synchronziation,
+             * which is safe to call from any thread.
              */
             struct SynchronizationStatus
             {
@@ -62,19 +104,62 @@ namespace ClickTrack
             void synchronize(unsigned long t);
             SynchronizationStatus get_last_synchronization();
 
+
+            /* Profiling is off by default. While on, the timing manager
+             * records how long each block and each node of the signal chain
+             * take to run, and the rolling DSP load against the block
+             * deadline. Enabling it restarts the statistics. Audio consumers
+             * report xruns from the sound driver.
+             *
+             * These are safe to call from any thread, so a monitoring thread
+             * may poll the snapshot without disturbing the audio thread.
+             */
+            void set_profiling(bool enabled);
+            void report_xruns(unsigned long n);
+            DspProfiler::Snapshot get_dsp_snapshot();
+
         private:
             /* The next sample time to be processed
              */
-            unsigned long time;
+            std::atomic<unsigned long> time;
 
-            /* Lists of consumers that need processing
+            /* The MIDI consumers that need processing, and the compiled
+             * graph of the audio signal chain
              */
             std::vector<MidiConsumer*> midi_consumers;
-            std::vector<AudioConsumer*> audio_consumers;
+            AudioGraph audio_graph;
+
+            /* Profiling state. The flag is set by any thread, and read once a
+             * block by the audio thread
+             */
+            std::atomic<bool> profiling;
+            bool was_profiling;
+            DspProfiler profiler;
+
+            /* Queued parameter changes
+             */
+            struct ParameterChange
+            {
+                void (*apply)(void*, float);
+                void* target;
+                float value;
+            };
+            SpscRingBuffer<ParameterChange> parameter_changes;
+
+            template <class Target, void (Target::*Setter)(float)>
+            static void apply_setter(void* target, float value)
+            {
+                (static_cast<Target*>(target)->*Setter)(value);
+            }
 
-            /* The last synchronization status
+            /* The last synchronization status. It is written by the audio
+             * thread and read from others, so it is guarded by a sequence
+             * count that is odd while a write is in progress.
              */
-            struct SynchronizationStatus last_sync;
+            std::atomic<unsigned> sync_sequence;
+            std::atomic<bool> synced;
+            std::atomic<unsigned long> sync_sample_time;
+            std::atomic<double> sync_timestamp;
     };
 }
 
@@ -0,0 +1,199 @@
+#ifdef CLICKTRACK_TRACE
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "trace.h"
+
+using namespace ClickTrack;
+namespace chr = std::chrono;
+
+
+namespace
+{
+    /* One recorded event. Times are in nanoseconds since the trace began.
+     */
+    struct Event
+    {
+        const char* name;
+        char phase;
+        unsigned long long time;
+        unsigned long arg;
+    };
+
+    /* Each thread's buffer. Only its own thread writes events, and it
+     * publishes them by bumping the count, so a reader may read up to the
+     * count at any time.
+     */
+    struct ThreadBuffer
+    {
+        ThreadBuffer(unsigned size)
+            : name(nullptr), events(size), count(0), dropped(0)
+        {}
+
+        std::atomic<const char*> name;
+        std::vector<Event> events;
+        std::atomic<unsigned> count;
+        std::atomic<unsigned long> dropped;
+    };
+
+    const chr::steady_clock::time_point trace_start = chr::steady_clock::now();
+
+    /* Every thread's buffer is allocated up front, and claimed in order.
+     * Threads past the last one share an empty buffer, which only counts the
+     * events it drops. Buffers are never reused, as a thread's events outlive
+     * it.
+     */
+    std::vector<ThreadBuffer*> make_buffers()
+    {
+        std::vector<ThreadBuffer*> buffers;
+        for(unsigned i = 0; i < CLICKTRACK_TRACE_THREADS; i++)
+            buffers.push_back(new ThreadBuffer(CLICKTRACK_TRACE_EVENTS));
+        return buffers;
+    }
+
+    const std::vector<ThreadBuffer*> buffers = make_buffers();
+    ThreadBuffer overflow_buffer(0);
+    std::atomic<unsigned> buffers_claimed(0);
+
+    thread_local ThreadBuffer* thread_buffer = nullptr;
+
+
+    ThreadBuffer* get_thread_buffer()
+    {
+        if(thread_buffer == nullptr)
+        {
+            unsigned i = buffers_claimed.fetch_add(1,
+                    std::memory_order_relaxed);
+            thread_buffer = i < buffers.size() ? buffers[i] : &overflow_buffer;
+        }
+        return thread_buffer;
+    }
+
+
+    /* Returns the number of buffers claimed so far
+     */
+    unsigned get_num_claimed()
+    {
+        unsigned claimed = buffers_claimed.load(std::memory_order_relaxed);
+        return claimed < buffers.size() ? claimed : buffers.size();
+    }
+
+
+    /* Returns a printable event name. Nodes are named by their mangled type
+     * names, which start with N or a digit.
+     */
+    std::string display_name(const char* name)
+    {
+        if(name[0] != 'N' && !(name[0] >= '0' && name[0] <= '9'))
+            return name;
+
+        int status;
+        char* demangled = abi::__cxa_demangle(name, NULL, NULL, &status);
+        if(status != 0)
+            return name;
+
+        std::string result(demangled);
+        free(demangled);
+        return result;
+    }
+
+
+    /* Escapes a string for a JSON string literal
+     */
+    std::string escape(const std::string& in)
+    {
+        std::string out;
+        for(char c : in)
+        {
+            if(c == '"' || c == '\\')
+                out += '\\';
+            out += c;
+        }
+        return out;
+    }
+}
+
+
+void Trace::record(const char* name, char phase, unsigned long arg)
+{
+    ThreadBuffer* buffer = get_thread_buffer();
+    unsigned i = buffer->count.load(std::memory_order_relaxed);
+    if(i == buffer->events.size())
+    {
+        buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    unsigned long long time = chr::duration_cast<chr::nanoseconds>(
+            chr::steady_clock::now() - trace_start).count();
+    buffer->events[i] = {name, phase, time, arg};
+    buffer->count.store(i+1, std::memory_order_release);
+}
+
+
+void Trace::set_thread_name(const char* name)
+{
+    get_thread_buffer()->name.store(name, std::memory_order_relaxed);
+}
+
+
+bool Trace::write_json(const char* filename)
+{
+    std::ofstream file(filename);
+    if(!file)
+        return false;
+
+    file << "{\"traceEvents\":[";
+    bool first = true;
+    for(unsigned id = 0; id < get_num_claimed(); id++)
+    {
+        const ThreadBuffer* buffer = buffers[id];
+
+        // Name the thread, then write out its events
+        const char* name = buffer->name.load(std::memory_order_relaxed);
+        if(name != nullptr)
+        {
+            file << (first ? "\n" : ",\n") <<
+                "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" <<
+                id << ",\"args\":{\"name\":\"" << escape(name) <<
+                "\"}}";
+            first = false;
+        }
+
+        unsigned count = buffer->count.load(std::memory_order_acquire);
+        for(unsigned i = 0; i < count; i++)
+        {
+            const Event& event = buffer->events[i];
+            file << (first ? "\n" : ",\n") <<
+                "{\"name\":\"" << escape(display_name(event.name)) <<
+                "\",\"ph\":\"" << event.phase << "\"," <<
+                (event.phase == 'i' ? "\"s\":\"t\"," : "") <<
+                "\"ts\":" << event.time/1000 << "." <<
+                    (event.time%1000)/100 << (event.time%100)/10 <<
+                    event.time%10 <<
+                ",\"pid\":0,\"tid\":" << id <<
+                ",\"args\":{\"t\":" << event.arg << "}}";
+            first = false;
+        }
+    }
+    file << "\n],\"displayTimeUnit\":\"ns\"}\n";
+
+    return (bool) file;
+}
+
+
+unsigned long Trace::get_dropped_events()
+{
+    unsigned long dropped =
+        overflow_buffer.dropped.load(std::memory_order_relaxed);
+    for(unsigned id = 0; id < get_num_claimed(); id++)
+        dropped += buffers[id]->dropped.load(std::memory_order_relaxed);
+    return dropped;
+}
+
+#endif
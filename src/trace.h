@@ -0,0 +1,76 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/* Tracing records a timeline of begin and end events for each block, each
+ * node of the signal chain and each MIDI event, and writes it out as Chrome
+ * trace-event JSON. It can be opened in a trace viewer such as
+ * chrome://tracing or Perfetto, to find the blocks behind a spike.
+ *
+ * Tracing is compiled out completely unless CLICKTRACK_TRACE is defined, e.g.
+ * by building with `make clean; make TRACE=1`. Then the macros below expand
+ * to nothing.
+ *
+ * Each thread records into its own buffer of CLICKTRACK_TRACE_EVENTS events.
+ * There are CLICKTRACK_TRACE_THREADS buffers, all allocated when the program
+ * starts, so recording never allocates or takes a lock. A thread claims a
+ * buffer on its first event or when it is named. Events on threads past that
+ * limit, or past the end of a full buffer, are dropped. Every event carries
+ * an argument, usually the sample time of the block or MIDI event, so MIDI
+ * timestamps line up with the blocks that played them.
+ *
+ * Event and thread names are not copied, so they must outlive the trace.
+ */
+#ifdef CLICKTRACK_TRACE
+
+#define TRACE_BEGIN(name, arg) ClickTrack::Trace::record((name), 'B', (arg))
+#define TRACE_END(name, arg) ClickTrack::Trace::record((name), 'E', (arg))
+#define TRACE_INSTANT(name, arg) ClickTrack::Trace::record((name), 'i', (arg))
+#define TRACE_THREAD_NAME(name) ClickTrack::Trace::set_thread_name(name)
+#define TRACE_WRITE(filename) ClickTrack::Trace::write_json(filename)
+
+#ifndef CLICKTRACK_TRACE_EVENTS
+#define CLICKTRACK_TRACE_EVENTS (1 << 16)
+#endif
+
+#ifndef CLICKTRACK_TRACE_THREADS
+#define CLICKTRACK_TRACE_THREADS 8
+#endif
+
+namespace ClickTrack
+{
+    namespace Trace
+    {
+        /* Records one event on the calling thread. The phase is one of the
+         * trace-event phases: 'B' begins a span, 'E' ends the innermost
+         * span, and 'i' marks an instant.
+         */
+        void record(const char* name, char phase, unsigned long arg);
+
+        /* Names the calling thread on the timeline, claiming its buffer if
+         * it does not have one yet
+         */
+        void set_thread_name(const char* name);
+
+        /* Writes every thread's events so far to the given file. Safe to
+         * call while other threads are recording. Returns false if the file
+         * could not be written.
+         */
+        bool write_json(const char* filename);
+
+        /* Returns the number of events dropped because a buffer was full
+         */
+        unsigned long get_dropped_events();
+    }
+}
+
+#else
+
+#define TRACE_BEGIN(name, arg) ((void) 0)
+#define TRACE_END(name, arg) ((void) 0)
+#define TRACE_INSTANT(name, arg) ((void) 0)
+#define TRACE_THREAD_NAME(name) ((void) 0)
+#define TRACE_WRITE(filename) ((void) 0)
+
+#endif
+
+#endif
@@ -0,0 +1,118 @@
+#include <algorithm>
+#include "uniform_convolver.h"
+#include "vector_ops.h"
+
+using namespace ClickTrack;
+
+
+UniformConvolver::UniformConvolver(unsigned in_partition_size,
+        const SAMPLE* impulse, unsigned impulse_length)
+    : partition_size(in_partition_size),
+      num_bins(partition_size+1),
+      num_partitions(std::max(1u,
+                  (impulse_length + partition_size - 1) / partition_size)),
+      transformer(2*partition_size),
+
+      impulse_real(num_partitions*num_bins),
+      impulse_imag(num_partitions*num_bins),
+      fdl_real(num_partitions*num_bins),
+      fdl_imag(num_partitions*num_bins),
+      fdl_head(0),
+
+      input_buffer(2*partition_size),
+      output_buffer(2*partition_size),
+      spectrum(num_bins),
+      accumulator_real(num_bins),
+      accumulator_imag(num_bins)
+{
+    // Transform each partition of the impulse response, zero padded to twice
+    // its length so the circular convolution doesn't wrap around
+    for(unsigned i = 0; i < num_partitions; i++)
+    {
+        for(unsigned j = 0; j < partition_size; j++)
+        {
+            unsigned t = i*partition_size + j;
+            input_buffer[j] = t < impulse_length ? impulse[t] : 0.0;
+        }
+
+        transformer.rfft(&input_buffer[0], &spectrum[0]);
+        for(unsigned k = 0; k < num_bins; k++)
+        {
+            impulse_real[i*num_bins + k] = spectrum[k].real();
+            impulse_imag[i*num_bins + k] = spectrum[k].imag();
+        }
+    }
+
+    reset();
+}
+
+
+void UniformConvolver::process(const SAMPLE* input, SAMPLE* output)
+{
+    // Slide the input window along by one partition and transform it
+    std::copy(input_buffer.begin() + partition_size, input_buffer.end(),
+            input_buffer.begin());
+    std::copy(input, input + partition_size,
+            input_buffer.begin() + partition_size);
+    transformer.rfft(&input_buffer[0], &spectrum[0]);
+
+    // Push it onto the delay line
+    fdl_head = (fdl_head + 1) % num_partitions;
+    SAMPLE* newest_real = &fdl_real[fdl_head*num_bins];
+    SAMPLE* newest_imag = &fdl_imag[fdl_head*num_bins];
+    for(unsigned k = 0; k < num_bins; k++)
+    {
+        newest_real[k] = spectrum[k].real();
+        newest_imag[k] = spectrum[k].imag();
+    }
+
+    // Multiply each impulse partition with the input from that many blocks
+    // ago, and accumulate the result
+    std::fill(accumulator_real.begin(), accumulator_real.end(), 0.0);
+    std::fill(accumulator_imag.begin(), accumulator_imag.end(), 0.0);
+    for(unsigned i = 0; i < num_partitions; i++)
+    {
+        unsigned row = (fdl_head + num_partitions - i) % num_partitions;
+        complex_multiply_accumulate(
+                &fdl_real[row*num_bins], &fdl_imag[row*num_bins],
+                &impulse_real[i*num_bins], &impulse_imag[i*num_bins],
+                &accumulator_real[0], &accumulator_imag[0], num_bins);
+    }
+
+    // Return to the time domain. The first half of the window has wrapped
+    // around, so we only keep the second half.
+    for(unsigned k = 0; k < num_bins; k++)
+        spectrum[k] = std::complex<SAMPLE>(accumulator_real[k],
+                accumulator_imag[k]);
+    transformer.irfft(&spectrum[0], &output_buffer[0]);
+
+    std::copy(output_buffer.begin() + partition_size, output_buffer.end(),
+            output);
+}
+
+
+void UniformConvolver::reset()
+{
+    std::fill(fdl_real.begin(), fdl_real.end(), 0.0);
+    std::fill(fdl_imag.begin(), fdl_imag.end(), 0.0);
+    std::fill(input_buffer.begin(), input_buffer.end(), 0.0);
+    fdl_head = 0;
+}
+
+
+unsigned UniformConvolver::get_block_size()
+{
+    return partition_size;
+}
+
+
+unsigned UniformConvolver::get_partition_size()
+{
+    return partition_size;
+}
+
+
+unsigned UniformConvolver::get_num_partitions()
+{
+    return num_partitions;
+}
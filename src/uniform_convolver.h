@@ -0,0 +1,74 @@
+#ifndef UNIFORM_CONVOLVER_H
+#define UNIFORM_CONVOLVER_H
+
+#include <complex>
+#include <vector>
+#include "convolver.h"
+#include "fft.h"
+
+
+namespace ClickTrack
+{
+    /* The UniformConvolver computes the linear convolution of a stream with a
+     * fixed impulse response, one partition of samples at a time.
+     *
+     * It uses uniformly partitioned overlap-save: the impulse response is cut
+     * into partitions of the same length as the input blocks, and each is
+     * transformed once up front. Every block of input is transformed once and
+     * pushed onto a frequency domain delay line. The output spectrum is then
+     * the sum over partitions of each impulse spectrum times the input
+     * spectrum from that many blocks ago, followed by a single inverse
+     * transform.
+     *
+     * Spectra are stored as half spectra of real signals, split into real and
+     * imaginary arrays, with the whole delay line in one contiguous buffer so
+     * the multiply-accumulate streams straight through memory.
+     *
+     * Each output block depends on its own input block, so the convolver adds
+     * no latency beyond having to wait for a whole block of input.
+     */
+    class UniformConvolver : public Convolver
+    {
+        public:
+            /* The partition size must be a power of two.
+             */
+            UniformConvolver(unsigned partition_size, const SAMPLE* impulse,
+                    unsigned impulse_length);
+
+            /* Blocks are one partition long
+             */
+            void process(const SAMPLE* input, SAMPLE* output);
+            unsigned get_block_size();
+
+            /* Clears the delay line, as if only silence had been processed.
+             */
+            void reset();
+
+            unsigned get_partition_size();
+            unsigned get_num_partitions();
+
+        private:
+            const unsigned partition_size;
+            const unsigned num_bins;
+            const unsigned num_partitions;
+            Transformer transformer;
+
+            // Impulse response spectra and the delay line of input spectra,
+            // each num_partitions rows of num_bins bins. The newest input
+            // spectrum lives in row fdl_head.
+            std::vector<SAMPLE> impulse_real;
+            std::vector<SAMPLE> impulse_imag;
+            std::vector<SAMPLE> fdl_real;
+            std::vector<SAMPLE> fdl_imag;
+            unsigned fdl_head;
+
+            // Preallocate buffers for speed
+            std::vector<SAMPLE> input_buffer;
+            std::vector<SAMPLE> output_buffer;
+            std::vector< std::complex<SAMPLE> > spectrum;
+            std::vector<SAMPLE> accumulator_real;
+            std::vector<SAMPLE> accumulator_imag;
+    };
+}
+
+#endif
@@ -0,0 +1,465 @@
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include "vector_ops.h"
+
+using namespace ClickTrack;
+
+
+void ClickTrack::complex_multiply_accumulate(
+        const SAMPLE* a_real, const SAMPLE* a_imag,
+        const SAMPLE* b_real, const SAMPLE* b_imag,
+        SAMPLE* out_real, SAMPLE* out_imag, unsigned n)
+{
+    unsigned i = 0;
+
+#ifdef __SSE__
+    // Four bins at a time
+    for(; i+4 <= n; i += 4)
+    {
+        __m128 ar = _mm_loadu_ps(a_real+i);
+        __m128 ai = _mm_loadu_ps(a_imag+i);
+        __m128 br = _mm_loadu_ps(b_real+i);
+        __m128 bi = _mm_loadu_ps(b_imag+i);
+
+        __m128 real = _mm_sub_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi));
+        __m128 imag = _mm_add_ps(_mm_mul_ps(ar, bi), _mm_mul_ps(ai, br));
+
+        _mm_storeu_ps(out_real+i, _mm_add_ps(_mm_loadu_ps(out_real+i), real));
+        _mm_storeu_ps(out_imag+i, _mm_add_ps(_mm_loadu_ps(out_imag+i), imag));
+    }
+#endif
+
+    // Finish off the remainder
+    for(; i < n; i++)
+    {
+        out_real[i] += a_real[i]*b_real[i] - a_imag[i]*b_imag[i];
+        out_imag[i] += a_real[i]*b_imag[i] + a_imag[i]*b_real[i];
+    }
+}
+
+
+void ClickTrack::multiply_accumulate(const SAMPLE* in, SAMPLE gain,
+        SAMPLE* out, unsigned n)
+{
+    unsigned i = 0;
+
+#ifdef __SSE__
+    __m128 g = _mm_set1_ps(gain);
+    for(; i+4 <= n; i += 4)
+        _mm_storeu_ps(out+i, _mm_add_ps(_mm_loadu_ps(out+i),
+                    _mm_mul_ps(g, _mm_loadu_ps(in+i))));
+#endif
+
+    for(; i < n; i++)
+        out[i] += gain*in[i];
+}
+
+
+SAMPLE ClickTrack::dot_product(const SAMPLE* a, const SAMPLE* b, unsigned n)
+{
+    unsigned i = 0;
+    SAMPLE result = 0.0;
+
+#ifdef __SSE__
+    // Keep four running sums, and combine them at the end
+    __m128 sums = _mm_setzero_ps();
+    for(; i+4 <= n; i += 4)
+        sums = _mm_add_ps(sums,
+                _mm_mul_ps(_mm_loadu_ps(a+i), _mm_loadu_ps(b+i)));
+
+    SAMPLE partial[4];
+    _mm_storeu_ps(partial, sums);
+    result = (partial[0] + partial[1]) + (partial[2] + partial[3]);
+#endif
+
+    // Finish off the remainder
+    for(; i < n; i++)
+        result += a[i]*b[i];
+
+    return result;
+}
+
+
+/* Clamp to [-1, 1] only if asked, at compile time
+ */
+template <bool CLAMP>
+static inline SAMPLE clamp_sample(SAMPLE x)
+{
+    return CLAMP ? std::min(std::max(x, -1.0f), 1.0f) : x;
+}
+
+#ifdef __SSE__
+template <bool CLAMP>
+static inline __m128 clamp_vector(__m128 x)
+{
+    return CLAMP ? _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-1.0f)),
+            _mm_set1_ps(1.0f)) : x;
+}
+#endif
+
+
+/* Shared body of interleave and interleave_clamp, so the clamp costs
+ * nothing when it is not wanted
+ */
+template <bool CLAMP>
+static void interleave_channels(const SAMPLE* const* in,
+        unsigned num_channels, SAMPLE* out, unsigned n)
+{
+    const unsigned stride = num_channels;
+    unsigned c = 0;
+
+#ifdef __SSE__
+    // Four channels at a time, transposing four frames at once so each frame
+    // is written with one store
+    for(; c+4 <= num_channels; c += 4)
+    {
+        unsigned i = 0;
+        for(; i+4 <= n; i += 4)
+        {
+            __m128 r0 = _mm_loadu_ps(in[c]+i);
+            __m128 r1 = _mm_loadu_ps(in[c+1]+i);
+            __m128 r2 = _mm_loadu_ps(in[c+2]+i);
+            __m128 r3 = _mm_loadu_ps(in[c+3]+i);
+            r0 = clamp_vector<CLAMP>(r0);
+            r1 = clamp_vector<CLAMP>(r1);
+            r2 = clamp_vector<CLAMP>(r2);
+            r3 = clamp_vector<CLAMP>(r3);
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+            _mm_storeu_ps(out + i*stride + c, r0);
+            _mm_storeu_ps(out + (i+1)*stride + c, r1);
+            _mm_storeu_ps(out + (i+2)*stride + c, r2);
+            _mm_storeu_ps(out + (i+3)*stride + c, r3);
+        }
+        for(; i < n; i++)
+            for(unsigned j = c; j < c+4; j++)
+                out[i*stride + j] = clamp_sample<CLAMP>(in[j][i]);
+    }
+
+    // Then a pair of channels, such as plain stereo
+    for(; c+2 <= num_channels; c += 2)
+    {
+        unsigned i = 0;
+        for(; i+4 <= n; i += 4)
+        {
+            __m128 a = clamp_vector<CLAMP>(_mm_loadu_ps(in[c]+i));
+            __m128 b = clamp_vector<CLAMP>(_mm_loadu_ps(in[c+1]+i));
+            __m128 first = _mm_unpacklo_ps(a, b);
+            __m128 second = _mm_unpackhi_ps(a, b);
+
+            _mm_storel_pi((__m64*) (out + i*stride + c), first);
+            _mm_storeh_pi((__m64*) (out + (i+1)*stride + c), first);
+            _mm_storel_pi((__m64*) (out + (i+2)*stride + c), second);
+            _mm_storeh_pi((__m64*) (out + (i+3)*stride + c), second);
+        }
+        for(; i < n; i++)
+            for(unsigned j = c; j < c+2; j++)
+                out[i*stride + j] = clamp_sample<CLAMP>(in[j][i]);
+    }
+#endif
+
+    // Finish off the remaining channels one at a time
+    for(; c < num_channels; c++)
+        for(unsigned i = 0; i < n; i++)
+            out[i*stride + c] = clamp_sample<CLAMP>(in[c][i]);
+}
+
+
+void ClickTrack::interleave(const SAMPLE* const* in, unsigned num_channels,
+        SAMPLE* out, unsigned n)
+{
+    interleave_channels<false>(in, num_channels, out, n);
+}
+
+
+void ClickTrack::interleave_clamp(const SAMPLE* const* in,
+        unsigned num_channels, SAMPLE* out, unsigned n)
+{
+    interleave_channels<true>(in, num_channels, out, n);
+}
+
+
+void ClickTrack::deinterleave(const SAMPLE* in, unsigned num_channels,
+        SAMPLE* const* out, unsigned n)
+{
+    const unsigned stride = num_channels;
+    unsigned c = 0;
+
+#ifdef __SSE__
+    // Four channels at a time, reading four frames and transposing them
+    for(; c+4 <= num_channels; c += 4)
+    {
+        unsigned i = 0;
+        for(; i+4 <= n; i += 4)
+        {
+            __m128 r0 = _mm_loadu_ps(in + i*stride + c);
+            __m128 r1 = _mm_loadu_ps(in + (i+1)*stride + c);
+            __m128 r2 = _mm_loadu_ps(in + (i+2)*stride + c);
+            __m128 r3 = _mm_loadu_ps(in + (i+3)*stride + c);
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+            _mm_storeu_ps(out[c]+i, r0);
+            _mm_storeu_ps(out[c+1]+i, r1);
+            _mm_storeu_ps(out[c+2]+i, r2);
+            _mm_storeu_ps(out[c+3]+i, r3);
+        }
+        for(; i < n; i++)
+            for(unsigned j = c; j < c+4; j++)
+                out[j][i] = in[i*stride + j];
+    }
+
+    // Then a pair of channels
+    for(; c+2 <= num_channels; c += 2)
+    {
+        unsigned i = 0;
+        for(; i+4 <= n; i += 4)
+        {
+            __m128 first = _mm_setzero_ps();
+            __m128 second = _mm_setzero_ps();
+            first = _mm_loadl_pi(first, (const __m64*) (in + i*stride + c));
+            first = _mm_loadh_pi(first,
+                    (const __m64*) (in + (i+1)*stride + c));
+            second = _mm_loadl_pi(second,
+                    (const __m64*) (in + (i+2)*stride + c));
+            second = _mm_loadh_pi(second,
+                    (const __m64*) (in + (i+3)*stride + c));
+
+            _mm_storeu_ps(out[c]+i,
+                    _mm_shuffle_ps(first, second, _MM_SHUFFLE(2,0,2,0)));
+            _mm_storeu_ps(out[c+1]+i,
+                    _mm_shuffle_ps(first, second, _MM_SHUFFLE(3,1,3,1)));
+        }
+        for(; i < n; i++)
+            for(unsigned j = c; j < c+2; j++)
+                out[j][i] = in[i*stride + j];
+    }
+#endif
+
+    // Finish off the remaining channels one at a time
+    for(; c < num_channels; c++)
+        for(unsigned i = 0; i < n; i++)
+            out[c][i] = in[i*stride + c];
+}
+
+
+void ClickTrack::decode_pcm8(const unsigned char* in, SAMPLE* out, unsigned n)
+{
+    unsigned i = 0;
+
+#ifdef __SSE2__
+    // Sixteen at a time, widening the unsigned bytes to ints
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i offset = _mm_set1_epi32(128);
+    const __m128 scale = _mm_set1_ps(1.0f/128);
+    for(; i+16 <= n; i += 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i*) (in+i));
+        __m128i low = _mm_unpacklo_epi8(bytes, zero);
+        __m128i high = _mm_unpackhi_epi8(bytes, zero);
+
+        __m128i words[4] = {
+            _mm_unpacklo_epi16(low, zero), _mm_unpackhi_epi16(low, zero),
+            _mm_unpacklo_epi16(high, zero), _mm_unpackhi_epi16(high, zero)
+        };
+        for(unsigned j = 0; j < 4; j++)
+            _mm_storeu_ps(out+i+4*j, _mm_mul_ps(scale,
+                        _mm_cvtepi32_ps(_mm_sub_epi32(words[j], offset))));
+    }
+#endif
+
+    // 8-bit wav files are unsigned, centered on 128
+    for(; i < n; i++)
+        out[i] = ((SAMPLE) in[i] - 128) / 128;
+}
+
+
+void ClickTrack::decode_pcm16(const unsigned char* in, SAMPLE* out,
+        unsigned n)
+{
+    unsigned i = 0;
+
+#ifdef __SSE2__
+    // Eight at a time, sign extending by moving each value into the high
+    // half of an int and shifting it back down
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 scale = _mm_set1_ps(1.0f/32768);
+    for(; i+8 <= n; i += 8)
+    {
+        __m128i values = _mm_loadu_si128((const __m128i*) (in+2*i));
+        __m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(zero, values), 16);
+        __m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(zero, values), 16);
+        _mm_storeu_ps(out+i, _mm_mul_ps(scale, _mm_cvtepi32_ps(low)));
+        _mm_storeu_ps(out+i+4, _mm_mul_ps(scale, _mm_cvtepi32_ps(high)));
+    }
+#endif
+
+    for(; i < n; i++)
+    {
+        int16_t value;
+        memcpy(&value, in+2*i, 2);
+        out[i] = (SAMPLE) value / 32768;
+    }
+}
+
+
+void ClickTrack::decode_pcm24(const unsigned char* in, SAMPLE* out,
+        unsigned n)
+{
+    unsigned i = 0;
+
+#ifdef __SSE2__
+    // Four at a time. Each 32 bit load picks up one value in its low three
+    // bytes; shifting it to the top leaves a full scale 32 bit sample. The
+    // last load reads one byte past the group, so stop a value early.
+    const __m128 scale = _mm_set1_ps(1.0f/2147483648.0f);
+    for(; i+5 <= n; i += 4)
+    {
+        int32_t words[4];
+        for(unsigned j = 0; j < 4; j++)
+            memcpy(&words[j], in+3*(i+j), 4);
+
+        __m128i values = _mm_slli_epi32(
+                _mm_loadu_si128((const __m128i*) words), 8);
+        _mm_storeu_ps(out+i, _mm_mul_ps(scale, _mm_cvtepi32_ps(values)));
+    }
+#endif
+
+    for(; i < n; i++)
+    {
+        const unsigned char* bytes = in+3*i;
+        int32_t value = (int32_t) ((uint32_t) bytes[0] << 8 |
+                (uint32_t) bytes[1] << 16 | (uint32_t) bytes[2] << 24);
+        out[i] = (SAMPLE) value / 2147483648.0f;
+    }
+}
+
+
+void ClickTrack::decode_pcm32(const unsigned char* in, SAMPLE* out,
+        unsigned n)
+{
+    unsigned i = 0;
+
+#ifdef __SSE2__
+    const __m128 scale = _mm_set1_ps(1.0f/2147483648.0f);
+    for(; i+4 <= n; i += 4)
+        _mm_storeu_ps(out+i, _mm_mul_ps(scale, _mm_cvtepi32_ps(
+                        _mm_loadu_si128((const __m128i*) (in+4*i)))));
+#endif
+
+    for(; i < n; i++)
+    {
+        int32_t value;
+        memcpy(&value, in+4*i, 4);
+        out[i] = (SAMPLE) value / 2147483648.0f;
+    }
+}
+
+
+void ClickTrack::decode_float32(const unsigned char* in, SAMPLE* out,
+        unsigned n)
+{
+    memcpy(out, in, n*sizeof(float));
+}
+
+
+void ClickTrack::decode_float64(const unsigned char* in, SAMPLE* out,
+        unsigned n)
+{
+    unsigned i = 0;
+
+#ifdef __SSE2__
+    for(; i+4 <= n; i += 4)
+    {
+        __m128 low = _mm_cvtpd_ps(_mm_loadu_pd((const double*) (in+8*i)));
+        __m128 high = _mm_cvtpd_ps(_mm_loadu_pd((const double*) (in+8*i+16)));
+        _mm_storeu_ps(out+i, _mm_movelh_ps(low, high));
+    }
+#endif
+
+    for(; i < n; i++)
+    {
+        double value;
+        memcpy(&value, in+8*i, 8);
+        out[i] = (SAMPLE) value;
+    }
+}
+
+
+void ClickTrack::encode_pcm16(const SAMPLE* in, unsigned char* out,
+        unsigned n)
+{
+    // Scale to match the decoder, so 1.0 itself clamps to the top step
+    const SAMPLE low = -1.0f;
+    const SAMPLE high = 32767.0f/32768;
+    unsigned i = 0;
+
+#ifdef __SSE2__
+    // Eight at a time
+    const __m128 low4 = _mm_set1_ps(low);
+    const __m128 high4 = _mm_set1_ps(high);
+    const __m128 scale = _mm_set1_ps(32768.0f);
+    for(; i+8 <= n; i += 8)
+    {
+        __m128 a = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in+i), low4), high4);
+        __m128 b = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in+i+4), low4), high4);
+        __m128i values = _mm_packs_epi32(
+                _mm_cvtps_epi32(_mm_mul_ps(a, scale)),
+                _mm_cvtps_epi32(_mm_mul_ps(b, scale)));
+        _mm_storeu_si128((__m128i*) (out+2*i), values);
+    }
+#endif
+
+    for(; i < n; i++)
+    {
+        int16_t value = (int16_t) lrintf(
+                std::min(std::max(in[i], low), high) * 32768.0f);
+        memcpy(out+2*i, &value, 2);
+    }
+}
+
+
+void ClickTrack::encode_pcm24(const SAMPLE* in, unsigned char* out,
+        unsigned n)
+{
+    const SAMPLE low = -1.0f;
+    const SAMPLE high = 8388607.0f/8388608;
+    unsigned i = 0;
+
+#ifdef __SSE2__
+    // Convert four at a time, then pack the low three bytes of each
+    const __m128 low4 = _mm_set1_ps(low);
+    const __m128 high4 = _mm_set1_ps(high);
+    const __m128 scale = _mm_set1_ps(8388608.0f);
+    for(; i+4 <= n; i += 4)
+    {
+        __m128 x = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in+i), low4), high4);
+        int32_t values[4];
+        _mm_storeu_si128((__m128i*) values,
+                _mm_cvtps_epi32(_mm_mul_ps(x, scale)));
+        for(unsigned j = 0; j < 4; j++)
+            memcpy(out+3*(i+j), &values[j], 3);
+    }
+#endif
+
+    for(; i < n; i++)
+    {
+        int32_t value = (int32_t) lrintf(
+                std::min(std::max(in[i], low), high) * 8388608.0f);
+        memcpy(out+3*i, &value, 3);
+    }
+}
+
+
+void ClickTrack::encode_float32(const SAMPLE* in, unsigned char* out,
+        unsigned n)
+{
+    memcpy(out, in, n*sizeof(float));
+}
@@ -0,0 +1,69 @@
+#ifndef VECTOR_OPS_H
+#define VECTOR_OPS_H
+
+#include "portaudio_wrapper.h"
+
+
+namespace ClickTrack
+{
+    /* Vectorized kernels for the inner loops of our DSP. Each kernel works on
+     * contiguous arrays of n elements, uses SSE when it is available, and
+     * falls back to plain loops otherwise. Arrays need not be aligned.
+     */
+
+    /* Complex multiply-accumulate over split real and imaginary arrays:
+     *      out[i] += a[i] * b[i]
+     */
+    void complex_multiply_accumulate(const SAMPLE* a_real, const SAMPLE* a_imag,
+            const SAMPLE* b_real, const SAMPLE* b_imag,
+            SAMPLE* out_real, SAMPLE* out_imag, unsigned n);
+
+    /* Scaled accumulate:
+     *      out[i] += gain * in[i]
+     */
+    void multiply_accumulate(const SAMPLE* in, SAMPLE gain, SAMPLE* out,
+            unsigned n);
+
+    /* Returns the sum of a[i] * b[i]
+     */
+    SAMPLE dot_product(const SAMPLE* a, const SAMPLE* b, unsigned n);
+
+    /* Interleaves n frames of num_channels separate channels into one
+     * array:
+     *      out[i*num_channels + c] = in[c][i]
+     * The clamping version also clamps each sample to [-1, 1] for the sound
+     * card.
+     */
+    void interleave(const SAMPLE* const* in, unsigned num_channels,
+            SAMPLE* out, unsigned n);
+    void interleave_clamp(const SAMPLE* const* in, unsigned num_channels,
+            SAMPLE* out, unsigned n);
+
+    /* Splits n interleaved frames of num_channels back into separate
+     * channels:
+     *      out[c][i] = in[i*num_channels + c]
+     */
+    void deinterleave(const SAMPLE* in, unsigned num_channels,
+            SAMPLE* const* out, unsigned n);
+
+    /* Decoders from little-endian PCM bytes to samples in [-1, 1). Each
+     * reads n values packed back to back, so interleaved audio comes out
+     * still interleaved. The input need not be aligned.
+     */
+    void decode_pcm8(const unsigned char* in, SAMPLE* out, unsigned n);
+    void decode_pcm16(const unsigned char* in, SAMPLE* out, unsigned n);
+    void decode_pcm24(const unsigned char* in, SAMPLE* out, unsigned n);
+    void decode_pcm32(const unsigned char* in, SAMPLE* out, unsigned n);
+    void decode_float32(const unsigned char* in, SAMPLE* out, unsigned n);
+    void decode_float64(const unsigned char* in, SAMPLE* out, unsigned n);
+
+    /* Encoders from samples to little-endian PCM bytes, the inverse of the
+     * decoders above. Integer encoders clamp to [-1, 1), the range the
+     * decoders produce, and round to the nearest step. Float samples are stored as they are.
+     */
+    void encode_pcm16(const SAMPLE* in, unsigned char* out, unsigned n);
+    void encode_pcm24(const SAMPLE* in, unsigned char* out, unsigned n);
+    void encode_float32(const SAMPLE* in, unsigned char* out, unsigned n);
+}
+
+#endif
@@ -0,0 +1,652 @@
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include "voice_bank.h"
+
+using namespace ClickTrack;
+
+
+static const float TWO_PI = 2*M_PI;
+static const float TWO_PI_ERROR = 2*M_PI - TWO_PI;
+
+
+#ifdef __SSE2__
+/* Lane helpers. Masks come from the comparison intrinsics.
+ */
+static inline __m128 select(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+
+/* Sine of any phase, to within a few parts in 10^7. The phase is wrapped
+ * into [-pi, pi] and folded into [-pi/2, pi/2] before a Taylor series.
+ */
+static inline __m128 sine(__m128 x)
+{
+    const __m128 pi = _mm_set1_ps(M_PI);
+    const __m128 half_pi = _mm_set1_ps(M_PI/2);
+    const __m128 neg_half_pi = _mm_set1_ps(-M_PI/2);
+
+    __m128 turns = _mm_cvtepi32_ps(_mm_cvtps_epi32(
+                _mm_mul_ps(x, _mm_set1_ps(1/(2*M_PI)))));
+    x = _mm_sub_ps(x, _mm_mul_ps(turns, _mm_set1_ps(TWO_PI)));
+    x = select(_mm_cmpgt_ps(x, half_pi), _mm_sub_ps(pi, x), x);
+    x = select(_mm_cmplt_ps(x, neg_half_pi),
+            _mm_sub_ps(_mm_sub_ps(_mm_setzero_ps(), pi), x), x);
+
+    __m128 x2 = _mm_mul_ps(x, x);
+    __m128 sum = _mm_set1_ps(-1.0/39916800);
+    sum = _mm_add_ps(_mm_mul_ps(sum, x2), _mm_set1_ps(1.0/362880));
+    sum = _mm_add_ps(_mm_mul_ps(sum, x2), _mm_set1_ps(-1.0/5040));
+    sum = _mm_add_ps(_mm_mul_ps(sum, x2), _mm_set1_ps(1.0/120));
+    sum = _mm_add_ps(_mm_mul_ps(sum, x2), _mm_set1_ps(-1.0/6));
+    sum = _mm_add_ps(_mm_mul_ps(sum, x2), _mm_set1_ps(1.0));
+    return _mm_mul_ps(sum, x);
+}
+
+
+/* PolyBLEP offset for t in cycles, where dt is one sample in cycles
+ */
+static inline __m128 poly_blep(__m128 t, __m128 dt)
+{
+    const __m128 one = _mm_set1_ps(1.0);
+
+    __m128 a = _mm_div_ps(t, dt);
+    __m128 rising = _mm_sub_ps(_mm_sub_ps(_mm_add_ps(a, a),
+                _mm_mul_ps(a, a)), one);
+
+    __m128 b = _mm_div_ps(_mm_sub_ps(t, one), dt);
+    __m128 falling = _mm_add_ps(_mm_add_ps(_mm_mul_ps(b, b),
+                _mm_add_ps(b, b)), one);
+
+    return select(_mm_cmplt_ps(t, dt), rising,
+            _mm_and_ps(_mm_cmpgt_ps(t, _mm_sub_ps(one, dt)), falling));
+}
+
+
+/* Reads a wavetable for a whole group. The level follows how far each
+ * lane's phase moved since the last read, which last holds.
+ */
+static inline __m128 read_table(const Wavetable* table, __m128 phase,
+        __m128& last)
+{
+    if(table == nullptr)
+        return _mm_setzero_ps();
+
+    __m128 step = _mm_sub_ps(phase, last);
+    step = _mm_sub_ps(step, _mm_and_ps(_mm_cmpgt_ps(step,
+                    _mm_set1_ps(M_PI)), _mm_set1_ps(TWO_PI)));
+    step = _mm_add_ps(step, _mm_and_ps(_mm_cmplt_ps(step,
+                    _mm_set1_ps(-M_PI)), _mm_set1_ps(TWO_PI)));
+    last = phase;
+
+    float phases[VoiceBank::LANES], steps[VoiceBank::LANES];
+    float outs[VoiceBank::LANES];
+    _mm_storeu_ps(phases, phase);
+    _mm_storeu_ps(steps, step);
+    table->read(phases, steps, outs, VoiceBank::LANES);
+    return _mm_loadu_ps(outs);
+}
+
+
+/* One sample of an oscillator for a whole group, as Oscillator computes it
+ */
+static inline __m128 oscillate(Oscillator::Mode mode, const Wavetable* table,
+        __m128 phase, __m128 inc, __m128& last)
+{
+    const __m128 one = _mm_set1_ps(1.0);
+    const __m128 inv_two_pi = _mm_set1_ps(1/(2*M_PI));
+
+    switch(mode)
+    {
+        case Oscillator::Sine:
+            return sine(phase);
+
+        case Oscillator::Saw:
+        case Oscillator::BlepSaw:
+        {
+            __m128 t = _mm_mul_ps(phase, inv_two_pi);
+            __m128 out = _mm_sub_ps(_mm_add_ps(t, t), one);
+            if(mode == Oscillator::BlepSaw)
+                out = _mm_sub_ps(out, poly_blep(t, _mm_mul_ps(inc, inv_two_pi)));
+            return out;
+        }
+
+        case Oscillator::Square:
+        case Oscillator::BlepSquare:
+        case Oscillator::Tri:
+        case Oscillator::BlepTri:
+        {
+            __m128 out = select(_mm_cmplt_ps(phase, _mm_set1_ps(M_PI)), one,
+                    _mm_set1_ps(-1.0));
+
+            if(mode == Oscillator::BlepSquare || mode == Oscillator::BlepTri)
+            {
+                __m128 dt = _mm_mul_ps(inc, inv_two_pi);
+                __m128 t = _mm_mul_ps(phase, inv_two_pi);
+                __m128 half = _mm_add_ps(t, _mm_set1_ps(0.5));
+                half = _mm_sub_ps(half, _mm_cvtepi32_ps(_mm_cvttps_epi32(half)));
+
+                out = _mm_add_ps(out, poly_blep(t, dt));
+                out = _mm_sub_ps(out, poly_blep(half, dt));
+            }
+
+            // Triangles integrate the square wave
+            if(mode == Oscillator::Tri || mode == Oscillator::BlepTri)
+            {
+                out = _mm_add_ps(_mm_mul_ps(inc, out),
+                        _mm_mul_ps(_mm_sub_ps(one, inc), last));
+                last = out;
+            }
+            return out;
+        }
+
+        case Oscillator::WhiteNoise:
+        {
+            float noise[VoiceBank::LANES];
+            for(unsigned i = 0; i < VoiceBank::LANES; i++)
+                noise[i] = 2*((float) rand() / RAND_MAX) - 1;
+            return _mm_loadu_ps(noise);
+        }
+
+        case Oscillator::PulseTrain:
+            return _mm_and_ps(_mm_cmplt_ps(phase, inc), one);
+
+        case Oscillator::TableSine:
+        case Oscillator::TableSaw:
+        case Oscillator::TableSquare:
+        case Oscillator::TableTri:
+        case Oscillator::Table:
+            return read_table(table, phase, last);
+    }
+    return _mm_setzero_ps();
+}
+
+
+/* Subtracts a full turn from any lane past it. Oscillator does this in double
+ * precision, so we subtract the rounding error of TWO_PI too, or phases would
+ * drift apart by a little each turn.
+ */
+static inline __m128 wrap_phase(__m128 phase)
+{
+    __m128 past = _mm_cmpge_ps(phase, _mm_set1_ps(TWO_PI));
+    phase = _mm_sub_ps(phase, _mm_and_ps(past, _mm_set1_ps(TWO_PI)));
+    return _mm_sub_ps(phase, _mm_and_ps(past, _mm_set1_ps(TWO_PI_ERROR)));
+}
+#endif
+
+
+
+
+VoiceBank::VoiceBank(unsigned in_num_voices)
+    : AudioGenerator(1), num_voices(in_num_voices),
+      num_groups((in_num_voices + LANES-1) / LANES), routing(ADD),
+      mod_intensity(0.0), waveform{{Oscillator::Sine}, {Oscillator::Sine}},
+      lfo(nullptr), attack_time(.005*SAMPLE_RATE),
+      decay_time(.1*SAMPLE_RATE), release_time(.1*SAMPLE_RATE),
+      sustain_level(.5), stage(), samples_left(), multiplier(), delta_mult(),
+      gain(), lane_sums(BUFFER_SIZE*LANES)
+{
+    // Pad out the last group with voices that are never played
+    unsigned num_lanes = num_groups*LANES;
+    for(unsigned osc = 0; osc < 2; osc++)
+    {
+        mode[osc] = Oscillator::Sine;
+        table[osc] = nullptr;
+        transpose[osc] = 1.0;
+        lfo_intensity[osc] = 0.0;
+
+        phase[osc].assign(num_lanes, 0.0);
+        phase_inc[osc].assign(num_lanes, 440 * 2*M_PI/SAMPLE_RATE);
+        last_output[osc].assign(num_lanes, 0.0);
+        vibrato[osc].assign(BUFFER_SIZE, 1.0);
+    }
+
+    stage.assign(num_lanes, SILENT);
+    samples_left.assign(num_lanes, INT_MAX);
+    multiplier.assign(num_lanes, 0.0);
+    delta_mult.assign(num_lanes, 0.0);
+    gain.assign(num_lanes, 1.0);
+}
+
+
+unsigned VoiceBank::get_num_voices()
+{
+    return num_voices;
+}
+
+
+void VoiceBank::note_down(unsigned voice, float freq, float velocity)
+{
+    // Convert from decibels as ADSRFilter::set_gain does
+    gain[voice] = pow(10, midiVelocityToGain(velocity)/10);
+    set_freq(voice, freq);
+
+    stage[voice] = ATTACK;
+    samples_left[voice] = attack_time;
+}
+
+
+void VoiceBank::note_up(unsigned voice)
+{
+    stage[voice] = RELEASE;
+    samples_left[voice] = release_time;
+}
+
+
+void VoiceBank::set_freq(unsigned voice, float freq)
+{
+    for(unsigned osc = 0; osc < 2; osc++)
+        phase_inc[osc][voice] = freq * 2*M_PI/SAMPLE_RATE;
+}
+
+
+float VoiceBank::get_level(unsigned voice)
+{
+    return multiplier[voice];
+}
+
+
+bool VoiceBank::is_silent(unsigned voice)
+{
+    return stage[voice] == SILENT;
+}
+
+
+void VoiceBank::set_routing(Routing in_routing)
+{
+    routing = in_routing;
+}
+
+
+void VoiceBank::set_modulator_intensity(float intensity)
+{
+    mod_intensity = intensity;
+}
+
+
+void VoiceBank::set_mode(unsigned osc, Oscillator::Mode in_mode)
+{
+    waveform[osc].set_mode(in_mode);
+}
+
+
+void VoiceBank::set_wavetable(unsigned osc,
+        std::shared_ptr<const Wavetable> in_table)
+{
+    waveform[osc].set_wavetable(in_table);
+}
+
+
+void VoiceBank::set_transposition(unsigned osc, float steps)
+{
+    transpose[osc] = pow(2, steps/12);
+}
+
+
+void VoiceBank::set_lfo_input(AudioChannel* input)
+{
+    lfo = input;
+    mark_graph_changed();
+}
+
+
+void VoiceBank::set_lfo_intensity(unsigned osc, float steps)
+{
+    lfo_intensity[osc] = steps/12;
+}
+
+
+void VoiceBank::set_attack_time(float in)
+{
+    attack_time = SAMPLE_RATE*in;
+}
+
+
+void VoiceBank::set_decay_time(float in)
+{
+    decay_time = SAMPLE_RATE*in;
+}
+
+
+void VoiceBank::set_sustain_level(float in)
+{
+    sustain_level = in;
+}
+
+
+void VoiceBank::set_release_time(float in)
+{
+    release_time = SAMPLE_RATE*in;
+}
+
+
+void VoiceBank::get_side_channels(std::vector<AudioChannel*>& channels)
+{
+    if(lfo != nullptr)
+        channels.push_back(lfo);
+}
+
+
+void VoiceBank::generate_block(std::vector<SAMPLE*>& outputs, unsigned long t)
+{
+    // Pick up any new waveforms
+    for(unsigned osc = 0; osc < 2; osc++)
+    {
+        waveform[osc].update();
+        mode[osc] = waveform[osc].get_mode();
+        table[osc] = waveform[osc].get_table();
+    }
+
+    // The vibrato is shared by every voice, so work it out once per sample.
+    // Without an LFO there is none, even if there was one last block
+    const SAMPLE* lfo_block = lfo != nullptr ? lfo->get_block(t) : nullptr;
+    for(unsigned osc = 0; osc < 2; osc++)
+    {
+        for(unsigned j = 0; j < BUFFER_SIZE; j++)
+            vibrato[osc][j] = lfo_block == nullptr ? 1.0 :
+                pow(2, lfo_block[j] * lfo_intensity[osc]);
+    }
+
+    // Render every group with a voice sounding
+    std::fill(lane_sums.begin(), lane_sums.end(), 0.0);
+    for(unsigned group = 0; group < num_groups; group++)
+    {
+        unsigned first = group*LANES;
+        for(unsigned i = first; i < first+LANES; i++)
+        {
+            if(stage[i] != SILENT)
+            {
+                render_group(group);
+                break;
+            }
+        }
+    }
+
+    // Then mix the lanes down
+    SAMPLE* out = outputs[0];
+    for(unsigned j = 0; j < BUFFER_SIZE; j++)
+    {
+        const float* sums = &lane_sums[j*LANES];
+        out[j] = sums[0] + sums[1] + sums[2] + sums[3];
+    }
+}
+
+
+void VoiceBank::render_group(unsigned group)
+{
+    unsigned first = group*LANES;
+
+#ifdef __SSE2__
+    // Load the group into registers
+    __m128 phase0 = _mm_loadu_ps(&phase[0][first]);
+    __m128 phase1 = _mm_loadu_ps(&phase[1][first]);
+    __m128 inc0 = _mm_loadu_ps(&phase_inc[0][first]);
+    __m128 inc1 = _mm_loadu_ps(&phase_inc[1][first]);
+    __m128 step0 = _mm_mul_ps(inc0, _mm_set1_ps(transpose[0]));
+    __m128 step1 = _mm_mul_ps(inc1, _mm_set1_ps(transpose[1]));
+    __m128 last0 = _mm_loadu_ps(&last_output[0][first]);
+    __m128 last1 = _mm_loadu_ps(&last_output[1][first]);
+
+    __m128 mult = _mm_loadu_ps(&multiplier[first]);
+    __m128 delta = _mm_loadu_ps(&delta_mult[first]);
+    __m128 level = _mm_loadu_ps(&gain[first]);
+    __m128i left = _mm_loadu_si128((const __m128i*) &samples_left[first]);
+
+    const __m128 intensity = _mm_set1_ps(mod_intensity);
+    const __m128i one = _mm_set1_epi32(1);
+    for(unsigned j = 0; j < BUFFER_SIZE; j++)
+    {
+        // The second oscillator runs first, as it may modulate the first
+        phase1 = wrap_phase(_mm_add_ps(phase1,
+                    _mm_mul_ps(step1, _mm_set1_ps(vibrato[1][j]))));
+        __m128 out1 = oscillate(mode[1], table[1], phase1, inc1,
+                last1);
+
+        phase0 = wrap_phase(_mm_add_ps(phase0,
+                    _mm_mul_ps(step0, _mm_set1_ps(vibrato[0][j]))));
+        __m128 out;
+        if(routing == FM)
+        {
+            __m128 modulated = wrap_phase(_mm_add_ps(phase0,
+                        _mm_mul_ps(intensity, out1)));
+            out = oscillate(mode[0], table[0], modulated, inc0, last0);
+        }
+        else
+        {
+            out = _mm_add_ps(oscillate(mode[0], table[0], phase0, inc0,
+                        last0), out1);
+        }
+
+        // Step the envelopes. Stages rarely end, so handle those one voice
+        // at a time
+        mult = _mm_add_ps(mult, delta);
+        left = _mm_sub_epi32(left, one);
+        int ended = _mm_movemask_ps(_mm_castsi128_ps(
+                    _mm_cmplt_epi32(left, _mm_setzero_si128())));
+        if(ended != 0)
+        {
+            _mm_storeu_ps(&multiplier[first], mult);
+            _mm_storeu_ps(&delta_mult[first], delta);
+            _mm_storeu_si128((__m128i*) &samples_left[first], left);
+            for(unsigned i = 0; i < LANES; i++)
+            {
+                if(ended & (1 << i))
+                    advance_envelope(first+i);
+            }
+            mult = _mm_loadu_ps(&multiplier[first]);
+            delta = _mm_loadu_ps(&delta_mult[first]);
+            left = _mm_loadu_si128((const __m128i*) &samples_left[first]);
+        }
+
+        float* sums = &lane_sums[j*LANES];
+        _mm_storeu_ps(sums, _mm_add_ps(_mm_loadu_ps(sums),
+                    _mm_mul_ps(_mm_mul_ps(level, mult), out)));
+    }
+
+    // Save the group
+    _mm_storeu_ps(&phase[0][first], phase0);
+    _mm_storeu_ps(&phase[1][first], phase1);
+    _mm_storeu_ps(&last_output[0][first], last0);
+    _mm_storeu_ps(&last_output[1][first], last1);
+    _mm_storeu_ps(&multiplier[first], mult);
+    _mm_storeu_ps(&delta_mult[first], delta);
+    _mm_storeu_si128((__m128i*) &samples_left[first], left);
+#else
+    // Without SSE, render the group one voice at a time
+    for(unsigned i = first; i < first+LANES; i++)
+    {
+        for(unsigned j = 0; j < BUFFER_SIZE; j++)
+        {
+            phase[1][i] += phase_inc[1][i] * transpose[1] * vibrato[1][j];
+            if(phase[1][i] > 2*M_PI) phase[1][i] -= 2*M_PI;
+            float out1 = render_oscillator(1, i, phase[1][i]);
+
+            phase[0][i] += phase_inc[0][i] * transpose[0] * vibrato[0][j];
+            if(phase[0][i] > 2*M_PI) phase[0][i] -= 2*M_PI;
+            float out;
+            if(routing == FM)
+            {
+                float modulated = phase[0][i] + mod_intensity*out1;
+                if(modulated > 2*M_PI) modulated -= 2*M_PI;
+                out = render_oscillator(0, i, modulated);
+            }
+            else
+            {
+                out = render_oscillator(0, i, phase[0][i]) + out1;
+            }
+
+            multiplier[i] += delta_mult[i];
+            if(--samples_left[i] < 0)
+                advance_envelope(i);
+
+            lane_sums[j*LANES + i-first] += gain[i] * multiplier[i] * out;
+        }
+    }
+#endif
+}
+
+
+void VoiceBank::advance_envelope(unsigned voice)
+{
+    switch(stage[voice])
+    {
+        case ATTACK:
+            stage[voice] = DECAY;
+            samples_left[voice] = decay_time;
+            multiplier[voice] = 1.0;
+            delta_mult[voice] = (sustain_level - 1.0)/decay_time;
+            break;
+
+        case DECAY:
+            stage[voice] = SUSTAIN;
+            samples_left[voice] = INT_MAX;
+            multiplier[voice] = sustain_level;
+            delta_mult[voice] = 0.0;
+            break;
+
+        case RELEASE:
+            stage[voice] = SILENT;
+            samples_left[voice] = INT_MAX;
+            multiplier[voice] = 0.0;
+            delta_mult[voice] = 0.0;
+            break;
+
+        default:
+            // No other stages end themselves
+            samples_left[voice] = INT_MAX;
+            break;
+    }
+}
+
+
+float VoiceBank::render_oscillator(unsigned osc, unsigned voice, float phase)
+{
+    float inc = phase_inc[osc][voice];
+    switch(mode[osc])
+    {
+        case Oscillator::Sine:
+            return sin(phase);
+
+        case Oscillator::Saw:
+        case Oscillator::BlepSaw:
+        {
+            float t = phase / TWO_PI;
+            float out = 2*t - 1;
+            if(mode[osc] == Oscillator::BlepSaw)
+            {
+                float dt = inc / TWO_PI;
+                if(t < dt)
+                    out -= 2*(t/dt) - (t/dt)*(t/dt) - 1;
+                else if(t > 1 - dt)
+                    out -= ((t-1)/dt)*((t-1)/dt) + 2*((t-1)/dt) + 1;
+            }
+            return out;
+        }
+
+        case Oscillator::Square:
+        case Oscillator::BlepSquare:
+        case Oscillator::Tri:
+        case Oscillator::BlepTri:
+        {
+            float out = phase < M_PI ? 1.0 : -1.0;
+            if(mode[osc] == Oscillator::BlepSquare ||
+                    mode[osc] == Oscillator::BlepTri)
+            {
+                float dt = inc / TWO_PI;
+                float edges[2] = { phase / TWO_PI,
+                    (float) fmod(phase / TWO_PI + 0.5, 1.0) };
+                for(unsigned e = 0; e < 2; e++)
+                {
+                    float t = edges[e];
+                    float offset = 0.0;
+                    if(t < dt)
+                        offset = 2*(t/dt) - (t/dt)*(t/dt) - 1;
+                    else if(t > 1 - dt)
+                        offset = ((t-1)/dt)*((t-1)/dt) + 2*((t-1)/dt) + 1;
+                    out += e == 0 ? offset : -offset;
+                }
+            }
+
+            // Triangles integrate the square wave
+            if(mode[osc] == Oscillator::Tri || mode[osc] == Oscillator::BlepTri)
+            {
+                out = inc*out + (1-inc)*last_output[osc][voice];
+                last_output[osc][voice] = out;
+            }
+            return out;
+        }
+
+        case Oscillator::WhiteNoise:
+            return 2*((float) rand() / RAND_MAX) - 1;
+
+        case Oscillator::PulseTrain:
+            return phase < inc ? 1.0 : 0.0;
+
+        case Oscillator::TableSine:
+        case Oscillator::TableSaw:
+        case Oscillator::TableSquare:
+        case Oscillator::TableTri:
+        case Oscillator::Table:
+        {
+            float step = phase - last_output[osc][voice];
+            if(step > M_PI) step -= 2*M_PI;
+            else if(step < -M_PI) step += 2*M_PI;
+            last_output[osc][voice] = phase;
+
+            if(table[osc] == nullptr)
+                return 0.0;
+            return table[osc]->read(phase, step);
+        }
+    }
+    return 0.0;
+}
+
+
+
+
+BankVoice::BankVoice(PolyphonicInstrument* in_parent, VoiceBank* in_bank,
+        unsigned in_index)
+    : PolyphonicVoice(in_parent), bank(in_bank), index(in_index)
+{}
+
+
+AudioChannel* BankVoice::get_output_channel()
+{
+    return nullptr;
+}
+
+
+void BankVoice::handle_note_down(float velocity)
+{
+    bank->note_down(index, freq*pitch_multiplier, velocity);
+}
+
+
+void BankVoice::handle_note_up()
+{
+    bank->note_up(index);
+}
+
+
+void BankVoice::handle_pitch_wheel(float value)
+{
+    bank->set_freq(index, freq*pitch_multiplier);
+}
+
+
+float BankVoice::get_level()
+{
+    return bank->get_level(index);
+}
+
+
+bool BankVoice::is_idle()
+{
+    return !playing && bank->is_silent(index);
+}
@@ -0,0 +1,169 @@
+#ifndef VOICE_BANK_H
+#define VOICE_BANK_H
+
+#include <memory>
+#include <vector>
+#include "audio_generics.h"
+#include "oscillator.h"
+#include "polyphonic_instrument.h"
+
+
+namespace ClickTrack
+{
+    /* The voice bank renders every voice of a synthesizer at once. Each voice
+     * is two oscillators feeding an ADSR envelope, and behaves like the same
+     * chain built from Oscillator and ADSRFilter objects.
+     *
+     * Rather than one object graph per voice, the state of all voices is kept
+     * in structure of arrays form, and voices are rendered in groups of LANES.
+     * With SSE, one instruction advances one sample of a whole group. Groups
+     * whose envelopes are all silent are skipped.
+     *
+     * The two oscillators are either added together, or the second frequency
+     * modulates the first. Oscillator modes, transpositions and envelope times
+     * are shared by every voice, as the synths set them for all voices at
+     * once. Each voice has its own frequency, velocity and envelope state.
+     */
+    class VoiceBank : public AudioGenerator
+    {
+        public:
+            static const unsigned LANES = 4;
+
+            VoiceBank(unsigned num_voices);
+
+            unsigned get_num_voices();
+
+            /* Controls for one voice
+             */
+            void note_down(unsigned voice, float freq, float velocity);
+            void note_up(unsigned voice);
+            void set_freq(unsigned voice, float freq);
+
+            /* Returns the envelope level of one voice, and whether its
+             * envelope has fallen silent
+             */
+            float get_level(unsigned voice);
+            bool is_silent(unsigned voice);
+
+            /* Routing between the two oscillators. Added voices sum both
+             * oscillators. FM voices play the first oscillator, phase
+             * modulated by the second with the given intensity.
+             */
+            enum Routing { ADD, FM };
+            void set_routing(Routing routing);
+            void set_modulator_intensity(float intensity);
+
+            /* Oscillator settings, as in oscillator.h. The LFO is shared by
+             * all voices, and each oscillator has its own vibrato intensity.
+             * Modes and wavetables may be set while the audio thread is
+             * running, and are heard from the next block.
+             */
+            void set_mode(unsigned osc, Oscillator::Mode mode);
+            void set_wavetable(unsigned osc,
+                    std::shared_ptr<const Wavetable> table);
+            void set_transposition(unsigned osc, float steps);
+            void set_lfo_input(AudioChannel* input);
+            void set_lfo_intensity(unsigned osc, float steps);
+
+            /* Envelope settings, as in adsr.h
+             */
+            void set_attack_time(float attack_time);
+            void set_decay_time(float decay_time);
+            void set_sustain_level(float sustain_level);
+            void set_release_time(float release_time);
+
+        private:
+            void generate_block(std::vector<SAMPLE*>& outputs,
+                    unsigned long t);
+            void get_side_channels(std::vector<AudioChannel*>& channels);
+
+            /* Renders one group of voices, adding each lane's output to the
+             * lane sums
+             */
+            void render_group(unsigned group);
+
+            /* Moves the envelope of one voice to its next stage, as
+             * ADSRFilter does when a stage runs out
+             */
+            void advance_envelope(unsigned voice);
+
+            /* Oscillator output for one voice, used without SSE
+             */
+            float render_oscillator(unsigned osc, unsigned voice, float phase);
+
+            unsigned num_voices;
+            unsigned num_groups;
+
+            /* Shared settings
+             */
+            Routing routing;
+            float mod_intensity;
+
+            /* Each oscillator's waveform, and its mode and table as of the
+             * start of this block
+             */
+            Oscillator::WaveformSlot waveform[2];
+            Oscillator::Mode mode[2];
+            const Wavetable* table[2];
+            float transpose[2];
+            AudioChannel* lfo;
+            float lfo_intensity[2];
+
+            unsigned attack_time, decay_time, release_time; // in samples
+            float sustain_level;
+
+            /* Per voice oscillator state, in radians. Increments are before
+             * transposition and vibrato. Last holds the triangle integrators,
+             * or the last phase read by table modes.
+             */
+            std::vector<float> phase[2];
+            std::vector<float> phase_inc[2];
+            std::vector<float> last_output[2];
+
+            /* Per voice envelope state. Stages count down the samples left
+             * until they end.
+             */
+            enum Stage { SILENT, ATTACK, DECAY, SUSTAIN, RELEASE };
+            std::vector<int> stage;
+            std::vector<int> samples_left;
+            std::vector<float> multiplier;
+            std::vector<float> delta_mult;
+            std::vector<float> gain;
+
+            /* Per block scratch space. Vibrato holds each oscillator's
+             * frequency multiplier for each sample, and lane sums holds the
+             * output of each lane for each sample.
+             */
+            std::vector<float> vibrato[2];
+            std::vector<float> lane_sums;
+    };
+
+
+    /* A bank voice is one voice of a VoiceBank, so that a PolyphonicInstrument
+     * can allocate it like any other voice. Its audio is only available
+     * through the bank's output.
+     */
+    class BankVoice : public PolyphonicVoice
+    {
+        public:
+            BankVoice(PolyphonicInstrument* parent, VoiceBank* bank,
+                    unsigned index);
+
+            /* Bank voices have no output of their own, so this returns null
+             */
+            AudioChannel* get_output_channel();
+
+            void handle_note_down(float velocity);
+            void handle_note_up();
+            void handle_pitch_wheel(float value);
+
+            float get_level();
+            bool is_idle();
+
+        private:
+            VoiceBank* bank;
+            unsigned index;
+    };
+}
+
+#endif
@@ -1,75 +1,203 @@
-#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "vector_ops.h"
 #include "wav_reader.h"
 
 using namespace ClickTrack;
 
 
+/* Little-endian field readers for the mapped headers
+ */
+static uint16_t read16(const unsigned char* p)
+{
+    return (uint16_t) (p[0] | p[1] << 8);
+}
+
+static uint32_t read32(const unsigned char* p)
+{
+    return (uint32_t) p[0] | (uint32_t) p[1] << 8 |
+        (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static uint64_t read64(const unsigned char* p)
+{
+    return (uint64_t) read32(p) | (uint64_t) read32(p+4) << 32;
+}
+
+static bool has_id(const unsigned char* p, const char* id)
+{
+    return memcmp(p, id, 4) == 0;
+}
+
+
 WavReader::WavReader(const char* in_filename)
-    : AudioGenerator(2), filename(in_filename) // always stereo
+    : AudioGenerator(2), // always stereo
+      file(-1), map(nullptr), map_size(0), encoding(PCM16), num_channels(0),
+      sample_rate(0), frame_size(0), data(nullptr), samples_total(0),
+      samples_read(0), interleaved(), discard(), channel_blocks()
 {
-    // Set up file to read
-    file.open(filename, std::ios::in|std::ios::binary);
-    union {
-        char raw[4];
-        unsigned short two[2];
-        unsigned int four;
-    } container;
+    // Map in the whole file
+    file = open(in_filename, O_RDONLY);
+    if(file < 0)
+        throw InvalidWavFile("Could not open wav file");
 
+    struct stat info;
+    if(fstat(file, &info) != 0 || info.st_size < 12)
+    {
+        unmap();
+        throw InvalidWavFile("Wav file too short");
+    }
+    map_size = info.st_size;
 
-    // Parse RIFF HEADER
-    file.read(container.raw, 4);
-    if(container.four != 0x46464952)
-        throw InvalidWavFile("No RIFF identifier");
+    void* mapped = mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, file, 0);
+    if(mapped == MAP_FAILED)
+    {
+        unmap();
+        throw InvalidWavFile("Could not map wav file");
+    }
+    map = (const unsigned char*) mapped;
 
-    file.read(container.raw, 4); // toss size
+    // Both playback and read_all stream through the file front to back
+#ifdef MADV_SEQUENTIAL
+    madvise(mapped, map_size, MADV_SEQUENTIAL);
+#endif
 
-    file.read(container.raw, 4);
-    if(container.four != 0x45564157)
-        throw InvalidWavFile("No WAV identifier");
+    try
+    {
+        parse_chunks();
+    }
+    catch(...)
+    {
+        unmap();
+        throw;
+    }
 
+    // Set up decoding scratch space
+    interleaved.resize(BUFFER_SIZE*num_channels);
+    if(num_channels > 2)
+        discard.resize(BUFFER_SIZE*(num_channels-2));
+    channel_blocks.resize(num_channels);
+    for(unsigned c = 2; c < num_channels; c++)
+        channel_blocks[c] = &discard[BUFFER_SIZE*(c-2)];
+}
 
-    // Parse fmt header
-    file.read(container.raw, 4);
-    if(container.four != 0x20746d66)
-        throw InvalidWavFile("No fmt section");
 
-    // Parse size
-    file.read(container.raw, 4);
-    if(container.four != 16)
-        throw InvalidWavFile("Invalid fmt length");
+WavReader::~WavReader()
+{
+    unmap();
+}
 
-    // Read format and channel count
-    file.read(container.raw, 4);
-    if(container.two[0] != 1)
-        throw InvalidWavFile("No support for nonlinear quantization");
-    stereo = container.two[1] == 2;
 
-    // Read sample rate
-    file.read(container.raw, 4);
-    if(container.four != 44100)
-        throw InvalidWavFile("No support for sample rates other than 44100");
+void WavReader::unmap()
+{
+    if(map != nullptr)
+        munmap((void*) map, map_size);
+    if(file >= 0)
+        close(file);
+    map = nullptr;
+    file = -1;
+}
 
-    file.read(container.raw, 4); // toss byte rate
 
-    // Read alignment
-    file.read(container.raw, 4);
-    byte_depth = container.two[1]/8;
-    if(byte_depth != 2)
-        throw InvalidWavFile("Unsupported byte depth");
+void WavReader::parse_chunks()
+{
+    // Parse RIFF header. RF64 files keep their real sizes in a ds64 chunk
+    bool rf64 = has_id(map, "RF64");
+    if(!rf64 && !has_id(map, "RIFF"))
+        throw InvalidWavFile("No RIFF identifier");
+    if(!has_id(map+8, "WAVE"))
+        throw InvalidWavFile("No WAV identifier");
+
+    bool found_fmt = false;
+    uint64_t ds64_data_size = 0;
+    uint64_t data_size = 0;
+    unsigned format = 0;
+    unsigned block_align = 0;
+
+    // Walk the chunks, skipping any we do not understand (LIST, bext, fact,
+    // ...). Chunks are padded to an even length.
+    size_t pos = 12;
+    while(data == nullptr && pos+8 <= map_size)
+    {
+        const unsigned char* chunk = map+pos+8;
+        uint64_t size = read32(map+pos+4);
+        uint64_t available = map_size - (pos+8);
+
+        if(has_id(map+pos, "ds64") && size >= 24 && available >= 24)
+        {
+            ds64_data_size = read64(chunk+8);
+        }
+        else if(has_id(map+pos, "fmt "))
+        {
+            if(size < 16 || available < 16)
+                throw InvalidWavFile("Invalid fmt length");
+
+            format = read16(chunk);
+            num_channels = read16(chunk+2);
+            sample_rate = read32(chunk+4);
+            block_align = read16(chunk+12);
 
+            // Extensible files keep their real format at the head of the
+            // subformat GUID
+            if(format == 0xFFFE)
+            {
+                if(size < 40 || available < 40)
+                    throw InvalidWavFile("Invalid extensible fmt length");
+                format = read16(chunk+24);
+            }
+            found_fmt = true;
+        }
+        else if(has_id(map+pos, "data"))
+        {
+            if(!found_fmt)
+                throw InvalidWavFile("No fmt section before data");
 
-    // Parse data header
-    file.read(container.raw, 4);
-    if(container.four != 0x61746164)
+            // Writers that could not seek back leave the size unset
+            data_size = size;
+            if(rf64 && size == 0xFFFFFFFF)
+                data_size = ds64_data_size;
+            data_size = std::min(data_size, available);
+            data = chunk;
+        }
+
+        pos += 8 + size + (size & 1);
+    }
+
+    if(!found_fmt)
+        throw InvalidWavFile("No fmt section");
+    if(data == nullptr)
         throw InvalidWavFile("No data section");
 
-    // Parse size
-    file.read(container.raw, 4);
-    samples_total = container.four / byte_depth;
-    if(stereo) samples_total /= 2;
 
-    // Start with nothing played
-    samples_read = 0;
+    // Work out how to decode samples
+    if(num_channels == 0 || block_align % num_channels != 0)
+        throw InvalidWavFile("Invalid block alignment");
+    unsigned byte_depth = block_align / num_channels;
+
+    if(format == 1 && byte_depth == 1)
+        encoding = PCM8;
+    else if(format == 1 && byte_depth == 2)
+        encoding = PCM16;
+    else if(format == 1 && byte_depth == 3)
+        encoding = PCM24;
+    else if(format == 1 && byte_depth == 4)
+        encoding = PCM32;
+    else if(format == 3 && byte_depth == 4)
+        encoding = FLOAT32;
+    else if(format == 3 && byte_depth == 8)
+        encoding = FLOAT64;
+    else if(format == 1 || format == 3)
+        throw InvalidWavFile("Unsupported byte depth");
+    else
+        throw InvalidWavFile("Unsupported sample format");
+
+    frame_size = block_align;
+    samples_total = data_size / frame_size;
 }
 
 
@@ -82,43 +210,107 @@ bool WavReader::is_done()
 void WavReader::restart()
 {
     samples_read = 0;
-    file.seekg(44); // move to end of headers
 }
 
 
-unsigned WavReader::get_total_samples()
+unsigned long WavReader::get_total_samples()
 {
     return samples_total;
 }
 
 
-void WavReader::generate_outputs(std::vector<SAMPLE>& outputs, unsigned long t)
+unsigned WavReader::get_num_channels()
 {
-    // TODO: support more than 16-bit
-    union {
-        char raw[2];
-        signed short val;
-    } left, right;
-    left.val = 0; right.val = 0;
+    return num_channels;
+}
 
-    // Silence at end
-    if(samples_read == samples_total)
+
+unsigned WavReader::get_sample_rate()
+{
+    return sample_rate;
+}
+
+
+void WavReader::read_all(std::vector<std::vector<SAMPLE>>& channels)
+{
+    channels.resize(num_channels);
+    std::vector<SAMPLE*> out(num_channels);
+    for(unsigned c = 0; c < num_channels; c++)
+    {
+        channels[c].resize(samples_total);
+        out[c] = channels[c].data();
+    }
+
+    read_all(out.data());
+}
+
+
+void WavReader::read_all(SAMPLE* const* channels)
+{
+    // Decode one block at a time so the scratch space stays in cache
+    std::vector<SAMPLE*> out(num_channels);
+    for(unsigned long frame = 0; frame < samples_total; frame += BUFFER_SIZE)
     {
-        outputs[0] = 0;
-        outputs[1] = 0;
-        return;
+        for(unsigned c = 0; c < num_channels; c++)
+            out[c] = channels[c] + frame;
+        decode(frame, std::min<unsigned long>(BUFFER_SIZE,
+                    samples_total-frame), &out[0]);
     }
+}
+
+
+void WavReader::decode(unsigned long frame, unsigned n, SAMPLE* const* out)
+{
+    const unsigned char* in = data + frame*frame_size;
+    unsigned count = n*num_channels;
+
+    // Mono needs no deinterleaving, so decode straight into the output
+    SAMPLE* decoded = num_channels == 1 ? out[0] : &interleaved[0];
+    switch(encoding)
+    {
+        case PCM8:
+            decode_pcm8(in, decoded, count);
+            break;
+        case PCM16:
+            decode_pcm16(in, decoded, count);
+            break;
+        case PCM24:
+            decode_pcm24(in, decoded, count);
+            break;
+        case PCM32:
+            decode_pcm32(in, decoded, count);
+            break;
+        case FLOAT32:
+            decode_float32(in, decoded, count);
+            break;
+        case FLOAT64:
+            decode_float64(in, decoded, count);
+            break;
+    }
+
+    if(num_channels > 1)
+        deinterleave(decoded, num_channels, out, n);
+}
+
+
+void WavReader::generate_block(std::vector<SAMPLE*>& outputs, unsigned long t)
+{
+    unsigned n = std::min<unsigned long>(BUFFER_SIZE,
+            samples_total - samples_read);
 
     // If we have stereo audio, read right channel
     // Otherwise copy left channel
-    file.read(left.raw, byte_depth);
-    if(stereo)
-        file.read(right.raw, byte_depth);
-    else
-        right.val = left.val;
+    channel_blocks[0] = outputs[0];
+    if(num_channels > 1)
+        channel_blocks[1] = outputs[1];
+    if(n > 0)
+        decode(samples_read, n, &channel_blocks[0]);
+    if(num_channels == 1)
+        std::copy(outputs[0], outputs[0]+n, outputs[1]);
 
-    outputs[0] = ((SAMPLE)left.val) / 32768;
-    outputs[1] = ((SAMPLE)right.val) / 32768;
+    // Silence at end
+    std::fill(outputs[0]+n, outputs[0]+BUFFER_SIZE, 0.0);
+    std::fill(outputs[1]+n, outputs[1]+BUFFER_SIZE, 0.0);
 
-    samples_read++;
+    samples_read += n;
 }
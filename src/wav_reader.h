@@ -1,8 +1,8 @@
 #ifndef WAV_READER_H
 #define WAV_READER_H
 
+#include <cstddef>
 #include <exception>
-#include <fstream>
 #include <string>
 #include "audio_generics.h"
 #include "portaudio_wrapper.h"
@@ -12,36 +12,91 @@ namespace ClickTrack
 {
     /* The WavReader is an input device. It reads a wav file and plays it back
      * in stereo until the file runs out. Then it stops forever.
+     *
+     * The file is memory mapped and decoded a block at a time. We accept
+     * 8, 16, 24 and 32 bit integer and 32 and 64 bit float files, in plain,
+     * WAVE_FORMAT_EXTENSIBLE or RF64 containers, and skip any chunks we do
+     * not need. Mono files play on both channels, and channels past the
+     * second are dropped. Files play back at our own sample rate, whatever
+     * rate they were recorded at.
      */
     class WavReader : public AudioGenerator
     {
         public:
             WavReader(const char* in_filename);
+            ~WavReader();
 
             /* Returns true once we have read out the entire wav file.
-             */ 
+             */
             bool is_done();
 
             /* Resets the WavReader to point to the head of the file.
-             */ 
+             */
             void restart();
 
             /* Returns the number of samples in the wav file
              */
-            unsigned get_total_samples();
+            unsigned long get_total_samples();
+
+            /* Returns the channel count and sample rate stored in the file
+             */
+            unsigned get_num_channels();
+            unsigned get_sample_rate();
+
+            /* Decodes the entire file at once, resizing channels to hold one
+             * vector for each channel in the file. This is much faster than
+             * pulling samples through the output channels, and does not
+             * affect playback.
+             */
+            void read_all(std::vector<std::vector<SAMPLE>>& channels);
+
+            /* As above, but decodes into caller owned arrays, one for each
+             * channel in the file, each holding get_total_samples() samples
+             */
+            void read_all(SAMPLE* const* channels);
 
         private:
-            void generate_outputs(std::vector<SAMPLE>& output, unsigned long t);
+            WavReader(const WavReader&) = delete;
+            WavReader& operator=(const WavReader&) = delete;
 
+            void generate_block(std::vector<SAMPLE*>& outputs,
+                    unsigned long t);
 
-            const char* filename;
-            std::ifstream file;
+            /* Walks the chunks of the mapped file to find its format and its
+             * audio data
+             */
+            void parse_chunks();
 
-            bool stereo; //true iff stereo audio
-            unsigned short byte_depth; // bytes per sample
+            /* Decodes n frames starting at the given frame, writing channel
+             * c of the file to out[c]. n must be at most BUFFER_SIZE.
+             */
+            void decode(unsigned long frame, unsigned n, SAMPLE* const* out);
+
+            void unmap();
+
+
+            enum Encoding { PCM8, PCM16, PCM24, PCM32, FLOAT32, FLOAT64 };
 
-            unsigned samples_total; // total samples
-            unsigned samples_read;
+            int file;
+            const unsigned char* map;
+            size_t map_size;
+
+            Encoding encoding;
+            unsigned num_channels;
+            unsigned sample_rate;
+            unsigned frame_size; // bytes per frame
+            const unsigned char* data;
+
+            unsigned long samples_total; // total samples
+            unsigned long samples_read;
+
+            /* Scratch space for decoding. Interleaved holds one block of
+             * decoded frames before we split it into channels, and discard
+             * holds the channels we do not play.
+             */
+            std::vector<SAMPLE> interleaved;
+            std::vector<SAMPLE> discard;
+            std::vector<SAMPLE*> channel_blocks;
     };
 
 
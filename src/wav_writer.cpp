@@ -1,65 +1,315 @@
-#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+#include "vector_ops.h"
 #include "wav_writer.h"
 
 using namespace ClickTrack;
 
 
-WavWriter::WavWriter(const char* in_filename, unsigned num_inputs)
-    : AudioConsumer(num_inputs), filename(in_filename)
+/* Little-endian field writers for the header
+ */
+static void put16(unsigned char* p, uint16_t value)
+{
+    p[0] = value; p[1] = value >> 8;
+}
+
+static void put32(unsigned char* p, uint32_t value)
+{
+    put16(p, value); put16(p+2, value >> 16);
+}
+
+static void put64(unsigned char* p, uint64_t value)
+{
+    put32(p, value); put32(p+4, value >> 32);
+}
+
+
+static unsigned bytes_per_sample(WavWriter::Format format)
+{
+    switch(format)
+    {
+        case WavWriter::PCM24:
+            return 3;
+        case WavWriter::FLOAT32:
+            return 4;
+        default:
+            return 2;
+    }
+}
+
+
+WavWriter::WavWriter(const char* in_filename, unsigned num_inputs,
+        Format in_format)
+    : AudioConsumer(num_inputs),
+      format(in_format),
+      frame_size(num_inputs*bytes_per_sample(in_format)),
+      file(-1),
+      queue_memory(QUEUE_BLOCKS*num_inputs*BUFFER_SIZE),
+      ready_blocks(QUEUE_BLOCKS),
+      free_blocks(QUEUE_BLOCKS),
+      lossless(false),
+      dropped_blocks(0),
+      chunk(nullptr),
+      chunk_used(0),
+      channels(num_inputs),
+      interleaved(num_inputs*BUFFER_SIZE),
+      encoded(num_inputs*BUFFER_SIZE*bytes_per_sample(in_format)),
+      started(false),
+      next_t(0),
+      samples_written(0),
+      write_failed(false),
+      running(true),
+      disk_thread()
 {
     // Set up file to write
-    file.open(filename, std::ios::out | std::ios::binary | std::ios::trunc);
-
-
-    // Write RIFF header
-    file.write("RIFF", 4);
-    file.write("\0\0\0\0",4); // dummy size field
-    file.write("WAVE",4);
-
-    // Write WAV header
-    file.write("fmt ", 4);
-    int section2size = 16;
-    file.write((char*) &section2size, 4);
-    short format = 1;
-    file.write((char*) &format, 2);
-    file.write((char*) &num_inputs, 2);
-    unsigned sample_rate = SAMPLE_RATE;
-    file.write((char*) &sample_rate, 4);
-    unsigned byte_rate = sample_rate*num_inputs*16/8;
-    file.write((char*) &byte_rate, 4);
-    unsigned short block_align = num_inputs*16/8;
-    file.write((char*) &block_align, 2);
-    unsigned short bit_depth = 16;
-    file.write((char*) &bit_depth, 2);
-
-    // Write data header
-    file.write("data", 4);
-    file.write("\0\0\0\0", 4); // dummy size field
+    file = open(in_filename, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    if(file < 0)
+        throw WavFileNotWritable();
+
+    // Chunks are page aligned, and begin with the header so every write after
+    // the first lands on a chunk boundary in the file
+    void* memory;
+    if(posix_memalign(&memory, 4096, CHUNK_SIZE) != 0)
+    {
+        close(file);
+        throw std::bad_alloc();
+    }
+    chunk = (unsigned char*) memory;
+    fill_header(chunk, 0);
+    chunk_used = HEADER_SIZE;
+
+    // All the queued blocks start out free
+    for(unsigned i = 0; i < QUEUE_BLOCKS; i++)
+        free_blocks.push({&queue_memory[i*num_inputs*BUFFER_SIZE], 0});
+
+    disk_thread = std::thread(&WavWriter::disk_loop, this);
 }
 
 
 WavWriter::~WavWriter()
 {
-    unsigned data_size = samples_written*get_num_input_channels()*16/8;
-    unsigned file_size = 36+data_size;
-    file.seekp(4); file.write((char*) &file_size, 4);
-    file.seekp(40); file.write((char*) &data_size, 4);
+    // Let the disk thread drain the queue and stop
+    running.store(false, std::memory_order_release);
+    disk_thread.join();
+
+    // Chunks must have an even length
+    unsigned long long data_size = samples_written*frame_size;
+    if(data_size % 2 != 0)
+        append_silence(1);
+    flush();
+
+    // Go back and fill in the real lengths
+    unsigned char header[HEADER_SIZE];
+    fill_header(header, data_size);
+    if(!write_failed && pwrite(file, header, HEADER_SIZE, 0) != HEADER_SIZE)
+        write_failed = true;
+
+    close(file);
+    free(chunk);
+}
+
+
+unsigned long WavWriter::get_dropped_blocks()
+{
+    return dropped_blocks.load(std::memory_order_relaxed);
+}
+
+
+void WavWriter::set_lossless(bool in_lossless)
+{
+    lossless.store(in_lossless, std::memory_order_relaxed);
+}
+
+
+void WavWriter::fill_header(unsigned char* header,
+        unsigned long long data_size)
+{
+    // A normal RIFF header holds 32 bit lengths. Past that, switch to RF64,
+    // which keeps the real lengths in a ds64 chunk. Reserve room for it with
+    // a JUNK chunk until then.
+    unsigned long long riff_size = HEADER_SIZE - 8 + data_size + data_size%2;
+    bool rf64 = riff_size > 0xFFFFFFFFull;
+
+    // RIFF header
+    memcpy(header, rf64 ? "RF64" : "RIFF", 4);
+    put32(header+4, rf64 ? 0xFFFFFFFF : riff_size);
+    memcpy(header+8, "WAVE", 4);
+
+    // ds64 header, or the space for it
+    memset(header+12, 0, 36);
+    memcpy(header+12, rf64 ? "ds64" : "JUNK", 4);
+    put32(header+16, 28);
+    if(rf64)
+    {
+        put64(header+20, riff_size);
+        put64(header+28, data_size);
+        put64(header+36, data_size / frame_size);
+    }
+
+    // fmt header
+    unsigned num_channels = get_num_input_channels();
+    unsigned short bit_depth = 8*bytes_per_sample(format);
+    memcpy(header+48, "fmt ", 4);
+    put32(header+52, 16);
+    put16(header+56, format == FLOAT32 ? 3 : 1);
+    put16(header+58, num_channels);
+    put32(header+60, SAMPLE_RATE);
+    put32(header+64, SAMPLE_RATE*frame_size);
+    put16(header+68, frame_size);
+    put16(header+70, bit_depth);
+
+    // data header
+    memcpy(header+72, "data", 4);
+    put32(header+76, rf64 ? 0xFFFFFFFF : data_size);
+}
+
+
+void WavWriter::process_block(std::vector<const SAMPLE*>& inputs,
+        unsigned long t)
+{
+    // Take a free block. If the disk has fallen behind, drop this one rather
+    // than wait, unless we are lossless
+    Block block;
+    if(!free_blocks.pop(block))
+    {
+        if(!lossless.load(std::memory_order_relaxed))
+        {
+            dropped_blocks.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
 
-    file.close();
+        const std::chrono::microseconds poll_period(
+                1000000ul * BUFFER_SIZE / SAMPLE_RATE / 4);
+        while(!free_blocks.pop(block))
+            std::this_thread::sleep_for(poll_period);
+    }
+
+    // Copy the channels, and leave the rest to the disk thread. There is
+    // always room in the queue for a block we took from the free list
+    for(unsigned i = 0; i < inputs.size(); i++)
+        std::copy(inputs[i], inputs[i]+BUFFER_SIZE,
+                block.samples + i*BUFFER_SIZE);
+    block.t = t;
+    ready_blocks.push(block);
 }
 
 
-void WavWriter::process_inputs(std::vector<SAMPLE>& inputs, unsigned long t)
+void WavWriter::disk_loop()
 {
-    for(int i = 0; i < inputs.size(); i++)
+    const std::chrono::microseconds poll_period(
+            1000000ul * BUFFER_SIZE / SAMPLE_RATE / 2);
+
+    while(true)
     {
-        // Clip instead of overflowing
-        SAMPLE sample = inputs[i];
-        if(sample > 0.999f)  sample = 0.999f;
-        if(sample < -0.999f) sample = -0.999f;
+        // Check for shutdown before draining, so we always write out every
+        // block queued before it
+        bool stopping = !running.load(std::memory_order_acquire);
 
-        signed short quantized = sample * 32768;
-        file.write((char*) &quantized, 2);
+        Block block;
+        bool drained_any = false;
+        while(ready_blocks.pop(block))
+        {
+            write_block(block);
+            free_blocks.push(block);
+            drained_any = true;
+        }
+
+        if(stopping)
+            break;
+        if(!drained_any)
+            std::this_thread::sleep_for(poll_period);
+    }
+}
+
+
+void WavWriter::write_block(const Block& block)
+{
+    // Fill in for dropped blocks
+    if(started && block.t > next_t)
+    {
+        append_silence((block.t - next_t)*frame_size);
+        samples_written += block.t - next_t;
+    }
+    started = true;
+    next_t = block.t + BUFFER_SIZE;
+
+    // Interleave and quantize
+    unsigned num_channels = channels.size();
+    for(unsigned i = 0; i < num_channels; i++)
+        channels[i] = block.samples + i*BUFFER_SIZE;
+    interleave(channels.data(), num_channels, interleaved.data(),
+            BUFFER_SIZE);
+
+    unsigned n = num_channels*BUFFER_SIZE;
+    switch(format)
+    {
+        case PCM16:
+            encode_pcm16(interleaved.data(), encoded.data(), n);
+            break;
+        case PCM24:
+            encode_pcm24(interleaved.data(), encoded.data(), n);
+            break;
+        case FLOAT32:
+            encode_float32(interleaved.data(), encoded.data(), n);
+            break;
+    }
+
+    append(encoded.data(), encoded.size());
+    samples_written += BUFFER_SIZE;
+}
+
+
+void WavWriter::append(const unsigned char* bytes, size_t n)
+{
+    while(n > 0)
+    {
+        size_t count = std::min(n, CHUNK_SIZE - chunk_used);
+        memcpy(chunk + chunk_used, bytes, count);
+        chunk_used += count;
+        bytes += count;
+        n -= count;
+
+        if(chunk_used == CHUNK_SIZE)
+            flush();
+    }
+}
+
+
+void WavWriter::append_silence(size_t n)
+{
+    while(n > 0)
+    {
+        size_t count = std::min(n, CHUNK_SIZE - chunk_used);
+        memset(chunk + chunk_used, 0, count);
+        chunk_used += count;
+        n -= count;
+
+        if(chunk_used == CHUNK_SIZE)
+            flush();
+    }
+}
+
+
+void WavWriter::flush()
+{
+    // Once a write fails the file is lost, so just keep draining the queue
+    size_t done = 0;
+    while(!write_failed && done < chunk_used)
+    {
+        ssize_t count = write(file, chunk + done, chunk_used - done);
+        if(count < 0 && errno == EINTR)
+            continue;
+        if(count <= 0)
+            write_failed = true;
+        else
+            done += count;
     }
-    samples_written++;
+    chunk_used = 0;
 }
@@ -1,10 +1,15 @@
 #ifndef WAV_WRITER_H
 #define WAV_WRITER_H
 
-#include <fstream>
+#include <atomic>
+#include <cstddef>
+#include <exception>
 #include <string>
+#include <thread>
+#include <vector>
 #include "audio_generics.h"
 #include "portaudio_wrapper.h"
+#include "spsc_ringbuffer.h"
 
 
 namespace ClickTrack
@@ -13,22 +18,112 @@ namespace ClickTrack
      * writes it out to a wav file.
      *
      * Must be terminated gracefully to update the length params in the header
-     * Uses 16-bit integer PCM
+     * Writes 16 or 24-bit integer or 32-bit float PCM. Files that grow past
+     * 4 GB are finished as RF64.
+     *
+     * The audio thread only copies each block into a queue. A background disk
+     * thread encodes the blocks and writes them out in large chunks, so a
+     * stalled disk never holds up the audio thread. If the disk falls too far
+     * behind, blocks are dropped and counted, and written out as silence so
+     * the recording keeps its timing.
      */
     class WavWriter : public AudioConsumer
     {
         public:
-            WavWriter(const char* in_filename, unsigned num_inputs = 1);
+            enum Format { PCM16, PCM24, FLOAT32 };
+
+            WavWriter(const char* in_filename, unsigned num_inputs = 1,
+                    Format format = PCM16);
             ~WavWriter();
 
+            /* Returns how many blocks were dropped because the disk thread
+             * fell behind
+             */
+            unsigned long get_dropped_blocks();
+
+            /* When lossless, a full queue makes the audio thread wait for the
+             * disk instead of dropping blocks. Use this for offline rendering,
+             * where there is no deadline to miss.
+             */
+            void set_lossless(bool lossless);
+
         private:
-            void process_inputs(std::vector<SAMPLE>& input, unsigned long t);
+            void process_block(std::vector<const SAMPLE*>& inputs,
+                    unsigned long t);
+
+            /* Disk thread. Drains the queue until the writer is destroyed.
+             */
+            void disk_loop();
+
+            /* A queued block, holding one channel after another
+             */
+            struct Block
+            {
+                SAMPLE* samples;
+                unsigned long t;
+            };
+
+            /* Encodes one queued block into the chunk, after filling any gap
+             * left by dropped blocks with silence
+             */
+            void write_block(const Block& block);
+
+            /* Adds bytes, or zeros, to the chunk, writing it out each time it
+             * fills up
+             */
+            void append(const unsigned char* bytes, size_t n);
+            void append_silence(size_t n);
+            void flush();
+
+            /* Fills in the header for the given length of audio data
+             */
+            static const unsigned HEADER_SIZE = 80;
+            void fill_header(unsigned char* header,
+                    unsigned long long data_size);
 
 
-            const char* filename;
-            std::ofstream file;
+            static const unsigned QUEUE_BLOCKS = 512;
+            static const size_t CHUNK_SIZE = 1 << 20;
 
-            unsigned samples_written; // number of frames of samples
+            const Format format;
+            const unsigned frame_size; // bytes per frame
+            int file;
+
+            /* The queue. Blocks are handed to the disk thread through
+             * ready_blocks, and back to the audio thread through free_blocks.
+             */
+            std::vector<SAMPLE> queue_memory;
+            SpscRingBuffer<Block> ready_blocks;
+            SpscRingBuffer<Block> free_blocks;
+            std::atomic<bool> lossless;
+            std::atomic<unsigned long> dropped_blocks;
+
+            /* Only touched by the disk thread while it runs
+             */
+            unsigned char* chunk;
+            size_t chunk_used;
+            std::vector<const SAMPLE*> channels;
+            std::vector<SAMPLE> interleaved;
+            std::vector<unsigned char> encoded;
+            bool started;
+            unsigned long next_t;
+            unsigned long long samples_written; // number of frames of samples
+            bool write_failed;
+
+            std::atomic<bool> running;
+            std::thread disk_thread;
+    };
+
+
+    /* Thrown when we can't create the output file
+     */
+    class WavFileNotWritable: public std::exception
+    {
+        public:
+            virtual const char* what() const throw()
+            {
+                return "Could not open wav file for writing";
+            }
     };
 }
 
@@ -0,0 +1,214 @@
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include "fft.h"
+#include "wav_reader.h"
+#include "wavetable.h"
+
+using namespace ClickTrack;
+
+
+/* Reads the first channel of a wav file
+ */
+static std::vector<SAMPLE> read_cycle(const char* filename)
+{
+    WavReader wav(filename);
+    std::vector<std::vector<SAMPLE>> channels;
+    wav.read_all(channels);
+    return channels[0];
+}
+
+
+Wavetable::Wavetable()
+    : levels(NUM_LEVELS*STRIDE, 0.0)
+{}
+
+
+Wavetable::Wavetable(const std::vector<SAMPLE>& cycle)
+    : levels(NUM_LEVELS*STRIDE, 0.0)
+{
+    if(cycle.empty())
+        return;
+
+    // Take the DFT of the cycle at its own length, so harmonics past our
+    // table size are dropped rather than folded back down by resampling.
+    // This only runs on load, so a direct DFT is fast enough
+    const unsigned length = cycle.size();
+    std::vector<double> cosines(length), sines(length);
+    for(unsigned k = 0; k < length; k++)
+    {
+        cosines[k] = cos(2*M_PI*k/length);
+        sines[k] = sin(2*M_PI*k/length);
+    }
+
+    // Bins are rescaled from the cycle's length to our table size. A tone
+    // at the cycle's Nyquist lands in its bin twice as loud as any other
+    std::vector< std::complex<SAMPLE> > spectrum(TABLE_SIZE/2+1, 0.0);
+    const unsigned harmonics = std::min(TABLE_SIZE/2, length/2);
+    for(unsigned h = 0; h <= harmonics; h++)
+    {
+        double real = 0.0, imag = 0.0;
+        for(unsigned n = 0; n < length; n++)
+        {
+            unsigned k = (unsigned long long) h*n % length;
+            real += cycle[n]*cosines[k];
+            imag -= cycle[n]*sines[k];
+        }
+
+        double scale = (double) TABLE_SIZE/length;
+        if(h > 0 && 2*h == length)
+            scale /= 2;
+        spectrum[h] = std::complex<SAMPLE>(scale*real, scale*imag);
+    }
+    build(spectrum);
+}
+
+
+Wavetable::Wavetable(const char* filename)
+    : Wavetable(read_cycle(filename))
+{}
+
+
+std::shared_ptr<const Wavetable> Wavetable::get_shape(Shape shape)
+{
+    // Build each shape from its Fourier series, as the sum of a[h]*sin(hx) +
+    // b[h]*cos(hx). A real tone of amplitude a lands in its bin as N/2*a.
+    static const std::shared_ptr<const Wavetable> shapes[] = {
+        make_shape(SINE), make_shape(SAW), make_shape(SQUARE),
+        make_shape(TRIANGLE) };
+    return shapes[shape];
+}
+
+
+std::shared_ptr<const Wavetable> Wavetable::make_shape(Shape shape)
+{
+    const double scale = TABLE_SIZE/2;
+    std::vector< std::complex<SAMPLE> > spectrum(TABLE_SIZE/2+1, 0.0);
+    for(unsigned h = 1; h <= TABLE_SIZE/2; h++)
+    {
+        double a = 0.0, b = 0.0;
+        switch(shape)
+        {
+            case SINE:
+                a = h == 1 ? 1.0 : 0.0;
+                break;
+            case SAW:
+                a = -2/(M_PI*h);
+                break;
+            case SQUARE:
+                a = h % 2 == 1 ? 4/(M_PI*h) : 0.0;
+                break;
+            case TRIANGLE:
+                b = h % 2 == 1 ? -8/(M_PI*M_PI*h*h) : 0.0;
+                break;
+        }
+        spectrum[h] = std::complex<SAMPLE>(scale*b, -scale*a);
+    }
+
+    std::shared_ptr<Wavetable> table(new Wavetable());
+    table->build(spectrum);
+    return table;
+}
+
+
+void Wavetable::build(std::vector< std::complex<SAMPLE> >& spectrum)
+{
+    // Each level drops the upper half of the harmonics left in the one before
+    Transformer transformer(TABLE_SIZE);
+    unsigned harmonics = TABLE_SIZE/2;
+    for(unsigned level = 0; level < NUM_LEVELS; level++, harmonics /= 2)
+    {
+        for(unsigned h = harmonics+1; h <= TABLE_SIZE/2; h++)
+            spectrum[h] = 0.0;
+
+        SAMPLE* table = &levels[level*STRIDE];
+        transformer.irfft(&spectrum[0], table);
+        table[TABLE_SIZE] = table[0];
+    }
+}
+
+
+unsigned Wavetable::get_level(float phase_inc)
+{
+    // Level i holds TABLE_SIZE/2 >> i harmonics, and the highest must stay
+    // under Nyquist. So i is log2 of phase_inc*TABLE_SIZE/(2pi), rounded up,
+    // which we read from its exponent bits after rounding the mantissa up
+    float x = fabsf(phase_inc) * (float) (TABLE_SIZE/(2*M_PI));
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    int level = (int) ((bits + 0x7fffff) >> 23) - 127;
+
+    if(level <= 0)
+        return 0;
+    if(level >= (int) NUM_LEVELS)
+        return NUM_LEVELS-1;
+    return level;
+}
+
+
+SAMPLE Wavetable::read(float phase, float phase_inc) const
+{
+    const SAMPLE* table = &levels[get_level(phase_inc)*STRIDE];
+
+    // Floor the position, then wrap negative phases around through the mask
+    float position = phase * (float) (TABLE_SIZE/(2*M_PI));
+    int whole = position;
+    if(whole > position)
+        whole--;
+    float frac = position - whole;
+    unsigned i = (unsigned) whole & (TABLE_SIZE-1);
+    return table[i] + frac*(table[i+1] - table[i]);
+}
+
+
+void Wavetable::read(const float* phases, const float* phase_incs,
+        SAMPLE* outs, unsigned n) const
+{
+    unsigned i = 0;
+#ifdef __SSE2__
+    const __m128 scale = _mm_set1_ps(TABLE_SIZE/(2*M_PI));
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128i mantissa = _mm_set1_epi32(0x7fffff);
+    const __m128i bias = _mm_set1_epi32(127);
+    const __m128i top = _mm_set1_epi32(NUM_LEVELS-1);
+    for(; i+4 <= n; i += 4)
+    {
+        // Pick levels as get_level does
+        __m128 x = _mm_mul_ps(_mm_and_ps(_mm_loadu_ps(phase_incs+i),
+                    abs_mask), scale);
+        __m128i level = _mm_sub_epi32(_mm_srli_epi32(_mm_add_epi32(
+                        _mm_castps_si128(x), mantissa), 23), bias);
+        level = _mm_and_si128(level, _mm_cmpgt_epi32(level,
+                    _mm_setzero_si128()));
+        __m128i over = _mm_cmpgt_epi32(level, top);
+        level = _mm_or_si128(_mm_and_si128(over, top),
+                _mm_andnot_si128(over, level));
+
+        // Floor the position, stepping truncated negatives down by one
+        __m128 position = _mm_mul_ps(_mm_loadu_ps(phases+i), scale);
+        __m128i whole = _mm_cvttps_epi32(position);
+        __m128 below = _mm_cmpgt_ps(_mm_cvtepi32_ps(whole), position);
+        whole = _mm_add_epi32(whole, _mm_castps_si128(below));
+        __m128 frac = _mm_sub_ps(position, _mm_cvtepi32_ps(whole));
+
+        // Then look up each lane's pair of samples. Level offsets fit in 16
+        // bits, so a 16 bit multiply is enough
+        int index[4];
+        __m128i offset = _mm_mullo_epi16(level, _mm_set1_epi32(STRIDE));
+        _mm_storeu_si128((__m128i*) index, _mm_add_epi32(offset,
+                    _mm_and_si128(whole, _mm_set1_epi32(TABLE_SIZE-1))));
+        __m128 a = _mm_setr_ps(levels[index[0]], levels[index[1]],
+                levels[index[2]], levels[index[3]]);
+        __m128 b = _mm_setr_ps(levels[index[0]+1], levels[index[1]+1],
+                levels[index[2]+1], levels[index[3]+1]);
+        _mm_storeu_ps(outs+i, _mm_add_ps(a,
+                    _mm_mul_ps(frac, _mm_sub_ps(b, a))));
+    }
+#endif
+    for(; i < n; i++)
+        outs[i] = read(phases[i], phase_incs[i]);
+}
@@ -0,0 +1,86 @@
+#ifndef WAVETABLE_H
+#define WAVETABLE_H
+
+#include <complex>
+#include <memory>
+#include <vector>
+#include "portaudio_wrapper.h"
+
+
+namespace ClickTrack
+{
+    /* A wavetable holds one cycle of a waveform, band limited into a set of
+     * mip levels. Level 0 keeps every harmonic the table can hold, and each
+     * level after keeps half as many as the one before, so every octave of
+     * pitch has a level with nothing above Nyquist.
+     *
+     * Levels are built from the waveform's spectrum with our FFT. Reads pick
+     * the level from the phase increment, and interpolate linearly between
+     * table samples.
+     *
+     * Tables never change once built, so any number of oscillators may share
+     * one.
+     */
+    class Wavetable
+    {
+        public:
+            static const unsigned TABLE_SIZE = 2048;
+            static const unsigned NUM_LEVELS = 11; // 1024 harmonics down to 1
+
+            /* Builds the table from one cycle of any length. Harmonics past
+             * the 1024 the table can hold are dropped.
+             */
+            Wavetable(const std::vector<SAMPLE>& cycle);
+
+            /* Loads one cycle from the first channel of a wav file. Throws
+             * InvalidWavFile if it cannot be read.
+             */
+            Wavetable(const char* filename);
+
+            /* Band-limited shapes, built once and shared by the whole
+             * process. They line up with the Oscillator modes of the same
+             * name, but the triangle has unit amplitude at every frequency.
+             */
+            enum Shape { SINE, SAW, SQUARE, TRIANGLE };
+            static std::shared_ptr<const Wavetable> get_shape(Shape shape);
+
+            /* Returns the waveform at the given phase, in radians. Phases
+             * outside one cycle wrap around. The phase increment is the
+             * distance in radians the phase moves each sample, and picks
+             * the level.
+             */
+            SAMPLE read(float phase, float phase_inc) const;
+
+            /* Reads n phases at once, as above. With SSE, four are read
+             * together.
+             */
+            void read(const float* phases, const float* phase_incs,
+                    SAMPLE* outs, unsigned n) const;
+
+            /* Returns the level used for the given phase increment
+             */
+            static unsigned get_level(float phase_inc);
+
+        private:
+            Wavetable();
+            Wavetable(const Wavetable&) = delete;
+            Wavetable& operator=(const Wavetable&) = delete;
+
+            /* Fills every level from the spectrum of one cycle, holding
+             * TABLE_SIZE/2+1 bins
+             */
+            void build(std::vector< std::complex<SAMPLE> >& spectrum);
+
+            /* Builds one of the shared shapes from its Fourier series
+             */
+            static std::shared_ptr<const Wavetable> make_shape(Shape shape);
+
+            /* Each level holds TABLE_SIZE samples, then a copy of the first
+             * so reads never wrap between the two they interpolate
+             */
+            static const unsigned STRIDE = TABLE_SIZE+1;
+            std::vector<SAMPLE> levels;
+    };
+}
+
+#endif
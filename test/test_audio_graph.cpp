@@ -0,0 +1,209 @@
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include "../src/adder.h"
+#include "../src/audio_graph.h"
+#include "../src/gain_filter.h"
+#include "../src/oscillator.h"
+#include "../src/thread_pool.h"
+#include "../src/timing_manager.h"
+
+using namespace ClickTrack;
+
+
+/* A consumer that records the first sample of each block it receives
+ */
+class BlockRecorder : public AudioConsumer
+{
+    public:
+        BlockRecorder() : AudioConsumer(1), samples() {}
+        std::vector<SAMPLE> samples;
+
+    private:
+        void process_block(std::vector<const SAMPLE*>& inputs, unsigned long t)
+        {
+            samples.push_back(inputs[0][0]);
+        }
+};
+
+
+/* Runs a bank of oscillators into an adder, with the given number of threads,
+ * and records its output
+ */
+std::vector<SAMPLE> run_bank(unsigned num_threads)
+{
+    const unsigned num_oscillators = 16;
+    Oscillator lfo(Oscillator::Sine, 5);
+    std::vector<Oscillator*> oscillators;
+    std::vector<GainFilter*> gains;
+    Adder adder(num_oscillators);
+    for(unsigned i = 0; i < num_oscillators; i++)
+    {
+        oscillators.push_back(new Oscillator(Oscillator::BlepSaw, 110*(i+1)));
+        oscillators[i]->set_lfo_input(lfo.get_output_channel());
+        oscillators[i]->set_lfo_intensity(0.5);
+
+        gains.push_back(new GainFilter(-1.0*i));
+        gains[i]->set_input_channel(oscillators[i]->get_output_channel());
+        adder.set_input_channel(gains[i]->get_output_channel(), i);
+    }
+
+    BlockRecorder recorder;
+    recorder.set_input_channel(adder.get_output_channel());
+
+    AudioGraph graph;
+    graph.set_num_threads(num_threads);
+    graph.add_consumer(&recorder);
+    for(unsigned i = 0; i < 100; i++)
+        graph.run(i*BUFFER_SIZE);
+
+    for(unsigned i = 0; i < num_oscillators; i++)
+    {
+        delete gains[i];
+        delete oscillators[i];
+    }
+    return recorder.samples;
+}
+
+
+/* Counts how many times each task of a batch runs
+ */
+void count_task(void* arg, unsigned i)
+{
+    std::atomic<unsigned>* counts = (std::atomic<unsigned>*) arg;
+    counts[i].fetch_add(1, std::memory_order_relaxed);
+}
+
+
+int main()
+{
+    std::cout << "Starting test..." << "\n\n" << std::endl;
+
+
+    // Build a diamond, with an LFO read as a side channel
+    Oscillator osc(Oscillator::Saw, 440);
+    Oscillator lfo(Oscillator::Sine, 5);
+
+    GainFilter left(0.0);
+    left.set_input_channel(osc.get_output_channel());
+    left.set_lfo_input(lfo.get_output_channel());
+    GainFilter right(-3.0);
+    right.set_input_channel(osc.get_output_channel());
+
+    Adder adder(2);
+    adder.set_input_channel(left.get_output_channel(), 0);
+    adder.set_input_channel(right.get_output_channel(), 1);
+
+    BlockRecorder recorder;
+    recorder.set_input_channel(adder.get_output_channel());
+
+    AudioGraph graph;
+    graph.add_consumer(&recorder);
+    graph.compile();
+
+    std::cout << "Compiled " << graph.get_num_nodes() << " nodes" << std::endl;
+    if(graph.get_num_nodes() != 6)
+        throw "Failed to find every node in the graph";
+    if(graph.get_num_levels() != 4)
+        throw "Failed to group the graph into levels";
+
+
+    // Run a few blocks
+    for(unsigned i = 0; i < 4; i++)
+        graph.run(i*BUFFER_SIZE);
+    std::cout << "Ran " << recorder.samples.size() << " blocks" << std::endl;
+    if(recorder.samples.size() != 4)
+        throw "Failed to run the consumer once per block";
+
+
+    // Rewiring must trigger a recompile
+    adder.remove_channel(1);
+    graph.run(4*BUFFER_SIZE);
+    std::cout << "Recompiled " << graph.get_num_nodes() << " nodes" << std::endl;
+    if(graph.get_num_nodes() != 5)
+        throw "Failed to recompile after rewiring";
+
+
+    // Feeding the adder back into itself must be caught
+    adder.set_input_channel(adder.get_output_channel(), 1);
+    try
+    {
+        graph.compile();
+        throw "Failed to throw exception on cycle";
+    }
+    catch(AudioGraphCycle&)
+    {
+        std::cout << "Caught cycle." << std::endl;
+    }
+
+
+    // Running on several threads must match running on one
+    std::vector<SAMPLE> serial = run_bank(1);
+    std::vector<SAMPLE> parallel = run_bank(4);
+    std::cout << "Ran " << parallel.size() << " blocks on 4 threads" << std::endl;
+    if(serial != parallel)
+        throw "Failed to match serial output in parallel";
+
+
+    // Run many short batches back to back, of changing sizes, so workers
+    // still finishing one batch overlap the start of the next. Every task
+    // must run exactly once, and run must not return early
+    ThreadPool pool(3);
+    const unsigned max_tasks = 64;
+    std::vector< std::atomic<unsigned> > counts(max_tasks);
+    for(unsigned batch = 0; batch < 200000; batch++)
+    {
+        unsigned num_tasks = 1 + (batch*7919) % max_tasks;
+        for(unsigned i = 0; i < max_tasks; i++)
+            counts[i].store(0, std::memory_order_relaxed);
+
+        pool.run(&count_task, &counts[0], num_tasks);
+        for(unsigned i = 0; i < max_tasks; i++)
+        {
+            if(counts[i].load(std::memory_order_relaxed) != (i < num_tasks))
+                throw "Failed to run each task of a batch exactly once";
+        }
+    }
+    std::cout << "Ran 200000 batches on 4 threads" << std::endl;
+
+
+    // Profile a chain through the timing manager, while another thread polls
+    TimingManager timer;
+    Oscillator source(Oscillator::BlepSaw, 220);
+    GainFilter gain(-6.0);
+    gain.set_input_channel(source.get_output_channel());
+    BlockRecorder sink;
+    sink.set_input_channel(gain.get_output_channel());
+    timer.add_audio_consumer(&sink);
+    timer.set_profiling(true);
+
+    std::atomic<bool> done(false);
+    std::thread monitor([&timer, &done]()
+    {
+        while(!done.load())
+            timer.get_dsp_snapshot();
+    });
+    for(unsigned i = 0; i < 10*BUFFER_SIZE; i++)
+        timer.tick();
+    done.store(true);
+    monitor.join();
+
+    DspProfiler::Snapshot snapshot = timer.get_dsp_snapshot();
+    std::cout << "Profiled " << snapshot.blocks << " blocks, load " <<
+        100*snapshot.load << "%, worst block " << snapshot.worst_block_us <<
+        "us" << std::endl;
+    for(auto& node : snapshot.nodes)
+        std::cout << "    " << node.name << ": " << node.mean_us << "us" <<
+            std::endl;
+    if(snapshot.blocks != 10 || snapshot.nodes.size() != 3)
+        throw "Failed to profile every block and node";
+    if(snapshot.nodes[0].name != "ClickTrack::Oscillator")
+        throw "Failed to name the profiled nodes";
+    if(snapshot.worst_block_us <= 0 || snapshot.xruns != 0)
+        throw "Failed to time the profiled blocks";
+
+
+    std::cout << "\n\n" << "All tests passed!" << std::endl;
+
+    return 0;
+}
@@ -1,15 +1,153 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
 #include <iostream>
+#include <thread>
+#include <vector>
 #include "../src/convolution_filter.h"
+#include "../src/low_latency_convolver.h"
 #include "../src/speaker.h"
 #include "../src/timing_manager.h"
+#include "../src/uniform_convolver.h"
 #include "../src/wav_reader.h"
 #include "../src/wav_writer.h"
 
 using namespace ClickTrack;
 
 
+/* Returns a random signal in [-1, 1]
+ */
+std::vector<SAMPLE> random_signal(unsigned length)
+{
+    std::vector<SAMPLE> signal(length);
+    for(unsigned i = 0; i < length; i++)
+        signal[i] = 2.0*rand()/RAND_MAX - 1.0;
+    return signal;
+}
+
+
+/* Streams input through the convolver one block at a time, and compares the
+ * output against direct convolution. The input must be a whole number of
+ * blocks. Returns the worst error, relative to the largest expected output.
+ */
+float check_convolver(Convolver& convolver, const std::vector<SAMPLE>& impulse,
+        const std::vector<SAMPLE>& input)
+{
+    unsigned block_size = convolver.get_block_size();
+    std::vector<SAMPLE> output(input.size());
+    for(unsigned i = 0; i + block_size <= input.size(); i += block_size)
+        convolver.process(&input[i], &output[i]);
+
+    double worst = 0.0, peak = 0.0;
+    for(unsigned i = 0; i < input.size(); i++)
+    {
+        double expected = 0.0;
+        for(unsigned j = 0; j < impulse.size() && j <= i; j++)
+            expected += (double) impulse[j] * input[i-j];
+
+        worst = std::max(worst, fabs(expected - output[i]));
+        peak = std::max(peak, fabs(expected));
+    }
+    return worst / peak;
+}
+
+
 int main()
 {
+    std::cout << "Starting test..." << "\n\n" << std::endl;
+
+
+    // Check the uniform convolver against direct convolution, with impulses
+    // both a whole number of partitions long and not
+    const unsigned partition_size = 256;
+    const unsigned impulse_lengths[] = {1, 100, 256, 1000, 1024, 5000};
+    for(unsigned length : impulse_lengths)
+    {
+        std::vector<SAMPLE> impulse = random_signal(length);
+        UniformConvolver convolver(partition_size, &impulse[0], length);
+
+        // Run the input a few partitions past the end of the impulse
+        unsigned input_length = (length/partition_size + 4)*partition_size;
+        float error = check_convolver(convolver, impulse,
+                random_signal(input_length));
+        std::cout << "Uniform convolver, impulse of " << length <<
+            " samples: relative error " << error << std::endl;
+        if(error > 1e-4)
+            throw "Failed to match direct convolution";
+    }
+    std::cout << std::endl;
+
+
+    // The low latency convolver must match too, across its FIR head and the
+    // edge of every segment at 64, 256, 2048 and 8192 samples
+    const unsigned long_lengths[] = {8193, 12000, 20000};
+    for(unsigned length : long_lengths)
+    {
+        std::vector<SAMPLE> impulse = random_signal(length);
+        LowLatencyConvolver convolver(&impulse[0], length);
+
+        unsigned block_size = convolver.get_block_size();
+        unsigned input_length = (length/block_size + 64)*block_size;
+        float error = check_convolver(convolver, impulse,
+                random_signal(input_length));
+        std::cout << "Low latency convolver, impulse of " << length <<
+            " samples: relative error " << error << std::endl;
+        if(error > 1e-4)
+            throw "Failed to match direct convolution";
+    }
+
+
+    // An impulse in the first sample must come straight back out, with no
+    // latency
+    {
+        std::vector<SAMPLE> impulse = random_signal(10000);
+        LowLatencyConvolver convolver(&impulse[0], impulse.size());
+
+        unsigned block_size = convolver.get_block_size();
+        std::vector<SAMPLE> input(block_size, 0.0), output(block_size);
+        input[0] = 1.0;
+        for(unsigned i = 0; i < impulse.size(); i += block_size)
+        {
+            convolver.process(&input[0], &output[0]);
+            input[0] = 0.0;
+            for(unsigned j = 0; j < block_size && i+j < impulse.size(); j++)
+            {
+                if(fabs(output[j] - impulse[i+j]) > 1e-4)
+                    throw "Failed to convolve with zero latency";
+            }
+        }
+        std::cout << "Low latency convolver returned the impulse with no "
+            << "latency" << std::endl;
+    }
+
+
+    // Fed at the pace of real time, background jobs must never be late
+    {
+        std::vector<SAMPLE> impulse = random_signal(SAMPLE_RATE);
+        LowLatencyConvolver convolver(&impulse[0], impulse.size());
+
+        unsigned block_size = convolver.get_block_size();
+        std::vector<SAMPLE> input = random_signal(block_size);
+        std::vector<SAMPLE> output(block_size);
+        auto block_time = std::chrono::microseconds(
+                1000000ull*block_size/SAMPLE_RATE);
+        auto deadline = std::chrono::steady_clock::now();
+        for(unsigned i = 0; i < SAMPLE_RATE; i += block_size)
+        {
+            convolver.process(&input[0], &output[0]);
+            deadline += block_time;
+            std::this_thread::sleep_until(deadline);
+        }
+
+        std::cout << "Low latency convolver missed " <<
+            convolver.get_missed_deadlines() << " deadlines in real time" <<
+            std::endl;
+        if(convolver.get_missed_deadlines() != 0)
+            throw "Failed to finish background jobs in time";
+    }
+    std::cout << std::endl;
+
+
     try
     {
         std::cout << "Reading in impulse" << std::endl;
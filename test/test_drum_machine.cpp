@@ -0,0 +1,283 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <sys/stat.h>
+#include "../src/audio_graph.h"
+#include "../src/drum_machine.h"
+#include "../src/sample_pool.h"
+
+using namespace ClickTrack;
+
+
+/* Records every sample it is sent
+ */
+class Recorder : public AudioConsumer
+{
+    public:
+        Recorder() : AudioConsumer(1), samples() {}
+        std::vector<SAMPLE> samples;
+
+    private:
+        void process_block(std::vector<const SAMPLE*>& inputs, unsigned long t)
+        {
+            samples.insert(samples.end(), inputs[0], inputs[0]+BUFFER_SIZE);
+        }
+};
+
+
+/* Plays a drum machine into a recorder at unity gain, one block at a time
+ */
+class DrumRig
+{
+    public:
+        DrumRig(const std::string& path)
+            : drums(path), recorder(), graph(), t(0)
+        {
+            drums.volume.set_gain(0.0);
+            recorder.set_input_channel(drums.get_output_channel());
+            graph.add_consumer(&recorder);
+        }
+
+        /* Runs the next block, and returns it
+         */
+        const SAMPLE* run()
+        {
+            graph.run(t);
+            t += BUFFER_SIZE;
+            return &recorder.samples[recorder.samples.size() - BUFFER_SIZE];
+        }
+
+        DrumMachine drums;
+        Recorder recorder;
+        AudioGraph graph;
+        unsigned long t;
+};
+
+
+/* Returns true if samples [begin, end) of a block all hold the given value
+ */
+bool holds(const SAMPLE* block, unsigned begin, unsigned end, SAMPLE value)
+{
+    for(unsigned i = begin; i < end; i++)
+        if(fabs(block[i] - value) > 1e-6)
+            return false;
+    return true;
+}
+
+
+/* Writes a mono 32 bit float wav file holding a constant value. Constant
+ * samples make every mix easy to predict.
+ */
+void write_sample(const std::string& filename, float value, unsigned length)
+{
+    std::vector<unsigned char> file;
+    auto put = [&file](uint32_t value, unsigned bytes) {
+        for(unsigned i = 0; i < bytes; i++)
+            file.push_back((value >> 8*i) & 0xFF);
+    };
+    auto put_id = [&file](const char* id) {
+        file.insert(file.end(), id, id+4);
+    };
+
+    put_id("RIFF");
+    put(36 + 4*length, 4);
+    put_id("WAVE");
+    put_id("fmt ");
+    put(16, 4);
+    put(3, 2);
+    put(1, 2);
+    put(SAMPLE_RATE, 4);
+    put(4*SAMPLE_RATE, 4);
+    put(4, 2);
+    put(32, 2);
+    put_id("data");
+    put(4*length, 4);
+    for(unsigned i = 0; i < length; i++)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, 4);
+        put(bits, 4);
+    }
+
+    std::ofstream out(filename, std::ios::binary);
+    out.write((const char*) &file[0], file.size());
+    if(!out)
+        throw "Failed to write test sample";
+}
+
+
+/* Writes a kit of constant samples and its keymap into the given directory
+ */
+struct TestHit
+{
+    unsigned note;
+    const char* filename;
+    float value;
+    unsigned length;
+};
+
+void write_kit(const std::string& path, const std::vector<TestHit>& hits,
+        const std::string& extra_lines)
+{
+    mkdir(path.c_str(), 0755);
+    std::ofstream keymap(path + "keymap.txt");
+    keymap << "# Generated by test_drum_machine\n" << extra_lines;
+    for(auto& hit : hits)
+    {
+        write_sample(path + hit.filename, hit.value, hit.length);
+        keymap << hit.note << " " << hit.filename << "\n";
+    }
+    if(!keymap)
+        throw "Failed to write test keymap";
+}
+
+
+int main()
+{
+    const std::string kit_a = "wav/test_kit_a/";
+    const std::string kit_b = "wav/test_kit_b/";
+
+    const unsigned KICK = 36, CLOSED_HAT = 42, OPEN_HAT = 46, LONG = 50;
+    write_kit(kit_a, {
+            {KICK, "kick.wav", 0.125, 1000},
+            {CLOSED_HAT, "closed_hat.wav", 0.0625, 300},
+            {OPEN_HAT, "open_hat.wav", 0.25, 5000},
+            {LONG, "long.wav", 1.0/128, 2048}},
+        "choke 42 46\n");
+    write_kit(kit_b, {
+            {KICK, "kick.wav", 0.5, 300}},
+        "");
+
+
+    std::cout << "Checking layered hits" << std::endl;
+    {
+        // A second hit plays over the first, rather than restarting it
+        DrumRig rig(kit_a);
+        rig.drums.on_note_down(KICK, 1.0);
+        const SAMPLE* block = rig.run();
+        if(!holds(block, 0, BUFFER_SIZE, 0.125))
+            throw "Failed to play a single hit";
+
+        rig.drums.on_note_down(KICK, 1.0);
+        block = rig.run();
+        if(!holds(block, 0, BUFFER_SIZE, 0.25))
+            throw "Failed to sum layered hits";
+
+        // The first hit ends 1000 samples in, partway through the fourth
+        // block, leaving only the second
+        rig.run();
+        block = rig.run();
+        if(!holds(block, 0, 1000 - 3*BUFFER_SIZE, 0.25) ||
+                !holds(block, 1000 - 3*BUFFER_SIZE, BUFFER_SIZE, 0.125))
+            throw "Failed to end the first of two layered hits";
+    }
+
+
+    std::cout << "Checking choke groups" << std::endl;
+    {
+        // Closing the hi-hat cuts off the open one, but not the kick
+        DrumRig rig(kit_a);
+        rig.drums.on_note_down(KICK, 1.0);
+        rig.drums.on_note_down(OPEN_HAT, 1.0);
+        const SAMPLE* block = rig.run();
+        if(!holds(block, 0, BUFFER_SIZE, 0.375))
+            throw "Failed to play two drums at once";
+
+        rig.drums.on_note_down(CLOSED_HAT, 1.0);
+        block = rig.run();
+        if(!holds(block, 0, BUFFER_SIZE, 0.1875))
+            throw "Failed to choke the open hi-hat";
+
+        block = rig.run();
+        if(!holds(block, 0, 300 - BUFFER_SIZE, 0.1875) ||
+                !holds(block, 300 - BUFFER_SIZE, BUFFER_SIZE, 0.125))
+            throw "Failed to play out the closed hi-hat";
+    }
+
+
+    std::cout << "Checking the hit limit" << std::endl;
+    {
+        // Start the hit that will be furthest along, then shuffle it out of
+        // the first slot. When the closed hi-hat ends, the last hit moves
+        // into its place.
+        const unsigned max_hits = 64;
+        DrumRig rig(kit_a);
+        rig.drums.on_note_down(CLOSED_HAT, 1.0);
+        rig.drums.on_note_down(LONG, 1.0);
+        rig.run();
+        rig.drums.on_note_down(LONG, 1.0);
+        rig.run();
+
+        // Fill every cursor. Now there is one hit 768 samples in, one 512
+        // samples in, and the rest 256 samples in
+        for(unsigned i = 2; i < max_hits; i++)
+            rig.drums.on_note_down(LONG, 1.0);
+        const SAMPLE* block = rig.run();
+        if(!holds(block, 0, BUFFER_SIZE, max_hits/128.0))
+            throw "Failed to play every hit";
+
+        // One more hit must replace the one furthest along. The others then
+        // end one block apart
+        rig.drums.on_note_down(LONG, 1.0);
+        for(unsigned i = 0; i < 6; i++)
+        {
+            block = rig.run();
+            if(!holds(block, 0, BUFFER_SIZE, max_hits/128.0))
+                throw "Failed to replace the hit furthest along";
+        }
+        block = rig.run();
+        if(!holds(block, 0, BUFFER_SIZE, (max_hits-1)/128.0))
+            throw "Failed to end the second hit";
+        block = rig.run();
+        if(!holds(block, 0, BUFFER_SIZE, 1.0/128))
+            throw "Failed to play out the replacement hit";
+        block = rig.run();
+        if(!holds(block, 0, BUFFER_SIZE, 0.0))
+            throw "Failed to end every hit";
+    }
+
+
+    std::cout << "Checking kit swaps" << std::endl;
+    {
+        SamplePool& pool = get_sample_pool();
+        DrumRig rig(kit_a);
+        if(pool.size() != 4)
+            throw "Failed to load the first kit";
+
+        // Swap kits while a long hit is playing. The hit plays out on the
+        // old kit, mixed with hits on the new one
+        rig.drums.on_note_down(LONG, 1.0);
+        rig.run();
+        rig.drums.set_voice(kit_b);
+        if(pool.size() != 5)
+            throw "Failed to load the second kit";
+
+        const SAMPLE* block = rig.run();
+        if(!holds(block, 0, BUFFER_SIZE, 1.0/128))
+            throw "Failed to play out a hit across a kit swap";
+        rig.drums.on_note_down(KICK, 1.0);
+        block = rig.run();
+        if(!holds(block, 0, BUFFER_SIZE, 0.5 + 1.0/128))
+            throw "Failed to play the new kit";
+
+        // The old kit must be kept while its hit is still playing
+        rig.drums.set_voice(kit_b);
+        if(pool.size() != 5)
+            throw "Failed to keep a kit that is still playing";
+
+        // Then handed back once it finishes, and freed on the next swap
+        for(unsigned i = 0; i < 5; i++)
+            block = rig.run();
+        if(!holds(block, 0, BUFFER_SIZE, 1.0/128))
+            throw "Failed to play out the old kit";
+        rig.drums.set_voice(kit_b);
+        if(pool.size() != 1)
+            throw "Failed to free the old kit";
+    }
+
+    std::cout << "\n\n" << "All tests passed!" << std::endl;
+    return 0;
+}
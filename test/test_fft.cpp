@@ -1,10 +1,133 @@
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
 #include "../src/fft.h"
+#include "../src/fixed_fft.h"
 
 using namespace std;
 using namespace ClickTrack;
 
 
+/* The original textbook radix-2 transform, kept here as a baseline to
+ * benchmark against.
+ */
+class RadixTwoTransformer
+{
+    public:
+        RadixTwoTransformer(unsigned in_size)
+            : size(in_size), bit_reverses(), twiddles()
+        {
+            for(unsigned i = 0; i < size; i++)
+                bit_reverses.push_back(bit_reverse(i) >> (32-int_log(size)));
+
+            complex<float> exponent(0,-2*3.14159265358979f/size);
+            for(unsigned i = 0; i < size; i++)
+                twiddles.push_back(exp(exponent * complex<float>(i,0)));
+        }
+
+        void fft(complex<float>* in, complex<float>* out)
+        {
+            for(unsigned i = 0; i < size; i++)
+                out[bit_reverses[i]] = in[i];
+
+            for(unsigned N = 2; N <= size; N *= 2)
+            {
+                for(unsigned set = 0; set < size/N; set++)
+                {
+                    for(unsigned i = 0; i < N/2; i++)
+                    {
+                        unsigned lower_i = N*set + i;
+                        unsigned upper_i = lower_i + N/2;
+
+                        complex<float> lower = out[lower_i];
+                        complex<float> upper =
+                            out[upper_i] * twiddles[size/N * i];
+
+                        out[lower_i] = lower + upper;
+                        out[upper_i] = lower - upper;
+                    }
+                }
+            }
+        }
+
+    private:
+        const unsigned size;
+        vector<unsigned> bit_reverses;
+        vector< complex<float> > twiddles;
+};
+
+
+/* Returns the average time of one transform, in microseconds
+ */
+template <typename Function>
+double time_transform(Function transform, unsigned size)
+{
+    // Aim for a few million butterflies per measurement
+    unsigned iterations = 1 + (1 << 22) / (size*int_log(size));
+
+    auto start = chrono::steady_clock::now();
+    for(unsigned i = 0; i < iterations; i++)
+        transform();
+    chrono::duration<double, micro> elapsed =
+        chrono::steady_clock::now() - start;
+
+    return elapsed.count() / iterations;
+}
+
+
+/* Returns the largest difference between two arrays
+ */
+template <typename T>
+float max_error(const T* a, const T* b, unsigned n)
+{
+    float error = 0.0;
+    for(unsigned i = 0; i < n; i++)
+        error = max(error, (float) abs(a[i] - b[i]));
+    return error;
+}
+
+
+/* Checks every FixedTransformer<N> transform against Transformer
+ */
+template <unsigned N>
+void check_fixed_transformer()
+{
+    vector<float> real_input(N), real_expected(N), real_actual(N);
+    vector< complex<float> > input(N), expected(N), actual(N);
+    for(unsigned i = 0; i < N; i++)
+    {
+        real_input[i] = rand() / (float) RAND_MAX - 0.5;
+        input[i] = complex<float>(real_input[i],
+                rand() / (float) RAND_MAX - 0.5);
+    }
+
+    Transformer transformer(N);
+    FixedTransformer<N>* fixed = new FixedTransformer<N>();
+
+    float error = 0.0;
+    transformer.fft(&input[0], &expected[0]);
+    fixed->fft(&input[0], &actual[0]);
+    error = max(error, max_error(&expected[0], &actual[0], N));
+
+    transformer.ifft(&input[0], &expected[0]);
+    fixed->ifft(&input[0], &actual[0]);
+    error = max(error, max_error(&expected[0], &actual[0], N));
+
+    transformer.rfft(&real_input[0], &expected[0]);
+    fixed->rfft(&real_input[0], &actual[0]);
+    error = max(error, max_error(&expected[0], &actual[0], N/2+1));
+
+    transformer.irfft(&expected[0], &real_expected[0], 1.0);
+    fixed->irfft(&expected[0], &real_actual[0], 1.0);
+    error = max(error, max_error(&real_expected[0], &real_actual[0], N) / N);
+
+    delete fixed;
+    cout << "FixedTransformer<" << N << "> error " << error << endl;
+    if(error > 1e-4)
+        throw "Failed to match Transformer";
+}
+
+
 int main()
 {
     Transformer t(8);
@@ -24,8 +147,89 @@ int main()
     t.ifft(out, in);
     
     for(int i = 0; i < 8; i++)
-        cout << in_float[i] << endl;
+        cout << in[i].real() << endl;
+    cout << endl;
+
+
+    // Real transforms must invert each other at every size the convolvers
+    // and wavetables use, and match the complex transform
+    for(unsigned size = 128; size <= 8192; size *= 2)
+    {
+        vector<float> input(size), output(size), unnormalized(size);
+        vector< complex<float> > complex_input(size), expected(size);
+        vector< complex<float> > spectrum(size/2+1);
+        for(unsigned i = 0; i < size; i++)
+        {
+            input[i] = rand() / (float) RAND_MAX - 0.5;
+            complex_input[i] = input[i];
+        }
+
+        Transformer transformer(size);
+        transformer.rfft(&input[0], &spectrum[0]);
+        transformer.fft(&complex_input[0], &expected[0]);
+        float spectrum_error = max_error(&expected[0], &spectrum[0],
+                size/2+1);
+
+        transformer.irfft(&spectrum[0], &output[0]);
+        float inverse_error = max_error(&input[0], &output[0], size);
+
+        // An explicit scale replaces the 1/N normalization
+        transformer.irfft(&spectrum[0], &unnormalized[0], 1.0);
+        for(unsigned i = 0; i < size; i++)
+            unnormalized[i] /= size;
+        float scale_error = max_error(&input[0], &unnormalized[0], size);
+
+        cout << "rfft/irfft of " << size << ": spectrum error " <<
+            spectrum_error << ", round trip error " << inverse_error <<
+            ", scaled error " << scale_error << endl;
+        if(spectrum_error > 1e-3 || inverse_error > 1e-5 ||
+                scale_error > 1e-5)
+            throw "Failed to invert the real transform";
+    }
     cout << endl;
 
+    check_fixed_transformer<4>();
+    check_fixed_transformer<64>();
+    check_fixed_transformer<256>();
+    check_fixed_transformer<1024>();
+    check_fixed_transformer<4096>();
+    cout << endl;
+
+
+    // Benchmark against the old implementation
+    cout << "size\tradix-2 (us)\tfft (us)\trfft (us)\tspeedup\terror" <<
+        endl;
+    for(unsigned size = 64; size <= 16384; size *= 4)
+    {
+        vector< complex<float> > input(size), expected(size), actual(size);
+        vector<float> real_input(size);
+        for(unsigned i = 0; i < size; i++)
+        {
+            real_input[i] = rand() / (float) RAND_MAX - 0.5;
+            input[i] = complex<float>(real_input[i],
+                    rand() / (float) RAND_MAX - 0.5);
+        }
+
+        RadixTwoTransformer old_transformer(size);
+        Transformer new_transformer(size);
+
+        old_transformer.fft(&input[0], &expected[0]);
+        new_transformer.fft(&input[0], &actual[0]);
+        float error = 0.0;
+        for(unsigned i = 0; i < size; i++)
+            error = max(error, abs(expected[i] - actual[i]));
+
+        double old_time = time_transform([&]() {
+                old_transformer.fft(&input[0], &expected[0]); }, size);
+        double new_time = time_transform([&]() {
+                new_transformer.fft(&input[0], &actual[0]); }, size);
+        double real_time = time_transform([&]() {
+                new_transformer.rfft(&real_input[0], &actual[0]); }, size);
+
+        cout << size << "\t" << old_time << "\t\t" << new_time << "\t\t" <<
+            real_time << "\t\t" << old_time/new_time << "x\t" << error <<
+            endl;
+    }
+
     return 0;
 }
@@ -0,0 +1,86 @@
+#include <cstdlib>
+#include <iostream>
+#include "../src/moorer_reverb.h"
+#include "../src/offline_renderer.h"
+#include "../src/timing_manager.h"
+#include "../src/trace.h"
+#include "../src/wav_writer.h"
+
+using namespace ClickTrack;
+
+
+/* A generator that plays a short burst of noise, then silence forever
+ */
+class NoiseBurst : public AudioGenerator
+{
+    public:
+        NoiseBurst(unsigned in_length) : AudioGenerator(1), length(in_length) {}
+
+    private:
+        void generate_block(std::vector<SAMPLE*>& outputs, unsigned long t)
+        {
+            for(unsigned i = 0; i < BUFFER_SIZE; i++)
+            {
+                if(t + i < length)
+                    outputs[0][i] = 0.5 * (2.0*rand()/RAND_MAX - 1.0);
+                else
+                    outputs[0][i] = 0.0;
+            }
+        }
+
+        const unsigned length;
+};
+
+
+int main()
+{
+    try
+    {
+        std::cout << "Establishing signal chain" << std::endl;
+        TimingManager timer;
+
+        NoiseBurst burst(SAMPLE_RATE/10);
+
+        MoorerReverb rev(MoorerReverb::HALL, 1.0, 0.3, 0.5, 1);
+        rev.set_input_channel(burst.get_output_channel());
+
+        WavWriter out("wav/render_out.wav");
+        out.set_lossless(true);
+        out.set_input_channel(rev.get_output_channel());
+        timer.add_audio_consumer(&out);
+
+
+        // Render the burst, then let the reverb ring out
+        OfflineRenderer renderer(timer);
+        renderer.stop_after(SAMPLE_RATE/10);
+        renderer.wait_for_tail(rev.get_output_channel(), -80.0, 0.5);
+        renderer.set_max_samples(60*SAMPLE_RATE);
+
+        std::cout << "Rendering" << std::endl;
+        OfflineRenderer::Report report = renderer.render();
+
+        std::cout << "Rendered " << report.audio_seconds << "s of audio in "
+            << report.render_seconds << "s, " << report.realtime_factor <<
+            "x realtime" << std::endl;
+        if(report.samples_rendered <= SAMPLE_RATE/10 + SAMPLE_RATE/2)
+            throw "Stopped before the tail rang out";
+        if(report.samples_rendered >= 60*SAMPLE_RATE)
+            throw "Tail never decayed";
+        if(report.samples_rendered % BUFFER_SIZE != 0)
+            throw "Rendered a partial block";
+
+        // In tracing builds, save the render's timeline
+        TRACE_WRITE("wav/render_trace.json");
+
+        std::cout << "\n\n" << "All tests passed!" << std::endl;
+    }
+    catch(std::exception& e)
+    {
+        std::cerr << "\n\n" << "EXCEPTION: " << typeid(e).name() << std::endl;
+        std::cerr << "           " << e.what() << std::endl;
+
+        exit(1);
+    }
+
+    return 0;
+}
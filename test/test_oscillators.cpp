@@ -1,3 +1,4 @@
+#include <cmath>
 #include <cstdlib>
 #include <iostream>
 #include "../src/gain_filter.h"
@@ -5,12 +6,47 @@
 #include "../src/speaker.h"
 #include "../src/timing_manager.h"
 #include "../src/wav_writer.h"
+#include "../src/wavetable.h"
 
 using namespace ClickTrack;
 
 
+/* Builds a table from a cycle of the given length holding a sine, plus a
+ * harmonic that may be too high for the table, and checks the table plays
+ * only the sine
+ */
+void check_user_wavetable(unsigned length, unsigned high_harmonic)
+{
+    std::vector<SAMPLE> cycle(length);
+    for(unsigned i = 0; i < length; i++)
+    {
+        double x = 2*M_PI*i/length;
+        cycle[i] = sin(x) + 0.5*sin(high_harmonic*x);
+    }
+    Wavetable table(cycle);
+
+    double error = 0.0;
+    for(unsigned i = 0; i < 1000; i++)
+    {
+        double phase = 2*M_PI*i/1000;
+        error = std::max(error, fabs(table.read(phase, 0.0) - sin(phase)));
+    }
+    std::cout << "User wavetable of " << length << " samples is off by " <<
+        error << std::endl;
+    if(error > 1e-4)
+        throw "Failed to band limit a user wavetable";
+}
+
+
 int main()
 {
+    // Cycles longer than the table must drop their upper harmonics, rather
+    // than fold them back down. Short cycles must play back cleanly.
+    check_user_wavetable(8192, 1500);
+    check_user_wavetable(3000, 1200);
+    check_user_wavetable(100, 0);
+    std::cout << std::endl;
+
     std::cout << "Initializing signal chain" << std::endl;
     TimingManager timer;
 
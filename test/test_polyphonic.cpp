@@ -0,0 +1,310 @@
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include "../src/audio_graph.h"
+#include "../src/fm_synth.h"
+#include "../src/polyphonic_instrument.h"
+#include "../src/subtractive_synth.h"
+
+using namespace ClickTrack;
+
+
+/* Plays nothing. Stands in for the output of the test instrument's voices.
+ */
+class Silence : public AudioGenerator
+{
+    public:
+        Silence() : AudioGenerator(1) {}
+
+    private:
+        void generate_block(std::vector<SAMPLE*>& outputs, unsigned long t)
+        {
+            for(unsigned i = 0; i < BUFFER_SIZE; i++)
+                outputs[0][i] = 0.0;
+        }
+};
+
+
+/* A voice that only counts its notes, with a level set by the test
+ */
+class TestVoice : public PolyphonicVoice
+{
+    public:
+        TestVoice(PolyphonicInstrument* parent)
+            : PolyphonicVoice(parent), level(1.0), note_downs(0),
+              note_ups(0) {}
+
+        void handle_note_down(float velocity) { note_downs++; }
+        void handle_note_up() { note_ups++; }
+        void handle_pitch_wheel(float value) {}
+        AudioChannel* get_output_channel() { return nullptr; }
+
+        float get_level() { return is_playing() ? level : 0.0; }
+
+        float level;
+        unsigned note_downs;
+        unsigned note_ups;
+};
+
+
+/* An instrument of test voices
+ */
+class TestInstrument : public PolyphonicInstrument
+{
+    public:
+        TestInstrument(unsigned num_voices)
+            : PolyphonicInstrument(num_voices), silence(), voices()
+        {
+            std::vector<PolyphonicVoice*> added;
+            for(unsigned i = 0; i < num_voices; i++)
+            {
+                voices.push_back(new TestVoice(this));
+                added.push_back(voices.back());
+            }
+            add_voices(added, silence.get_output_channel());
+        }
+
+        /* Returns true if voice i is holding the given note
+         */
+        bool plays(unsigned i, unsigned note)
+        {
+            return voices[i]->is_playing() && voices[i]->get_note() == note;
+        }
+
+        Silence silence;
+        std::vector<TestVoice*> voices;
+};
+
+
+/* Records every sample it is sent
+ */
+class Recorder : public AudioConsumer
+{
+    public:
+        Recorder() : AudioConsumer(1), samples() {}
+        std::vector<SAMPLE> samples;
+
+    private:
+        void process_block(std::vector<const SAMPLE*>& inputs, unsigned long t)
+        {
+            samples.insert(samples.end(), inputs[0], inputs[0]+BUFFER_SIZE);
+        }
+};
+
+
+/* Sets up each synth with both oscillators in the given mode, and with the
+ * LFO and envelope in use
+ */
+void set_up(SubtractiveSynth& synth, Oscillator::Mode mode)
+{
+    synth.set_osc1_mode(mode);
+    synth.set_osc2_mode(mode);
+    synth.set_osc2_transposition(7);
+    synth.set_lfo_vibrato(0.5);
+    synth.set_decay_time(0.2);
+    synth.set_release_time(0.05);
+}
+
+void set_up(FMSynth& synth, Oscillator::Mode mode)
+{
+    synth.set_carrier_mode(mode);
+    synth.set_modulator_mode(mode);
+    synth.set_modulator_transposition(12);
+    synth.set_modulator_intensity(2.0);
+    synth.set_lfo_vibrato(0.3);
+    synth.set_release_time(0.05);
+}
+
+
+/* Plays a chord through the synth with the given backend, bending, releasing
+ * and sustaining it along the way, and records the output
+ */
+template <typename Synth>
+std::vector<SAMPLE> render(PolyphonicInstrument::VoiceBackend backend,
+        Oscillator::Mode mode)
+{
+    Synth synth(6, backend);
+    set_up(synth, mode);
+
+    Recorder recorder;
+    recorder.set_input_channel(synth.get_output_channel());
+    AudioGraph graph;
+    graph.add_consumer(&recorder);
+
+    for(unsigned block = 0; block < 400; block++)
+    {
+        if(block == 3)
+            for(unsigned i = 0; i < 6; i++)
+                synth.on_note_down(48 + 5*i, 0.3 + 0.1*i);
+        if(block == 100)
+            synth.on_pitch_wheel(0.5);
+        if(block == 150)
+        {
+            synth.on_note_up(48, 1.0);
+            synth.on_note_up(58, 1.0);
+        }
+        if(block == 250)
+            synth.on_sustain_down();
+        if(block == 260)
+            for(unsigned i = 0; i < 6; i++)
+                synth.on_note_up(48 + 5*i, 1.0);
+        if(block == 300)
+            synth.on_sustain_up();
+
+        graph.run(block*BUFFER_SIZE);
+    }
+    return recorder.samples;
+}
+
+
+/* Checks the synth sounds the same rendered by a voice bank as by separate
+ * voices, in every deterministic oscillator mode
+ */
+template <typename Synth>
+void check_voice_bank(const char* name)
+{
+    const Oscillator::Mode modes[] = {Oscillator::Sine, Oscillator::Saw,
+        Oscillator::Square, Oscillator::Tri, Oscillator::BlepSaw,
+        Oscillator::BlepSquare, Oscillator::BlepTri, Oscillator::PulseTrain,
+        Oscillator::TableSaw};
+
+    for(auto mode : modes)
+    {
+        std::vector<SAMPLE> objects =
+            render<Synth>(PolyphonicInstrument::OBJECT_VOICES, mode);
+        std::vector<SAMPLE> bank =
+            render<Synth>(PolyphonicInstrument::VOICE_BANK, mode);
+
+        double peak = 0.0, error = 0.0;
+        for(unsigned i = 0; i < objects.size(); i++)
+        {
+            peak = std::max(peak, (double) fabs(objects[i]));
+            error = std::max(error, (double) fabs(objects[i] - bank[i]));
+        }
+        std::cout << name << " mode " << mode << " differs by " <<
+            error/peak << " of peak" << std::endl;
+        if(peak == 0.0 || error > 1e-4*peak)
+            throw "Failed to match object voices with the voice bank";
+    }
+}
+
+
+int main()
+{
+    std::cout << "Checking retriggers" << std::endl;
+    {
+        // A held note retriggers its own voice, even with others free, and
+        // counts as the newest
+        TestInstrument synth(3);
+        synth.on_note_down(60, 1.0);
+        synth.on_note_down(62, 1.0);
+        synth.on_note_down(60, 1.0);
+        if(!synth.plays(0, 60) || synth.voices[0]->note_downs != 2 ||
+                !synth.plays(1, 62) || synth.voices[2]->is_playing())
+            throw "Failed to retrigger a held note on its own voice";
+
+        synth.on_note_down(64, 1.0);
+        synth.on_note_down(65, 1.0);
+        if(!synth.plays(0, 60) || !synth.plays(1, 65) || !synth.plays(2, 64))
+            throw "Failed to steal the oldest voice after a retrigger";
+    }
+
+
+    std::cout << "Checking same note stealing" << std::endl;
+    {
+        // By default a repeated note takes the free voice released longest
+        // ago, leaving the first note's tail to ring
+        TestInstrument synth(3);
+        synth.on_note_down(60, 1.0);
+        synth.on_note_up(60, 1.0);
+        synth.on_note_down(60, 1.0);
+        if(!synth.plays(1, 60) || synth.voices[0]->note_downs != 1)
+            throw "Failed to play a repeated note on a fresh voice";
+    }
+    {
+        // Same note instead restarts the voice still releasing it
+        TestInstrument synth(3);
+        synth.set_steal_policy(PolyphonicInstrument::STEAL_SAME_NOTE);
+        synth.on_note_down(60, 1.0);
+        synth.on_note_up(60, 1.0);
+        synth.on_note_down(60, 1.0);
+        if(!synth.plays(0, 60) || synth.voices[0]->note_downs != 2 ||
+                synth.voices[1]->note_downs != 0)
+            throw "Failed to reclaim the voice releasing the same note";
+
+        // The other voices must still be free, and the reclaimed voice the
+        // oldest held
+        synth.on_note_down(62, 1.0);
+        synth.on_note_down(64, 1.0);
+        synth.on_note_down(65, 1.0);
+        if(!synth.plays(0, 65) || !synth.plays(1, 62) || !synth.plays(2, 64))
+            throw "Failed to keep the voice lists in order after a reclaim";
+    }
+
+
+    std::cout << "Checking quietest stealing" << std::endl;
+    {
+        TestInstrument synth(3);
+        synth.set_steal_policy(PolyphonicInstrument::STEAL_QUIETEST);
+        synth.on_note_down(60, 1.0);
+        synth.on_note_down(62, 1.0);
+        synth.on_note_down(64, 1.0);
+        synth.voices[0]->level = 0.8;
+        synth.voices[1]->level = 0.2;
+        synth.voices[2]->level = 0.5;
+
+        synth.on_note_down(65, 1.0);
+        if(!synth.plays(0, 60) || !synth.plays(1, 65) || !synth.plays(2, 64))
+            throw "Failed to steal the quietest voice";
+
+        // On a tie, take the oldest
+        synth.voices[0]->level = 0.5;
+        synth.voices[1]->level = 0.5;
+        synth.on_note_down(67, 1.0);
+        if(!synth.plays(0, 67) || !synth.plays(1, 65) || !synth.plays(2, 64))
+            throw "Failed to steal the oldest of the quietest voices";
+    }
+
+
+    std::cout << "Checking stale notes" << std::endl;
+    {
+        // Once a voice is stolen, its old note no longer reaches it
+        TestInstrument synth(2);
+        synth.on_note_down(60, 1.0);
+        synth.on_note_down(62, 1.0);
+        synth.on_note_down(64, 1.0);
+        if(!synth.plays(0, 64))
+            throw "Failed to steal the oldest voice";
+
+        synth.on_note_up(60, 1.0);
+        if(!synth.plays(0, 64) || synth.voices[0]->note_ups != 0)
+            throw "Failed to ignore the release of a stolen note";
+
+        synth.on_note_down(60, 1.0);
+        if(!synth.plays(0, 64) || !synth.plays(1, 60))
+            throw "Failed to ignore a stale voice when replaying its note";
+    }
+    {
+        // Nor does it reach a voice that has moved on and been released, so
+        // same note stealing takes the free voice released longest ago
+        TestInstrument synth(3);
+        synth.set_steal_policy(PolyphonicInstrument::STEAL_SAME_NOTE);
+        synth.on_note_down(60, 1.0);
+        synth.on_note_down(62, 1.0);
+        synth.on_note_down(63, 1.0);
+        synth.on_note_down(64, 1.0);
+        synth.on_note_up(62, 1.0);
+        synth.on_note_up(64, 1.0);
+        synth.on_note_down(60, 1.0);
+        if(!synth.plays(1, 60) || synth.voices[0]->is_playing() ||
+                synth.voices[0]->get_note() != 64)
+            throw "Failed to take a free voice for a stale note";
+    }
+
+    std::cout << std::endl;
+    check_voice_bank<SubtractiveSynth>("Subtractive synth");
+    check_voice_bank<FMSynth>("FM synth");
+
+    std::cout << "\n\n" << "All tests passed!" << std::endl;
+    return 0;
+}
@@ -1,5 +1,13 @@
+#include <algorithm>
 #include <iostream>
+#include <thread>
+
+// Check every access to the masked ring buffer
+#ifndef RINGBUFFER_DEBUG
+#define RINGBUFFER_DEBUG
+#endif
 #include "../src/ringbuffer.h"
+#include "../src/spsc_ringbuffer.h"
 
 using namespace ClickTrack;
 
@@ -90,6 +98,104 @@ int main()
     }
 
 
+    // Test the masked variant rounds up to a power of two. The audio path
+    // instantiates SAMPLE buffers without checks, so use our own type here.
+    MaskedRingBuffer<double> masked(5);
+    std::cout << "\n" << "Masked buffer capacity: " <<
+        masked.get_capacity() << std::endl;
+    if(masked.get_capacity() != 8)
+        throw "Failed test on masked capacity";
+
+    try
+    {
+        masked.get(0);
+        throw "Failed to throw exception on empty masked buffer";
+    }
+    catch(RingBufferOutOfRange&)
+    {
+        std::cout << "Caught empty masked buffer." << std::endl;
+    }
+
+
+    // Fill it past the end of the ring, so a block wraps around
+    for(unsigned t = 0; t < 6; t++)
+        masked.add(t);
+    double block[5] = {6, 7, 8, 9, 10};
+    masked.write_block(block, 5);
+
+    MaskedRingBuffer<double>::Spans spans = masked.read_block(3, 8);
+    std::cout << "Spans of [3, 11): " << spans.first.length << " and " <<
+        spans.second.length << std::endl;
+    if(spans.first.length != 5 || spans.second.length != 3)
+        throw "Failed test on wrapped spans";
+
+    try
+    {
+        masked.read_block(2, 8);
+        throw "Failed to throw exception on underflow of masked buffer";
+    }
+    catch(RingBufferOutOfRange&)
+    {
+        std::cout << "Caught underflow of masked buffer." << std::endl;
+    }
+
+
+    // Accumulate across the wrap, and read it back
+    double ones[4] = {1, 1, 1, 1};
+    masked.add_block(6, ones, 4, 0.5);
+
+    double result[8];
+    masked.read_block(3, result, 8);
+    std::cout << "\n" << "Getting masked range:" << std::endl;
+    for(unsigned i = 0; i < 8; i++)
+    {
+        unsigned t = i+3;
+        double expected = t + (t >= 6 && t < 10 ? 0.5 : 0.0);
+        std::cout << "Time t=" << t << ": " << result[i] << std::endl;
+        if(result[i] != expected || masked[t] != expected)
+            throw "Failed test on masked lookup";
+    }
+
+
+    // Stream values through the lock-free queue from another thread, in
+    // uneven batches so both indices wrap many times
+    SpscRingBuffer<unsigned> queue(100);
+    std::cout << "\n" << "Lock-free queue capacity: " <<
+        queue.get_capacity() << std::endl;
+    if(queue.get_capacity() != 128)
+        throw "Failed test on lock-free queue capacity";
+
+    const unsigned count = 1000000;
+    std::thread producer([&queue, count]()
+    {
+        unsigned batch[37];
+        unsigned next = 0;
+        while(next < count)
+        {
+            unsigned n = std::min(37u, count - next);
+            for(unsigned i = 0; i < n; i++)
+                batch[i] = next + i;
+            next += queue.push_batch(batch, n);
+        }
+    });
+
+    unsigned batch[53];
+    unsigned expected = 0;
+    while(expected < count)
+    {
+        unsigned n = queue.pop_batch(batch, 53);
+        for(unsigned i = 0; i < n; i++, expected++)
+            if(batch[i] != expected)
+                throw "Failed test on lock-free queue ordering";
+    }
+    producer.join();
+
+    if(queue.size() != 0 || queue.front() != nullptr)
+        throw "Failed test on empty lock-free queue";
+    std::cout << "Passed " << count << " values through the lock-free queue."
+        << std::endl;
+
+
     std::cout << "\n\n" << "All tests passed!" << std::endl;
 
     return 0;
@@ -1,4 +1,9 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include "../src/audio_graph.h"
 #include "../src/speaker.h"
 #include "../src/timing_manager.h"
 #include "../src/wav_reader.h"
@@ -7,8 +12,345 @@
 using namespace ClickTrack;
 
 
+/* Records both channels of whatever it is connected to
+ */
+class StereoRecorder : public AudioConsumer
+{
+    public:
+        StereoRecorder() : AudioConsumer(2), left(), right() {}
+        std::vector<SAMPLE> left;
+        std::vector<SAMPLE> right;
+
+    private:
+        void process_block(std::vector<const SAMPLE*>& inputs, unsigned long t)
+        {
+            left.insert(left.end(), inputs[0], inputs[0]+BUFFER_SIZE);
+            right.insert(right.end(), inputs[1], inputs[1]+BUFFER_SIZE);
+        }
+};
+
+
+/* Describes a wav file for the reader to parse
+ */
+struct TestFile
+{
+    const char* name;
+    unsigned format; // 1 for integer PCM, 3 for float
+    unsigned byte_depth;
+    unsigned num_channels;
+    bool extensible;
+    bool rf64;
+    bool odd_chunk; // add an odd length chunk before the data
+};
+
+
+/* Little-endian field writers
+ */
+void put16(std::vector<unsigned char>& out, uint16_t value)
+{
+    out.push_back(value & 0xFF);
+    out.push_back(value >> 8);
+}
+
+void put32(std::vector<unsigned char>& out, uint32_t value)
+{
+    put16(out, value & 0xFFFF);
+    put16(out, value >> 16);
+}
+
+void put64(std::vector<unsigned char>& out, uint64_t value)
+{
+    put32(out, value & 0xFFFFFFFF);
+    put32(out, value >> 32);
+}
+
+void put_id(std::vector<unsigned char>& out, const char* id)
+{
+    out.insert(out.end(), id, id+4);
+}
+
+
+/* Appends one sample in the given encoding, and returns the value a reader
+ * should decode it as
+ */
+double encode(std::vector<unsigned char>& out, double value, unsigned format,
+        unsigned byte_depth)
+{
+    if(format == 3 && byte_depth == 4)
+    {
+        float f = value;
+        unsigned char bytes[4];
+        memcpy(bytes, &f, 4);
+        out.insert(out.end(), bytes, bytes+4);
+        return f;
+    }
+    if(format == 3)
+    {
+        unsigned char bytes[8];
+        memcpy(bytes, &value, 8);
+        out.insert(out.end(), bytes, bytes+8);
+        return (float) value;
+    }
+
+    // Integers are signed, except 8 bit which is offset by 128
+    double scale = pow(2.0, 8*byte_depth-1);
+    long long quantized = llround(value*scale);
+    long long stored = byte_depth == 1 ? quantized + 128 : quantized;
+    for(unsigned i = 0; i < byte_depth; i++)
+        out.push_back((stored >> 8*i) & 0xFF);
+    return quantized / scale;
+}
+
+
+/* Writes the described file holding num_frames frames of a test signal, and
+ * returns the samples of each channel a reader should decode
+ */
+std::vector<std::vector<double>> write_test_file(const char* filename,
+        const TestFile& test, unsigned num_frames)
+{
+    const unsigned sample_rate = 22050;
+    const unsigned block_align = test.num_channels*test.byte_depth;
+
+    std::vector<std::vector<double>> expected(test.num_channels);
+    std::vector<unsigned char> samples;
+    for(unsigned i = 0; i < num_frames; i++)
+    {
+        for(unsigned c = 0; c < test.num_channels; c++)
+        {
+            double value = 0.9*sin(0.01*(i+1)*(c+1));
+            expected[c].push_back(encode(samples, value, test.format,
+                        test.byte_depth));
+        }
+    }
+
+    std::vector<unsigned char> body;
+    put_id(body, "WAVE");
+    if(test.rf64)
+    {
+        put_id(body, "ds64");
+        put32(body, 28);
+        put64(body, 0); // RIFF size, which we do not need
+        put64(body, samples.size());
+        put64(body, num_frames);
+        put32(body, 0);
+    }
+
+    put_id(body, "fmt ");
+    put32(body, test.extensible ? 40 : 16);
+    put16(body, test.extensible ? 0xFFFE : test.format);
+    put16(body, test.num_channels);
+    put32(body, sample_rate);
+    put32(body, sample_rate*block_align);
+    put16(body, block_align);
+    put16(body, 8*test.byte_depth);
+    if(test.extensible)
+    {
+        const unsigned char guid_tail[] = {0x00, 0x00, 0x00, 0x00, 0x10, 0x00,
+            0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+        put16(body, 22);
+        put16(body, 8*test.byte_depth);
+        put32(body, 0);
+        put16(body, test.format);
+        body.insert(body.end(), guid_tail, guid_tail+sizeof(guid_tail));
+    }
+
+    if(test.odd_chunk)
+    {
+        put_id(body, "LIST");
+        put32(body, 3);
+        body.push_back('a');
+        body.push_back('b');
+        body.push_back('c');
+        body.push_back(0);
+    }
+
+    put_id(body, "data");
+    put32(body, test.rf64 ? 0xFFFFFFFF : samples.size());
+    body.insert(body.end(), samples.begin(), samples.end());
+    if(samples.size() % 2 == 1)
+        body.push_back(0);
+
+    std::vector<unsigned char> file;
+    put_id(file, test.rf64 ? "RF64" : "RIFF");
+    put32(file, test.rf64 ? 0xFFFFFFFF : body.size());
+    file.insert(file.end(), body.begin(), body.end());
+
+    std::ofstream out(filename, std::ios::binary);
+    out.write((const char*) &file[0], file.size());
+    if(!out)
+        throw "Failed to write test file";
+
+    return expected;
+}
+
+
+/* Generates the described file, then checks it decodes to the samples we
+ * wrote, both through read_all and through playback
+ */
+void check_reader(const TestFile& test)
+{
+    std::cout << "Reading " << test.name << std::endl;
+    const char* filename = "wav/test_reader.wav";
+    const unsigned num_frames = 1001;
+    std::vector<std::vector<double>> expected = write_test_file(filename,
+            test, num_frames);
+
+    WavReader wav(filename);
+    if(wav.get_num_channels() != test.num_channels ||
+            wav.get_sample_rate() != 22050 ||
+            wav.get_total_samples() != num_frames)
+        throw "Failed to parse wav header";
+
+    std::vector<std::vector<SAMPLE>> channels;
+    wav.read_all(channels);
+    for(unsigned c = 0; c < test.num_channels; c++)
+    {
+        for(unsigned i = 0; i < num_frames; i++)
+        {
+            if(fabs(channels[c][i] - expected[c][i]) > 1e-6)
+                throw "Failed to decode samples";
+        }
+    }
+
+    // Playback duplicates mono and drops channels past the second, then goes
+    // silent once the file runs out
+    TimingManager timer;
+    StereoRecorder recorder;
+    recorder.set_input_channel(wav.get_output_channel(0), 0);
+    recorder.set_input_channel(wav.get_output_channel(1), 1);
+    timer.add_audio_consumer(&recorder);
+    for(unsigned i = 0; i < (num_frames/BUFFER_SIZE + 2)*BUFFER_SIZE; i++)
+        timer.tick();
+    if(!wav.is_done())
+        throw "Failed to play the whole file";
+
+    const std::vector<double>& right = expected[test.num_channels > 1 ? 1 : 0];
+    for(unsigned i = 0; i < recorder.left.size(); i++)
+    {
+        double left_value = i < num_frames ? expected[0][i] : 0.0;
+        double right_value = i < num_frames ? right[i] : 0.0;
+        if(fabs(recorder.left[i] - left_value) > 1e-6 ||
+                fabs(recorder.right[i] - right_value) > 1e-6)
+            throw "Failed to play back samples";
+    }
+}
+
+
+/* Plays a different tone on each channel, which never reaches zero
+ */
+class TestSignal : public AudioGenerator
+{
+    public:
+        TestSignal() : AudioGenerator(2) {}
+
+        static SAMPLE value(unsigned long t, unsigned channel)
+        {
+            return 0.5 + 0.4*sin(0.01*(t+1)*(channel+1));
+        }
+
+    private:
+        void generate_block(std::vector<SAMPLE*>& outputs, unsigned long t)
+        {
+            for(unsigned c = 0; c < outputs.size(); c++)
+                for(unsigned i = 0; i < BUFFER_SIZE; i++)
+                    outputs[c][i] = value(t+i, c);
+        }
+};
+
+
+/* Writes a test signal in the given format, skipping a few blocks as if they
+ * were dropped, then reads it back and checks the samples and header
+ */
+void check_writer(WavWriter::Format format, const char* name,
+        double tolerance)
+{
+    std::cout << "Writing " << name << std::endl;
+    const char* filename = "wav/test_writer.wav";
+    const unsigned num_blocks = 40;
+    const unsigned num_frames = num_blocks*BUFFER_SIZE;
+    auto dropped = [](unsigned block) {
+        return block == 10 || block == 11 || block == 25;
+    };
+
+    // The header is only fixed up once the writer is destroyed
+    {
+        TestSignal signal;
+        WavWriter writer(filename, 2, format);
+        writer.set_lossless(true);
+        writer.set_input_channel(signal.get_output_channel(0), 0);
+        writer.set_input_channel(signal.get_output_channel(1), 1);
+
+        AudioGraph graph;
+        graph.add_consumer(&writer);
+        for(unsigned block = 0; block < num_blocks; block++)
+            if(!dropped(block))
+                graph.run(block*BUFFER_SIZE);
+    }
+
+    std::ifstream in(filename, std::ios::binary);
+    std::vector<unsigned char> header(80);
+    in.read((char*) &header[0], header.size());
+    in.seekg(0, std::ios::end);
+    unsigned long long file_size = in.tellg();
+    unsigned frame_size = format == WavWriter::PCM16 ? 4 :
+        format == WavWriter::PCM24 ? 6 : 8;
+    uint32_t riff_size = header[4] | header[5] << 8 | header[6] << 16 |
+        (uint32_t) header[7] << 24;
+    uint32_t data_size = header[76] | header[77] << 8 | header[78] << 16 |
+        (uint32_t) header[79] << 24;
+    if(riff_size != file_size - 8 || data_size != num_frames*frame_size)
+        throw "Failed to fix up the header";
+
+    WavReader wav(filename);
+    if(wav.get_num_channels() != 2 || wav.get_sample_rate() != SAMPLE_RATE ||
+            wav.get_total_samples() != num_frames)
+        throw "Failed to read back the header";
+
+    // Dropped blocks must come back as silence, in place
+    std::vector<std::vector<SAMPLE>> channels;
+    wav.read_all(channels);
+    for(unsigned c = 0; c < 2; c++)
+    {
+        for(unsigned i = 0; i < num_frames; i++)
+        {
+            SAMPLE expected = dropped(i/BUFFER_SIZE) ? 0.0 :
+                TestSignal::value(i, c);
+            if(fabs(channels[c][i] - expected) > tolerance)
+                throw "Failed to read back the written samples";
+        }
+    }
+}
+
+
 int main()
 {
+    const TestFile tests[] = {
+        // name, format, bytes, channels, extensible, rf64, odd chunk
+        {"8 bit mono", 1, 1, 1, false, false, false},
+        {"16 bit stereo", 1, 2, 2, false, false, false},
+        {"24 bit stereo", 1, 3, 2, false, false, false},
+        {"32 bit stereo", 1, 4, 2, false, false, false},
+        {"32 bit float stereo", 3, 4, 2, false, false, false},
+        {"64 bit float stereo", 3, 8, 2, false, false, false},
+        {"extensible 24 bit", 1, 3, 2, true, false, false},
+        {"extensible 32 bit float", 3, 4, 2, true, false, false},
+        {"RF64 16 bit", 1, 2, 2, false, true, false},
+        {"RF64 extensible 64 bit float", 3, 8, 2, true, true, false},
+        {"odd chunk, 16 bit", 1, 2, 2, false, false, true},
+        {"odd chunk, odd data, 24 bit mono", 1, 3, 1, false, false, true},
+        {"3 channel 32 bit float", 3, 4, 3, false, false, false},
+        {"6 channel 16 bit", 1, 2, 6, true, false, false},
+    };
+    for(auto& test : tests)
+        check_reader(test);
+    std::cout << std::endl;
+
+    check_writer(WavWriter::PCM16, "16 bit", 1.0/32768);
+    check_writer(WavWriter::PCM24, "24 bit", 1.0/8388608);
+    check_writer(WavWriter::FLOAT32, "32 bit float", 0.0);
+    std::cout << std::endl;
+
+
     try
     {
         std::cout << "Initializing signal chain" << std::endl;